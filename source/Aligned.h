@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+/// @brief Allocator handing out storage aligned to Alignment bytes, e.g. a cache line.
+template <typename T, size_t Alignment>
+struct AlignedAllocator {
+    using value_type = T;
+
+    template <typename U>
+    struct rebind {
+        using other = AlignedAllocator<U, Alignment>;
+    };
+
+    AlignedAllocator() = default;
+
+    template <typename U>
+    AlignedAllocator(const AlignedAllocator<U, Alignment> &) {}
+
+    T *allocate(size_t n) {
+        return static_cast<T *>(::operator new(n * sizeof(T), std::align_val_t{Alignment}));
+    }
+
+    void deallocate(T *p, size_t) {
+        ::operator delete(p, std::align_val_t{Alignment});
+    }
+
+    template <typename U>
+    bool operator==(const AlignedAllocator<U, Alignment> &) const { return true; }
+};
+
+/// Cache line size assumed for the alignment of hot arrays
+constexpr size_t CacheLine = 64;
+
+template <typename T>
+using AlignedVector = std::vector<T, AlignedAllocator<T, CacheLine>>;
@@ -1,17 +1,21 @@
 #include "App.h"
 #include "ConfigFunctions.h"
 #include "Math.h"
-#include "QuadTree.h"
 #include "Vec.h"
+#include "WorldFile.h"
 
 #include <SDL3/SDL_error.h>
 #include <SDL3/SDL_image.h>
 #include <SDL3/SDL_init.h>
+#include <SDL3/SDL_keyboard.h>
+#include <SDL3/SDL_mouse.h>
 #include <SDL3/SDL_render.h>
 #include <SDL3/SDL_video.h>
 #include <backends/imgui_impl_sdl3.h>
 #include <backends/imgui_impl_sdlrenderer3.h>
 #include <imgui.h>
+#include <algorithm>
+#include <chrono>
 #include <string>
 
 #include <entt/entt.hpp>
@@ -47,6 +51,15 @@ std::unique_ptr<IApp> CreateApp(Config &config, State &state, int16_t width,
     return nullptr;
   }
   SDL_Texture *spriteTexture = SDL_CreateTextureFromSurface(renderer, surface);
+  SDL_Texture *densityTexture = SDL_CreateTexture(
+      renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STREAMING,
+      width / DensityRenderer::TileSize, height / DensityRenderer::TileSize);
+  if (densityTexture == nullptr) {
+    printf("Density texture could not be created! SDL Error: %s\n",
+           SDL_GetError());
+    return nullptr;
+  }
+  SDL_SetTextureScaleMode(densityTexture, SDL_SCALEMODE_LINEAR);
 
   // ####################################
   // ## IMGUI
@@ -64,15 +77,15 @@ std::unique_ptr<IApp> CreateApp(Config &config, State &state, int16_t width,
   ImGui_ImplSDLRenderer3_Init(renderer);
 
   return std::make_unique<App>(config, state, width, height, window, renderer,
-                               surface, spriteTexture);
+                               surface, spriteTexture, densityTexture);
 }
 
 App::App(Config &config, State &state, int16_t width, int16_t height,
          SDL_Window *window, SDL_Renderer *renderer, SDL_Surface *surface,
-         SDL_Texture *spriteTexture)
-    : mConfig(config), mState(state), mWidth(width), mHeight(height),
-      mWindow(window), mRenderer(renderer), mSurface(surface),
-      mSpriteTexture(spriteTexture) {}
+         SDL_Texture *spriteTexture, SDL_Texture *densityTexture)
+    : mConfig(config), mState(state), mEngine(config, state, width, height),
+      mSimulation(mEngine), mUiConfig(config), mWidth(width), mHeight(height), mWindow(window), mRenderer(renderer), mSurface(surface),
+      mSpriteTexture(spriteTexture), mDensityTexture(densityTexture) {}
 
 App::~App() {
   // ####################################
@@ -85,6 +98,8 @@ App::~App() {
   // ## SDL
   SDL_DestroyTexture(mSpriteTexture);
   mSpriteTexture = nullptr;
+  SDL_DestroyTexture(mDensityTexture);
+  mDensityTexture = nullptr;
 
   // Deallocate surface
   SDL_DestroySurface(mSurface);
@@ -106,14 +121,19 @@ void App::Run() {
 
   bool quit = false;
   mLastMeasurement = SDL_GetTicks();
+  mSimulation.start();
 
   while (!quit) {
+    PROFILE_SCOPE("Frame");
+    mProfilerWindow.frame();
     ++mFramesCount;
 
     const auto now = SDL_GetTicks();
     if (now - mLastMeasurement > Second) {
-      const std::string title = std::format("Particles: {} FPS: {}",
-                                            mState.colors.size(), mFramesCount);
+      const std::string title = std::format(
+          "Particles: {} Sim: {:.0f} Hz FPS: {}",
+          mSimulation.snapshot().colors.size(),
+          mSimulation.stepsPerSecond(), mFramesCount);
       SDL_SetWindowTitle(mWindow, title.c_str());
 
       mLastMeasurement = now;
@@ -123,11 +143,12 @@ void App::Run() {
     quit = Update();
     Render();
   }
+
+  mSimulation.stop();
 }
 
 bool App::Update() {
-  // TODO: RSTA Remove rmb
-  static bool rmb = false;
+  PROFILE_SCOPE("Poll events");
   const ImGuiIO &io = ImGui::GetIO();
 
   SDL_Event e;
@@ -150,7 +171,9 @@ bool App::Update() {
       case SDLK_4:
       case SDLK_5:
       case SDLK_6:
-        mCurrentColor = e.key.key - SDLK_1;
+        if (static_cast<int>(e.key.key - SDLK_1) < mUiConfig.colorsCount) {
+          mCurrentColor = e.key.key - SDLK_1;
+        }
         break;
 
       case SDLK_SPACE:
@@ -160,6 +183,34 @@ bool App::Update() {
       case SDLK_Z:
         GenerateNewConfig();
         break;
+
+      case SDLK_T:
+        mSimulation.setTurbo(!mSimulation.turbo());
+        break;
+
+      case SDLK_F5:
+        SaveWorld();
+        break;
+
+      case SDLK_F9:
+        LoadWorld();
+        break;
+
+      case SDLK_P:
+        mProfilerWindow.dumpTrace(TracePath);
+        break;
+
+      case SDLK_E:
+        mBrushErase = !mBrushErase;
+        break;
+
+      case SDLK_R:
+        if (mSimulation.recording()) {
+          mSimulation.push(StopRecordingCommand{});
+        } else {
+          mSimulation.push(StartRecordingCommand{TrajectoryPath});
+        }
+        break;
       }
     } else if (e.type == SDL_EVENT_MOUSE_BUTTON_DOWN) {
       if (e.button.button == 1) {
@@ -168,28 +219,34 @@ bool App::Update() {
 
         AddParticle(static_cast<float>(mx), static_cast<float>(my),
                     mCurrentColor);
-      } else if (e.button.button == 3) {
-        rmb = true;
-      }
-    } else if (e.type == SDL_EVENT_MOUSE_BUTTON_UP) {
-      if (e.button.button == 3) {
-        rmb = false;
-      }
-    } else if (e.type == SDL_EVENT_MOUSE_MOTION) {
-      if (rmb) {
-        const float mx = e.motion.x;
-        const float my = e.motion.y;
-
-        AddParticle(mx, my, mCurrentColor);
       }
     }
   }
 
-  UpdateParticlesBruteForce();
-
+  if (!io.WantCaptureMouse) {
+    ApplyBrush();
+  }
   return false;
 }
 
+void App::ApplyBrush() {
+  float x = 0;
+  float y = 0;
+  if ((SDL_GetMouseState(&x, &y) & SDL_BUTTON_RMASK) == 0) {
+    return;
+  }
+  // Once per frame rather than per motion event, so the rate does not depend
+  // on how fast the mouse moves.
+  const Disc region{x, y, mBrushRadius};
+  const bool erase = mBrushErase != ((SDL_GetModState() & SDL_KMOD_SHIFT) != 0);
+  if (erase) {
+    mSimulation.push(EraseParticlesCommand{region});
+  } else {
+    mSimulation.push(SpawnParticlesCommand{
+        region, static_cast<uint32_t>(mBrushRate), mCurrentColor});
+  }
+}
+
 void App::Render() {
   constexpr ImVec4 clearColor = ImVec4(0.0f, 0.0f, 0.0f, 1.0f);
   SDL_SetRenderDrawColor(
@@ -197,229 +254,177 @@ void App::Render() {
       (Uint8)(clearColor.z * 255), (Uint8)(clearColor.w * 255));
   SDL_RenderClear(mRenderer);
 
-  RenderParticles();
+  const Snapshot &snapshot = mSimulation.snapshot();
+  RenderParticles(snapshot);
 
   // const ImGuiIO& io = ImGui::GetIO();
   // SDL_SetRenderScale(mRenderer, io.DisplayFramebufferScale.x,
   // io.DisplayFramebufferScale.y);
 
-  ImGui_ImplSDLRenderer3_NewFrame();
-  ImGui_ImplSDL3_NewFrame();
-  ImGui::NewFrame();
+  {
+    PROFILE_SCOPE("ImGui build");
+    ImGui_ImplSDLRenderer3_NewFrame();
+    ImGui_ImplSDL3_NewFrame();
+    ImGui::NewFrame();
+
+    static bool open = false;
+    ImGui::Begin(
+        "Particles!",
+        &open); // Create a window called "Hello, world!" and append into it.
+    ImGui::Text("Simulation: %.0f Hz, step %llu", mSimulation.stepsPerSecond(),
+                static_cast<unsigned long long>(snapshot.step));
+    ImGui::Text("Render: %.0f FPS", ImGui::GetIO().Framerate);
+    if (mDensityActive) {
+      ImGui::TextDisabled("Too crowded for sprites, drawing the density");
+    }
+    if (mSimulation.recording()) {
+      ImGui::TextColored(ImVec4(1.0f, 0.3f, 0.3f, 1.0f),
+                         "Recording to %s (R to stop)", TrajectoryPath);
+    }
+    RenderTiming();
+    RenderBrush();
+    if (RenderConfig(mUiConfig, mCurrentColor)) {
+      mSimulation.push(SetConfigCommand{mUiConfig});
+    }
+    ImGui::End();
 
-  static bool open = false;
-  ImGui::Begin(
-      "Particles!",
-      &open); // Create a window called "Hello, world!" and append into it.
-  RenderConfig(mConfig, mCurrentColor);
-  ImGui::End();
+    ImGui::Begin("Profiler");
+    mProfilerWindow.render();
+    ImGui::End();
 
-  ImGui::Render();
+    ImGui::Render();
+  }
 
+  PROFILE_SCOPE("Present");
   ImGui_ImplSDLRenderer3_RenderDrawData(ImGui::GetDrawData(), mRenderer);
   SDL_RenderPresent(mRenderer);
 }
 
-void App::RenderParticles() {
-  for (size_t i = 0; i < mState.colors.size(); ++i) {
-    const Position &pos = mState.pos[i];
-    const int col = mState.colors[i];
-
-    const float screenX = pos.x;
-    const float screenY = pos.y;
-
-    DrawParticle(screenX, screenY, mConfig.particleSize, col);
+void App::RenderParticles(const Snapshot &snapshot) {
+  PROFILE_SCOPE("Draw particles");
+  interpolatePositions(snapshot, mWidth, mHeight,
+                       std::chrono::steady_clock::now(), mInterpolated);
+
+  // Past a few particles per pixel the sprites only pile up into noise, and
+  // drawing them costs more than counting them.
+  int windowWidth = 0;
+  int windowHeight = 0;
+  SDL_GetWindowSizeInPixels(mWindow, &windowWidth, &windowHeight);
+  mDensityActive = DensityRenderer::wanted(
+      mInterpolated.size(), static_cast<double>(windowWidth) * windowHeight,
+      mDensityActive);
+  if (!mDensityActive) {
+    mParticleRenderer.render(mRenderer, mSpriteTexture, mUiConfig,
+                             snapshot.colors, mInterpolated);
+    return;
   }
-}
 
-void App::DrawParticle(float x, float y, int size, int color) {
-  const float offset = size / 2;
-  SDL_FRect dst{.x = x - offset,
-                .y = y - offset,
-                .w = static_cast<float>(size),
-                .h = static_cast<float>(size)};
-
-  const Rgb rgb = mConfig.particleColors[color];
-  SDL_SetTextureColorMod(mSpriteTexture, static_cast<char>(255 * rgb.r),
-                         static_cast<char>(255 * rgb.g),
-                         static_cast<char>(255 * rgb.b));
-  SDL_RenderTexture(mRenderer, mSpriteTexture, nullptr, &dst);
+  void *pixels = nullptr;
+  int pitch = 0;
+  if (!SDL_LockTexture(mDensityTexture, nullptr, &pixels, &pitch)) {
+    printf("Could not lock the density texture: %s\n", SDL_GetError());
+    return;
+  }
+  const PixelBuffer target{static_cast<uint8_t *>(pixels), pitch,
+                           mDensityTexture->w, mDensityTexture->h};
+  mDensityRenderer.render(target, mWidth, mHeight, mUiConfig, snapshot.colors,
+                          mInterpolated);
+  SDL_UnlockTexture(mDensityTexture);
+  const SDL_FRect world{0, 0, static_cast<float>(mWidth),
+                        static_cast<float>(mHeight)};
+  SDL_RenderTexture(mRenderer, mDensityTexture, nullptr, &world);
 }
 
-void App::AddParticle(const float x, const float y, const int c) const {
-  mState.colors.push_back(c);
-  mState.pos.push_back(Position{.x = x, .y = y});
-  mState.vel.push_back(Velocity{});
+void App::AddParticle(const float x, const float y, const int c) {
+  mSimulation.push(AddParticleCommand{x, y, c});
 }
 
-void App::ClearParticles() const {
-  mState.colors.clear();
-  mState.pos.clear();
-  mState.vel.clear();
-}
+void App::ClearParticles() { mSimulation.push(ClearParticlesCommand{}); }
 
 void App::GenerateNewConfig() {
-  mConfig.minDistances = generateDistances(mConfig.colorsCount);
-  mConfig.forces = generateForces(mConfig.colorsCount);
-  mConfig.radii = generateRadii(mConfig.colorsCount);
+  mUiConfig.minDistances = generateDistances(mUiConfig.colorsCount);
+  mUiConfig.forces = generateForces(mUiConfig.colorsCount);
+  mUiConfig.radii = generateRadii(mUiConfig.colorsCount);
+  invalidateInteractions(mUiConfig);
+  mSimulation.push(SetConfigCommand{mUiConfig});
 }
 
-void App::UpdateParticlesBruteForce() {
-  const size_t count = mState.colors.size();
-  for (size_t i = 0; i < count; ++i) {
-    Vec totalForce;
-
-    for (size_t j = 0; j < count; ++j) {
-      if (i == j) {
-        continue;
-      }
-
-      Vec direction = Vec{mState.pos[j].x - mState.pos[i].x,
-                          mState.pos[j].y - mState.pos[i].y};
-
-      if (direction.x > 0.5f * mWidth) {
-        direction.x -= mWidth;
-      } else if (direction.x < -0.5f * mWidth) {
-        direction.x += mWidth;
-      }
-      if (direction.y > 0.5f * mHeight) {
-        direction.y -= mHeight;
-      } else if (direction.y < -0.5f * mHeight) {
-        direction.y += mHeight;
-      }
-
-      const float distance = direction.magnitude();
-      direction.normalize();
-
-      const int c1 = mState.colors[i];
-      const int c2 = mState.colors[j];
-      if (distance < mConfig.minDistances[c1][c2]) {
-        float factor = std::abs(mConfig.forces[c1][c2]) * -3;
-        factor *= map(distance, 0, mConfig.minDistances[c1][c2], 1, 0);
-        factor *= mConfig.k;
-
-        Vec force = distance != 0 ? direction : randomVec();
-        force.mul(factor);
-        totalForce.add(force);
-      }
-
-      if (distance < mConfig.radii[c1][c2]) {
-        float factor = mConfig.forces[c1][c2];
-        factor *= map(distance, 0, mConfig.radii[c1][c2], 1, 0);
-        factor *= mConfig.k;
-
-        Vec force = distance != 0 ? direction : randomVec();
-        force.mul(factor);
-        totalForce.add(force);
-      }
-    }
-
-    totalForce.mul(mConfig.dt);
-    mState.vel[i].x *= (mConfig.friction);
-    mState.vel[i].y *= (mConfig.friction);
-    mState.vel[i].x += totalForce.x;
-    mState.vel[i].y += totalForce.y;
-
-    const auto wrapFloat = [](float v, float l) {
-      if (v < 0) {
-        return v + l;
-      } else if (v > l) {
-        return v - l;
-      }
-      return v;
-    };
-
-    mState.pos[i].x = wrapFloat(mState.pos[i].x + mState.vel[i].x,
-                                static_cast<float>(mWidth));
-    mState.pos[i].y = wrapFloat(mState.pos[i].y + mState.vel[i].y,
-                                static_cast<float>(mHeight));
+void App::SaveWorld() { mSimulation.push(SaveWorldCommand{WorldPath}); }
+
+void App::LoadWorld() {
+  Config config;
+  State state;
+  int width = 0;
+  int height = 0;
+  std::string error;
+  if (!loadWorld(WorldPath, config, state, width, height, error)) {
+    printf("Could not load the world: %s\n", error.c_str());
+    return;
+  }
+  if (width != mWidth || height != mHeight) {
+    printf("Could not load the world: saved in a %dx%d window, this one is "
+           "%dx%d\n",
+           width, height, mWidth, mHeight);
+    return;
   }
+  mUiConfig = config;
+  // The loaded world may have fewer colors than the one drawn with so far.
+  mCurrentColor =
+      std::clamp(mCurrentColor, 0, std::max(config.colorsCount - 1, 0));
+  mSimulation.push(SetWorldCommand{std::move(config), std::move(state)});
 }
 
-void App::UpdateParticlesQuadTree() {
-  const size_t count = mState.colors.size();
-
-  const float hw = mWidth / 2.0f;
-  const float hh = mHeight / 2.0f;
-  QuadTree quadtree(Boundry{.x = hw, .y = hh, .width = hw, .height = hh}, 4);
-  for (const Position &p : mState.pos) {
-    quadtree.insert(p);
+void App::RenderTiming() {
+  float stepRate = mSimulation.stepRate();
+  if (ImGui::SliderFloat("steps/s", &stepRate, 10.0f, 240.0f, "%.0f")) {
+    mSimulation.setStepRate(stepRate);
   }
+  int maxCatchUpSteps = mSimulation.maxCatchUpSteps();
+  if (ImGui::SliderInt("catch up", &maxCatchUpSteps, 1, 16)) {
+    mSimulation.setMaxCatchUpSteps(maxCatchUpSteps);
+  }
+  bool turbo = mSimulation.turbo();
+  if (ImGui::Checkbox("Turbo", &turbo)) {
+    mSimulation.setTurbo(turbo);
+  }
+  ImGui::SameLine();
+  bool sleeping = mSimulation.sleeping();
+  if (ImGui::Checkbox("Sleep", &sleeping)) {
+    mSimulation.setSleeping(sleeping);
+  }
+  if (sleeping) {
+    ImGui::SameLine();
+    ImGui::Text("%.0f%% awake", 100 * mSimulation.awakeFraction());
+  }
+  ImGui::Separator();
+}
 
-  for (size_t i = 0; i < count; ++i) {
-    Vec totalForce;
-
-    const float radius = 250;
-    std::vector<Position> neighbours;
-    quadtree.query(Boundry{.x = mState.pos[i].x,
-                           .y = mState.pos[i].y,
-                           .width = radius,
-                           .height = radius},
-                   neighbours);
-
-    for (const Position &p : neighbours) {
-      Vec direction = Vec{p.x - mState.pos[i].x, p.y - mState.pos[i].y};
-
-      if (direction.x > 0.5f * mWidth) {
-        direction.x -= mWidth;
-      } else if (direction.x < -0.5f * mWidth) {
-        direction.x += mWidth;
-      }
-      if (direction.y > 0.5f * mHeight) {
-        direction.y -= mHeight;
-      } else if (direction.y < -0.5f * mHeight) {
-        direction.y += mHeight;
-      }
-
-      const float distance = direction.magnitude();
-      direction.normalize();
-
-      const int c1 = mState.colors[i];
-      const int c2 = mState.colors[i];
-      if (distance < mConfig.minDistances[c1][c2]) {
-        float factor = std::abs(mConfig.forces[c1][c2]) * -3;
-        factor *= map(distance, 0, mConfig.minDistances[c1][c2], 1, 0);
-        factor *= mConfig.k;
-
-        Vec force = distance != 0 ? direction : randomVec();
-        force.mul(factor);
-        totalForce.add(force);
-      }
-
-      if (distance < mConfig.radii[c1][c2]) {
-        float factor = mConfig.forces[c1][c2];
-        factor *= map(distance, 0, mConfig.radii[c1][c2], 1, 0);
-        factor *= mConfig.k;
-
-        Vec force = distance != 0 ? direction : randomVec();
-        force.mul(factor);
-        totalForce.add(force);
-      }
-    }
-
-    totalForce.mul(mConfig.dt);
-    mState.vel[i].x *= (mConfig.friction);
-    mState.vel[i].y *= (mConfig.friction);
-    mState.vel[i].x += totalForce.x;
-    mState.vel[i].y += totalForce.y;
-
-    const auto wrapFloat = [](float v, float l) {
-      if (v < 0) {
-        return v + l;
-      } else if (v > l) {
-        return v - l;
-      }
-      return v;
-    };
-
-    mState.pos[i].x = wrapFloat(mState.pos[i].x + mState.vel[i].x,
-                                static_cast<float>(mWidth));
-    mState.pos[i].y = wrapFloat(mState.pos[i].y + mState.vel[i].y,
-                                static_cast<float>(mHeight));
+void App::RenderBrush() {
+  ImGui::Text("Brush (right mouse button)");
+  int mode = mBrushErase ? 1 : 0;
+  if (ImGui::RadioButton("Spawn", &mode, 0)) {
+    mBrushErase = false;
   }
+  ImGui::SameLine();
+  if (ImGui::RadioButton("Erase (E, or hold Shift)", &mode, 1)) {
+    mBrushErase = true;
+  }
+  ImGui::SliderFloat("brush radius", &mBrushRadius, 2.0f, 200.0f, "%.0f");
+  ImGui::SliderInt("particles/frame", &mBrushRate, 1, 10000, "%d",
+                   ImGuiSliderFlags_Logarithmic);
+
+  float x = 0;
+  float y = 0;
+  SDL_GetMouseState(&x, &y);
+  if (!ImGui::GetIO().WantCaptureMouse) {
+    ImGui::GetBackgroundDrawList()->AddCircle(
+        ImVec2(x, y), mBrushRadius,
+        mBrushErase ? IM_COL32(255, 80, 80, 160) : IM_COL32(255, 255, 255, 96));
+  }
+  ImGui::Separator();
 }
 
-void App::RenderConfig(Config &config, int &currentColor) {
+bool App::RenderConfig(Config &config, int &currentColor) {
   constexpr ImVec2 colorBoxSize(25.0f, 25.0f);
 
   ImGui::Text("Current Color: %i",
@@ -511,15 +516,21 @@ void App::RenderConfig(Config &config, int &currentColor) {
     draw_list->PopClipRect();
   }
 
-  ImGui::SliderFloat("matrix", &config.matrix[lastSelectedY][lastSelectedX],
-                     -1.0f, 1.0f);
+  bool changed = false;
+  changed |= ImGui::SliderFloat(
+      "matrix", &config.matrix[lastSelectedY][lastSelectedX], -1.0f, 1.0f);
 
   ImGui::Separator();
-  ImGui::SliderFloat("rMax", &config.rMax, 0.01f, 1.0f);
+  changed |= ImGui::SliderFloat("rMax", &config.rMax, 0.01f, 1.0f);
   ImGui::SliderInt("size", &config.particleSize, 2, 20);
 
   ImGui::Separator();
-  ImGui::SliderFloat("dt", &config.dt, 0.01f, 1.0f);
-  ImGui::SliderFloat("Friction", &config.friction, 0.01f, 1.0f);
-  ImGui::SliderFloat("k", &config.k, 0.01f, 1.0f);
+  changed |= ImGui::SliderFloat("dt", &config.dt, 0.01f, 1.0f);
+  changed |= ImGui::SliderFloat("Friction", &config.friction, 0.01f, 1.0f);
+  changed |= ImGui::SliderFloat("k", &config.k, 0.01f, 1.0f);
+
+  if (changed) {
+    invalidateInteractions(config);
+  }
+  return changed;
 }
@@ -1,6 +1,11 @@
 #pragma once
 
+#include "DensityRenderer.h"
+#include "Engine.h"
 #include "IApp.h"
+#include "ParticleRenderer.h"
+#include "ProfilerWindow.h"
+#include "Simulation.h"
 
 struct SDL_Window;
 struct SDL_Renderer;
@@ -13,7 +18,8 @@ public:
 	App(Config& config, State& state, int16_t width, int16_t height, SDL_Window* window,
 		SDL_Renderer* renderer,
 		SDL_Surface* surface,
-		SDL_Texture* spriteTexture);
+		SDL_Texture* spriteTexture,
+		SDL_Texture* densityTexture);
 
 	~App() override;
 
@@ -23,20 +29,49 @@ private:
 	bool Update();
 	void Render();
 
-	void RenderParticles();
-	void DrawParticle(float x, float y, int size, int color);
+	void RenderParticles(const Snapshot& snapshot);
 
-	void AddParticle(const float x, const float y, const int c) const;
-	void ClearParticles() const;
-	void UpdateParticlesBruteForce();
-	void UpdateParticlesQuadTree();
+	void AddParticle(const float x, const float y, const int c);
+	void ClearParticles();
 
 	void GenerateNewConfig();
 
-	static void RenderConfig(Config&, int& currentColor);
+	/// @brief F5 and F9: save the simulated world to WorldPath and load it back
+	void SaveWorld();
+	void LoadWorld();
+
+	/// @brief While the right mouse button is held, spawns mBrushRate particles per frame under
+	/// the cursor or erases the particles there
+	void ApplyBrush();
+
+	/// @brief Step rate, catch up limit and turbo controls of the simulation
+	void RenderTiming();
+	/// @brief Brush mode, radius and rate, and the brush outline under the cursor
+	void RenderBrush();
+
+	/// @brief Returns true when a setting the simulation depends on was changed
+	static bool RenderConfig(Config&, int& currentColor);
+
+	static constexpr const char* WorldPath = "world.particles";
+	/// R starts and stops recording the trajectory here
+	static constexpr const char* TrajectoryPath = "trajectory.ptraj";
+	/// P writes the last seconds of profiler samples here
+	static constexpr const char* TracePath = "trace.json";
 
 	Config& mConfig;
 	State& mState;
+	/// Owned by the simulation thread while it runs
+	Engine mEngine;
+	Simulation mSimulation;
+	/// Copy of the config edited by the UI and used for drawing, sent to the simulation when it changes
+	Config mUiConfig;
+	/// Positions drawn this frame, interpolated between the last two steps
+	std::vector<Position> mInterpolated;
+	ParticleRenderer mParticleRenderer;
+	DensityRenderer mDensityRenderer;
+	/// Whether the last frame drew the density map instead of the particles
+	bool mDensityActive = false;
+	ProfilerWindow mProfilerWindow;
 
 	// entt::registry mRegistry;
 
@@ -44,10 +79,16 @@ private:
 	int mLastMeasurement = 0;
 	int mCurrentColor = 0;
 
+	float mBrushRadius = 24.0f;
+	int mBrushRate = 200;
+	bool mBrushErase = false;
+
 	int16_t mWidth = 0;
 	int16_t mHeight = 0;
 	SDL_Window* mWindow = nullptr;
 	SDL_Renderer* mRenderer = nullptr;
 	SDL_Surface* mSurface = nullptr;
 	SDL_Texture* mSpriteTexture = nullptr;
+	/// Streaming texture of DensityRenderer::TileSize world units per texel
+	SDL_Texture* mDensityTexture = nullptr;
 };
\ No newline at end of file
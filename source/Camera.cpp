@@ -0,0 +1,58 @@
+#include "Camera.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+/// Wraps value into [0, period), however far outside it is
+float Wrap(float value, float period) {
+    return value - std::floor(value / period) * period;
+}
+
+/// Offset of value from the view's left edge in a periodic world, where the part of the world
+/// outside the view is split in two halves at its middle, one left and one right of the view
+float ViewOffset(float value, float left, float visible, float period) {
+    const float offset = Wrap(value - left, period);
+    return offset > (period + visible) / 2 ? offset - period : offset;
+}
+} // namespace
+
+Camera::Camera(float width, float height) : mWidth(width), mHeight(height), mCenter{width / 2, height / 2} {}
+
+void Camera::reset() {
+    mCenter = Position{mWidth / 2, mHeight / 2};
+    mZoom = 1;
+}
+
+void Camera::pan(float dx, float dy) {
+    mCenter.x = Wrap(mCenter.x - dx / mZoom, mWidth);
+    mCenter.y = Wrap(mCenter.y - dy / mZoom, mHeight);
+}
+
+void Camera::zoomAt(float factor, Position anchor) {
+    const Position world = toWorld(anchor);
+    mZoom = std::clamp(mZoom * factor, 1.0f, MaxZoom);
+    // The anchor's offset from the view's centre shrinks with the zoom.
+    mCenter.x = Wrap(world.x + (mWidth / 2 - anchor.x) / mZoom, mWidth);
+    mCenter.y = Wrap(world.y + (mHeight / 2 - anchor.y) / mZoom, mHeight);
+}
+
+Boundry Camera::visibleRect() const {
+    const float width = mWidth / mZoom;
+    const float height = mHeight / mZoom;
+    return Boundry{mCenter.x - width / 2, mCenter.y - height / 2, width, height};
+}
+
+Position Camera::toView(Position world) const {
+    const Boundry rect = visibleRect();
+    return Position{ViewOffset(world.x, rect.x, rect.width, mWidth) * mZoom, ViewOffset(world.y, rect.y, rect.height, mHeight) * mZoom};
+}
+
+Position Camera::toWorld(Position view) const {
+    const Boundry rect = visibleRect();
+    return Position{Wrap(rect.x + view.x / mZoom, mWidth), Wrap(rect.y + view.y / mZoom, mHeight)};
+}
+
+bool Camera::identity() const {
+    return mZoom == 1 && mCenter.x == mWidth / 2 && mCenter.y == mHeight / 2;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "QuadTree.h"
+#include "State.h"
+
+/// @brief Zoom and pan over the periodic world. The view is as large as the world in pixels,
+/// at zoom z it shows a 1/z wide and high part of the world around the centre, which may
+/// straddle the world's edges; the part past an edge is filled from the opposite side.
+class Camera {
+public:
+    static constexpr float MaxZoom = 64;
+
+    Camera(float width, float height);
+
+    /// @brief Shows the whole world again.
+    void reset();
+
+    /// @brief Moves the view by dx, dy view pixels, the world follows the cursor.
+    void pan(float dx, float dy);
+    /// @brief Multiplies the zoom by factor, keeping the world point under the view point anchor
+    /// in place. The zoom stays within [1, MaxZoom].
+    void zoomAt(float factor, Position anchor);
+
+    /// @brief The part of the world in view. Its left and top edges may be negative or past the
+    /// world's right and bottom edges, the rectangle then wraps around.
+    Boundry visibleRect() const;
+
+    /// @brief View pixel of a world point. Points outside the view land left or right of it,
+    /// whichever side is nearer, so discs on the view's edge are drawn in part.
+    Position toView(Position world) const;
+    /// @brief World point at a view pixel, wrapped into the world.
+    Position toWorld(Position view) const;
+
+    float zoom() const { return mZoom; }
+    /// @brief True when the whole world is in view, drawn as is.
+    bool identity() const;
+
+private:
+    float mWidth;
+    float mHeight;
+    /// World point at the centre of the view
+    Position mCenter;
+    float mZoom = 1;
+};
@@ -0,0 +1,65 @@
+#include "CellList.h"
+#include "Profiler.h"
+#include <algorithm>
+
+void CellList::build(const State &state, float cellSize, float width, float height) {
+    PROFILE_SCOPE("Index build: cell list");
+    const std::vector<Position> &pos = state.pos;
+    mColumns = cellSize > 0 ? std::max(1, static_cast<int>(width / cellSize)) : 1;
+    mRows = cellSize > 0 ? std::max(1, static_cast<int>(height / cellSize)) : 1;
+    mInvCellWidth = mColumns / width;
+    mInvCellHeight = mRows / height;
+
+    const size_t count = pos.size();
+    const size_t cellsCount = static_cast<size_t>(mColumns) * mRows;
+    mCellStart.assign(cellsCount + 1, 0);
+    mSlots.resize(count);
+    mIndices.resize(count);
+    mX.resize(count);
+    mY.resize(count);
+    mColors.resize(count);
+
+    // Counting sort: histogram, exclusive prefix sum, scatter.
+    for(size_t i = 0; i < count; ++i) {
+        const uint32_t c = cellY(pos[i].y) * mColumns + cellX(pos[i].x);
+        mSlots[i] = c;
+        ++mCellStart[c + 1];
+    }
+    for(size_t c = 0; c < cellsCount; ++c) {
+        mCellStart[c + 1] += mCellStart[c];
+    }
+    for(size_t i = 0; i < count; ++i) {
+        const uint32_t s = mCellStart[mSlots[i]]++;
+        mSlots[i] = s;
+        mIndices[s] = static_cast<uint32_t>(i);
+        mX[s] = pos[i].x;
+        mY[s] = pos[i].y;
+        mColors[s] = state.colors[i];
+    }
+    // The scatter advanced every start to the start of the next cell; shift them back.
+    for(size_t c = cellsCount; c > 0; --c) {
+        mCellStart[c] = mCellStart[c - 1];
+    }
+    mCellStart[0] = 0;
+}
+
+int CellList::cellX(float x) const {
+    return std::clamp(static_cast<int>(x * mInvCellWidth), 0, mColumns - 1);
+}
+
+int CellList::cellY(float y) const {
+    return std::clamp(static_cast<int>(y * mInvCellHeight), 0, mRows - 1);
+}
+
+int CellList::neighbourCells(int c, int count, int (&out)[3]) {
+    if(count <= 3) {
+        for(int i = 0; i < count; ++i) {
+            out[i] = i;
+        }
+        return count;
+    }
+    out[0] = c == 0 ? count - 1 : c - 1;
+    out[1] = c;
+    out[2] = c == count - 1 ? 0 : c + 1;
+    return 3;
+}
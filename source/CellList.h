@@ -0,0 +1,90 @@
+#pragma once
+
+#include "ForceKernel.h"
+#include "State.h"
+#include <cstdint>
+#include <span>
+#include <utility>
+#include <vector>
+
+/// @brief Uniform grid over the periodic world. Cells are at least `cellSize` wide, so
+/// every particle within that distance of a point lives in the 3x3 block of cells around it.
+/// The grid is rebuilt from scratch every step with a counting sort, which also gathers the
+/// particles into separate x, y and color arrays ordered by cell.
+class CellList {
+public:
+    /// @brief Bins all particles into cells of at least cellSize x cellSize.
+    void build(const State &state, float cellSize, float width, float height);
+
+    /// @brief Calls f(begin, end) with the range of sorted slots of every cell around (x, y).
+    /// Each cell is visited once, even when the grid is narrower than three cells.
+    template <typename F>
+    void forEachNeighbourCell(float x, float y, F &&f) const {
+        int columns[3];
+        int rows[3];
+        const int columnsCount = neighbourCells(cellX(x), mColumns, columns);
+        const int rowsCount = neighbourCells(cellY(y), mRows, rows);
+
+        for(int r = 0; r < rowsCount; ++r) {
+            for(int c = 0; c < columnsCount; ++c) {
+                const size_t cell = static_cast<size_t>(rows[r]) * mColumns + columns[c];
+                f(mCellStart[cell], mCellStart[cell + 1]);
+            }
+        }
+    }
+
+    /// @brief Calls f(j) for the index of every particle stored in the cells around (x, y).
+    template <typename F>
+    void forEachNeighbour(float x, float y, F &&f) const {
+        forEachNeighbourCell(x, y, [&](uint32_t begin, uint32_t end) {
+            for(uint32_t s = begin; s < end; ++s) {
+                f(mIndices[s]);
+            }
+        });
+    }
+
+    /// @brief Indices of the particles binned into the given cell.
+    std::span<const uint32_t> cell(int cx, int cy) const {
+        const size_t c = static_cast<size_t>(cy) * mColumns + cx;
+        return {mIndices.data() + mCellStart[c], mIndices.data() + mCellStart[c + 1]};
+    }
+
+    /// @brief Range of sorted slots [first, second) of the given cell.
+    std::pair<uint32_t, uint32_t> slots(int cx, int cy) const {
+        const size_t c = static_cast<size_t>(cy) * mColumns + cx;
+        return {mCellStart[c], mCellStart[c + 1]};
+    }
+
+    /// @brief Columns of the cells around column cx, each once. Returns their count.
+    int neighbourColumns(int cx, int (&out)[3]) const { return neighbourCells(cx, mColumns, out); }
+
+    /// @brief Particles in cell order, as separate x, y and color arrays indexed by slot.
+    ParticleArrays sorted() const { return ParticleArrays{mX.data(), mY.data(), mColors.data()}; }
+
+    /// @brief Slot of particle i in the cell ordered arrays.
+    uint32_t slot(size_t i) const { return mSlots[i]; }
+
+    /// @brief Particle stored at the given slot of the cell ordered arrays.
+    uint32_t index(size_t slot) const { return mIndices[slot]; }
+
+    int cellX(float x) const;
+    int cellY(float y) const;
+    int columns() const { return mColumns; }
+    int rows() const { return mRows; }
+
+private:
+    static int neighbourCells(int c, int count, int (&out)[3]);
+
+    int mColumns = 0;
+    int mRows = 0;
+    float mInvCellWidth = 0;
+    float mInvCellHeight = 0;
+
+    std::vector<uint32_t> mCellStart;
+    std::vector<uint32_t> mIndices;
+    std::vector<uint32_t> mSlots;
+
+    std::vector<float> mX;
+    std::vector<float> mY;
+    std::vector<int32_t> mColors;
+};
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "Aligned.h"
 #include <cmath>
 #include <vector>
 
@@ -13,6 +14,36 @@ struct Rgb
 using ParticleColors = std::vector<Rgb>;
 using Matrix = std::vector<std::vector<float>>;
 
+/// Parameters of one (c1, c2) color pair, precomputed for the force loop
+struct alignas(32) Interaction {
+	float minDistance;
+	float minDistanceSq;
+	float invMinDistance;
+	/// Repulsion at distance 0, -3 * |force| * k
+	float repulsion;
+	float radius;
+	float radiusSq;
+	float invRadius;
+	/// Signed force at distance 0, force * k
+	float attraction;
+};
+
+/// Config compiled for the simulation step, rebuilt whenever the config changes
+struct InteractionTable {
+	int colorsCount = 0;
+	float dt = 0;
+	float friction = 0;
+	float frictionFactor = 0;
+	/// Largest radius or min distance of all pairs, the farthest two particles interact
+	float maxRadius = 0;
+	/// colorsCount x colorsCount records, row c1 holds the forces c2 exerts on c1
+	AlignedVector<Interaction> pairs;
+
+	const Interaction& at(int c1, int c2) const {
+		return pairs[c1 * colorsCount + c2];
+	}
+};
+
 struct Config {
 	int colorsCount = 5;
 	ParticleColors particleColors;
@@ -20,7 +51,6 @@ struct Config {
 	float dt = 0.75f;
 	float frictionHalfLife = 0.04f;
 	float rMax = 0.1f;
-	float frictionFactor = std::pow(0.5f, dt / frictionHalfLife);
 	float forceFactor = 10;
 	int particleSize = 4.0f;
 
@@ -31,4 +61,8 @@ struct Config {
 	Matrix radii;
 	float k = 0.05f;
 	float friction = 0.85f;
-};
\ No newline at end of file
+
+	/// Compiled from the fields above by interactions(), stale while interactionsDirty is set
+	InteractionTable interactions;
+	bool interactionsDirty = true;
+};
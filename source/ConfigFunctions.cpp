@@ -1,5 +1,7 @@
 #include "ConfigFunctions.h"
-#include "math.h"
+#include "Hash.h"
+#include "Math.h"
+#include <algorithm>
 #include <cassert>
 
 Matrix generateMatrix(const int m, std::function<float(int r, int c)> generator) {
@@ -45,6 +47,18 @@ Matrix generateRadii (const int m) {
 }
 
 
+Config generateRandomConfig(const int colorsCount)
+{
+	Config config;
+	config.colorsCount = colorsCount;
+	config.particleColors = generateRandomColors(config.colorsCount);
+	config.matrix = generateRandomMatrix(config.colorsCount);
+	config.minDistances = generateDistances(config.colorsCount);
+	config.forces = generateForces(config.colorsCount);
+	config.radii = generateRadii(config.colorsCount);
+	return config;
+}
+
 ParticleColors generateRandomColors(const int c)
 {
 	const Rgb rgbs[] = {ToRgb(255, 0, 0),
@@ -59,9 +73,9 @@ ParticleColors generateRandomColors(const int c)
 						ToRgb(237, 135, 45),
 						ToRgb(128, 128, 0),
 						ToRgb(165, 11, 94)};
-	assert(c < sizeof rgbs);
+	assert(c <= std::size(rgbs));
 
-	return ParticleColors(std::begin(rgbs), std::end(rgbs) + c);
+	return ParticleColors(std::begin(rgbs), std::begin(rgbs) + c);
 }
 
 Rgb ToRgb(int r_, int g_, int b_)
@@ -79,4 +93,70 @@ Rgb lerp(const Rgb &lhs, const Rgb &rhs, float t)
 	const float g = (1.0f - t) * lhs.g + t * rhs.g;
 	const float b = (1.0f - t) * lhs.b + t * rhs.b;
 	return Rgb{.r = r, .g = g, .b = b};
-}
\ No newline at end of file
+}
+float maxRadius(const Config &config)
+{
+	// The repulsion of a pair reaches out to its min distance, which may exceed its radius.
+	float radius = 0;
+	for (size_t c1 = 0; c1 < config.radii.size(); ++c1) {
+		for (size_t c2 = 0; c2 < config.radii[c1].size(); ++c2) {
+			radius = std::max(radius, config.radii[c1][c2]);
+			if (c1 < config.minDistances.size() && c2 < config.minDistances[c1].size()) {
+				radius = std::max(radius, config.minDistances[c1][c2]);
+			}
+		}
+	}
+	return radius;
+}
+
+const InteractionTable &interactions(Config &config)
+{
+	if (!config.interactionsDirty) {
+		return config.interactions;
+	}
+
+	InteractionTable &table = config.interactions;
+	table.colorsCount = config.colorsCount;
+	table.dt = config.dt;
+	table.friction = config.friction;
+	table.frictionFactor = std::pow(0.5f, config.dt / config.frictionHalfLife);
+	table.maxRadius = maxRadius(config);
+	table.pairs.resize(static_cast<size_t>(config.colorsCount) * config.colorsCount);
+	for (int c1 = 0; c1 < config.colorsCount; ++c1) {
+		for (int c2 = 0; c2 < config.colorsCount; ++c2) {
+			const float minDistance = config.minDistances[c1][c2];
+			const float radius = config.radii[c1][c2];
+			const float force = config.forces[c1][c2];
+			table.pairs[c1 * config.colorsCount + c2] = Interaction{
+				.minDistance = minDistance,
+				.minDistanceSq = minDistance * minDistance,
+				.invMinDistance = minDistance > 0 ? 1 / minDistance : 0,
+				.repulsion = std::abs(force) * -3 * config.k,
+				.radius = radius,
+				.radiusSq = radius * radius,
+				.invRadius = radius > 0 ? 1 / radius : 0,
+				.attraction = force * config.k,
+			};
+		}
+	}
+
+	config.interactionsDirty = false;
+	return table;
+}
+
+void invalidateInteractions(Config &config)
+{
+	config.interactionsDirty = true;
+}
+
+uint64_t configHash(Config &config)
+{
+	const InteractionTable &table = interactions(config);
+	// Every compiled field is a plain float or int.
+	uint64_t hash = FnvOffset;
+	hash = fnv1a(hash, table.colorsCount);
+	hash = fnv1a(hash, table.dt);
+	hash = fnv1a(hash, table.friction);
+	hash = fnv1a(hash, table.frictionFactor);
+	return fnv1a(hash, table.pairs.data(), table.pairs.size() * sizeof(Interaction));
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Config.h"
+#include <cstdint>
 #include <functional>
 
 Matrix generateMatrix(const int m, std::function<float(int r, int c)> generator);
@@ -12,8 +13,23 @@ Matrix generateForces(const int m);
 Matrix generateDistances (const int m);
 Matrix generateRadii (const int m);
 
+/// Creates a config with colorsCount colors and random interactions between them
+Config generateRandomConfig(const int colorsCount);
+
 /// Creates the Rgb structure using r, g, b values in range [0, 255]
 Rgb ToRgb(int r_, int g_, int b_);
 
 
 Rgb lerp(const Rgb &lhs, const Rgb &rhs, float t);
+
+/// Returns the largest interaction radius or min distance, i.e. the farthest any two particles can interact
+float maxRadius(const Config &config);
+
+/// Returns the interaction table of the config, compiling it first if the config changed
+const InteractionTable &interactions(Config &config);
+
+/// Marks the interaction table stale, call after changing any simulation parameter
+void invalidateInteractions(Config &config);
+
+/// Hash of the interaction table, the same for configs the simulation steps alike
+uint64_t configHash(Config &config);
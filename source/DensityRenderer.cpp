@@ -0,0 +1,122 @@
+#include "DensityRenderer.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+constexpr uint8_t Black[4] = {0, 0, 0, 255};
+
+uint8_t ToByte(float channel) {
+    return static_cast<uint8_t>(std::clamp(channel, 0.0f, 1.0f) * 255);
+}
+} // namespace
+
+DensityRenderer::DensityRenderer(size_t threadsCount) : mThreadPool(threadsCount) {}
+
+void DensityRenderer::render(const PixelBuffer &target, float width, float height, const Config &config, std::span<const int> colors,
+                             std::span<const Position> pos) {
+    if(target.width <= 0 || target.height <= 0) {
+        return;
+    }
+
+    const size_t colorsCount = config.particleColors.size();
+    const size_t texels = static_cast<size_t>(target.width) * target.height;
+    const size_t histogramSize = texels * colorsCount;
+    const size_t count = pos.size();
+    const size_t partials = std::clamp<size_t>(count / MinPartialSize, 1, threadsCount());
+    mHistograms.resize(partials * histogramSize);
+
+    // Every partial clears its own histogram, so the memory is touched by the thread that counts into it.
+    const float scaleX = target.width / width;
+    const float scaleY = target.height / height;
+    mThreadPool.parallelFor(partials, 1, [&](size_t begin, size_t end) {
+        for(size_t partial = begin; partial < end; ++partial) {
+            uint32_t *histogram = mHistograms.data() + partial * histogramSize;
+            std::fill_n(histogram, histogramSize, 0);
+            const size_t first = count * partial / partials;
+            const size_t last = count * (partial + 1) / partials;
+            for(size_t i = first; i < last; ++i) {
+                // Positions past the edges, e.g. of discs that only touch a zoomed view, are left out.
+                if(pos[i].x < 0 || pos[i].x > width || pos[i].y < 0 || pos[i].y > height) {
+                    continue;
+                }
+                const int x = std::min(static_cast<int>(pos[i].x * scaleX), target.width - 1);
+                const int y = std::min(static_cast<int>(pos[i].y * scaleY), target.height - 1);
+                ++histogram[(static_cast<size_t>(y) * target.width + x) * colorsCount + colors[i]];
+            }
+        }
+    });
+
+    const size_t rows = static_cast<size_t>(target.height);
+    const size_t columns = static_cast<size_t>(target.width);
+    const size_t rowSize = columns * colorsCount;
+    mTotals.resize(texels);
+    mRowMax.resize(rows);
+    mThreadPool.parallelFor(rows, RowChunkSize, [&](size_t begin, size_t end) {
+        for(size_t y = begin; y < end; ++y) {
+            uint32_t *merged = mHistograms.data() + y * rowSize;
+            for(size_t partial = 1; partial < partials; ++partial) {
+                const uint32_t *row = mHistograms.data() + partial * histogramSize + y * rowSize;
+                for(size_t k = 0; k < rowSize; ++k) {
+                    merged[k] += row[k];
+                }
+            }
+            uint32_t *totals = mTotals.data() + y * columns;
+            uint32_t rowMax = 0;
+            for(size_t x = 0; x < columns; ++x) {
+                uint32_t total = 0;
+                for(size_t c = 0; c < colorsCount; ++c) {
+                    total += merged[x * colorsCount + c];
+                }
+                totals[x] = total;
+                rowMax = std::max(rowMax, total);
+            }
+            mRowMax[y] = rowMax;
+        }
+    });
+
+    mPalette.resize(colorsCount);
+    std::copy(config.particleColors.begin(), config.particleColors.end(), mPalette.begin());
+    uint32_t black = 0;
+    std::memcpy(&black, Black, 4);
+
+    // Log scale, so a lone particle still shows next to a clump of thousands
+    const uint32_t max = *std::max_element(mRowMax.begin(), mRowMax.end());
+    const float brightnessScale = max == 0 ? 0.0f : 1.0f / std::log1p(static_cast<float>(max));
+    mThreadPool.parallelFor(rows, RowChunkSize, [&](size_t begin, size_t end) {
+        const Rgb *palette = mPalette.data();
+        for(size_t y = begin; y < end; ++y) {
+            const uint32_t *merged = mHistograms.data() + y * rowSize;
+            const uint32_t *totals = mTotals.data() + y * columns;
+            uint32_t *row = reinterpret_cast<uint32_t *>(target.pixels + y * target.pitch);
+            for(size_t x = 0; x < columns; ++x) {
+                const uint32_t total = totals[x];
+                if(total == 0) {
+                    row[x] = black;
+                    continue;
+                }
+                const uint32_t *counts = merged + x * colorsCount;
+                Rgb sum{0, 0, 0};
+                for(size_t c = 0; c < colorsCount; ++c) {
+                    const float n = static_cast<float>(counts[c]);
+                    sum.r += n * palette[c].r;
+                    sum.g += n * palette[c].g;
+                    sum.b += n * palette[c].b;
+                }
+                // The mean color of the texel's particles, scaled by how many there are
+                const float scale = std::log1p(static_cast<float>(total)) * brightnessScale / total;
+                const uint8_t pixel[4] = {ToByte(sum.r * scale), ToByte(sum.g * scale), ToByte(sum.b * scale), 255};
+                std::memcpy(&row[x], pixel, 4);
+            }
+        }
+    });
+}
+
+bool DensityRenderer::wanted(size_t particles, double pixels, bool active) {
+    if(pixels <= 0) {
+        return active;
+    }
+    const double density = static_cast<double>(particles) / pixels;
+    return density > (active ? LeaveDensity : EnterDensity);
+}
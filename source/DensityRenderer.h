@@ -0,0 +1,58 @@
+#pragma once
+
+#include "Config.h"
+#include "PixelBuffer.h"
+#include "State.h"
+#include "ThreadPool.h"
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <thread>
+#include <vector>
+
+/// @brief Level of detail renderer for large particle counts: instead of drawing every particle it
+/// counts the particles of every color per texel and tone-maps the counts into an image, brighter
+/// where more particles are and tinted by the mix of their colors. Every thread counts a slice
+/// of the particles into a histogram of its own, the histograms are then merged row by row, so
+/// the cost is one pass over the particles plus a few passes over the texels.
+class DensityRenderer {
+public:
+    /// World units per texel of the textures the apps draw the density into
+    static constexpr int TileSize = 2;
+
+    explicit DensityRenderer(size_t threadsCount = std::thread::hardware_concurrency());
+
+    /// @brief Fills target with the density of the particles of a width x height world, each
+    /// texel covering width / target.width x height / target.height world units. Particles
+    /// outside the world are not counted.
+    void render(const PixelBuffer &target, float width, float height, const Config &config, std::span<const int> colors,
+                std::span<const Position> pos);
+
+    /// @brief Whether particles drawn on pixels screen pixels are dense enough for the density map.
+    /// active is whether it is used now, it is kept until the density falls a bit below the
+    /// threshold so the view does not flicker between the two around it.
+    static bool wanted(size_t particles, double pixels, bool active);
+
+    size_t threadsCount() const { return mThreadPool.threadsCount(); }
+
+private:
+    /// Particles per screen pixel above which the density map replaces the particles, about 200k
+    /// particles in the default 1280x960 window
+    static constexpr double EnterDensity = 0.15;
+    static constexpr double LeaveDensity = 0.1;
+    /// Fewest particles worth a histogram of their own
+    static constexpr size_t MinPartialSize = 1 << 15;
+    /// Texel rows merged and tone-mapped by one task
+    static constexpr size_t RowChunkSize = 8;
+
+    ThreadPool mThreadPool;
+    /// Partial histograms one after the other, counts of texel t and color c at t * colors + c.
+    /// The first one holds the merged counts.
+    std::vector<uint32_t> mHistograms;
+    /// Particles of every texel
+    std::vector<uint32_t> mTotals;
+    /// Most particles in one texel of every row
+    std::vector<uint32_t> mRowMax;
+    /// Config colors copied once per frame
+    std::vector<Rgb> mPalette;
+};
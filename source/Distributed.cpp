@@ -0,0 +1,324 @@
+#include "Distributed.h"
+#include "ConfigFunctions.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+/// A particle on the wire, between workers and back to the coordinator
+struct WireParticle {
+    uint32_t id;
+    int32_t color;
+    Position pos;
+    Velocity vel;
+};
+
+/// What a worker sends the coordinator before its particles
+struct WorkerResult {
+    uint64_t haloParticles;
+    uint64_t migrations;
+};
+
+/// Splits the world's x axis into strips
+class Strips {
+public:
+    Strips(int count, float width) : mCount(count), mWidth(width) {}
+
+    int count() const { return mCount; }
+    float begin(int strip) const { return strip * mWidth / mCount; }
+    float end(int strip) const { return (strip + 1) * mWidth / mCount; }
+    int of(float x) const { return std::clamp(static_cast<int>(x * mCount / mWidth), 0, mCount - 1); }
+    int left(int strip) const { return (strip + mCount - 1) % mCount; }
+    int right(int strip) const { return (strip + 1) % mCount; }
+
+private:
+    int mCount;
+    float mWidth;
+};
+
+template <typename T>
+void Append(std::vector<std::byte> &bytes, const T &value) {
+    const auto *begin = reinterpret_cast<const std::byte *>(&value);
+    bytes.insert(bytes.end(), begin, begin + sizeof(T));
+}
+
+/// Appends the particles of a message to particles
+void AppendParticles(std::span<const std::byte> bytes, std::vector<WireParticle> &particles) {
+    const size_t count = bytes.size() / sizeof(WireParticle);
+    const size_t first = particles.size();
+    particles.resize(first + count);
+    std::memcpy(particles.data() + first, bytes.data(), count * sizeof(WireParticle));
+}
+
+/// The channels of one worker, to the workers of the strips left and right of it and to the
+/// coordinator. With one worker there are no neighbours.
+struct WorkerLinks {
+    Channel *left = nullptr;
+    Channel *right = nullptr;
+    Channel *coordinator = nullptr;
+};
+
+/// Steps the strip of one worker process and sends the result to the coordinator
+bool RunWorker(int strip, const Strips &strips, Config &config, std::vector<WireParticle> owned, uint32_t nextId, int16_t width,
+               int16_t height, int steps, const DistributedSettings &settings, const WorkerLinks &links, std::string &error) {
+    State state;
+    Engine engine(config, state, width, height, settings.threadsPerWorker);
+    engine.setBackend(settings.backend);
+    // The owned particles go first and have to stay there, the halo behind them.
+    engine.spatialSorter() = SpatialSorter(SpatialSorter::Settings{.interval = 0, .checkInterval = 0});
+
+    const float radius = interactions(config).maxRadius;
+    const float begin = strips.begin(strip);
+    const float end = strips.end(strip);
+    const int leftStrip = strips.left(strip);
+    const int rightStrip = strips.right(strip);
+    // With two strips both borders face the same worker, which must get each particle once.
+    const bool sameNeighbour = leftStrip == rightStrip;
+    Channel *const neighbours[] = {links.left, links.right};
+    std::vector<std::byte> outgoing[2];
+    std::vector<std::byte> incoming[2];
+    std::vector<WireParticle> received;
+    uint64_t haloParticles = 0;
+    uint64_t migrations = 0;
+
+    // Appends what the neighbours sent to particles
+    const auto exchangeWithNeighbours = [&](std::vector<WireParticle> &particles) {
+        if(strips.count() == 1) {
+            return true;
+        }
+        if(!exchange(neighbours, outgoing, incoming, error)) {
+            return false;
+        }
+        for(const std::vector<std::byte> &message : incoming) {
+            AppendParticles(message, particles);
+        }
+        return true;
+    };
+
+    for(int step = 0; step < steps; ++step) {
+        // Halo: the particles the neighbours need for the forces on theirs.
+        outgoing[0].clear();
+        outgoing[1].clear();
+        for(size_t i = 0; strips.count() > 1 && i < owned.size(); ++i) {
+            const bool nearLeft = owned[i].pos.x - begin < radius;
+            const bool nearRight = end - owned[i].pos.x < radius;
+            if(nearLeft) {
+                Append(outgoing[0], owned[i]);
+            }
+            if(nearRight && !(sameNeighbour && nearLeft)) {
+                Append(outgoing[1], owned[i]);
+            }
+        }
+        haloParticles += (outgoing[0].size() + outgoing[1].size()) / sizeof(WireParticle);
+        received.clear();
+        if(!exchangeWithNeighbours(received)) {
+            return false;
+        }
+
+        ClearParticles(state);
+        for(const std::vector<WireParticle> *particles : {&owned, &received}) {
+            for(const WireParticle &particle : *particles) {
+                state.colors.push_back(particle.color);
+                state.pos.push_back(particle.pos);
+                state.vel.push_back(particle.vel);
+                state.ids.push_back(particle.id);
+            }
+        }
+        state.nextId = nextId;
+        engine.step();
+
+        for(size_t i = 0; i < owned.size(); ++i) {
+            owned[i].pos = state.pos[i];
+            owned[i].vel = state.vel[i];
+        }
+
+        // Migration: hand the particles that left the strip to their new owner.
+        outgoing[0].clear();
+        outgoing[1].clear();
+        size_t kept = 0;
+        for(const WireParticle &particle : owned) {
+            const int target = strips.of(particle.pos.x);
+            if(target == strip) {
+                owned[kept++] = particle;
+            } else if(target == leftStrip || target == rightStrip) {
+                Append(outgoing[target == leftStrip ? 0 : 1], particle);
+            } else {
+                error = "particle " + std::to_string(particle.id) + " moved farther than one strip in a step";
+                return false;
+            }
+        }
+        owned.resize(kept);
+        migrations += (outgoing[0].size() + outgoing[1].size()) / sizeof(WireParticle);
+        if(!exchangeWithNeighbours(owned)) {
+            return false;
+        }
+    }
+
+    const WorkerResult header{haloParticles, migrations};
+    std::vector<std::byte> result(sizeof(header) + owned.size() * sizeof(WireParticle));
+    std::memcpy(result.data(), &header, sizeof(header));
+    std::memcpy(result.data() + sizeof(header), owned.data(), owned.size() * sizeof(WireParticle));
+    Channel *const coordinator[] = {links.coordinator};
+    return exchange(coordinator, std::span(&result, 1), {}, error);
+}
+
+/// Stops the workers still running and reaps them
+void StopWorkers(const std::vector<pid_t> &workers) {
+    for(const pid_t pid : workers) {
+        kill(pid, SIGKILL);
+    }
+    for(const pid_t pid : workers) {
+        waitpid(pid, nullptr, 0);
+    }
+}
+} // namespace
+
+bool runDistributed(Config &config, State &state, int16_t width, int16_t height, int steps, const DistributedSettings &settings,
+                    DistributedStats &stats, std::string &error) {
+    if(settings.workers < 1) {
+        error = "at least one worker is needed";
+        return false;
+    }
+    const Strips strips(settings.workers, width);
+    const float radius = interactions(config).maxRadius;
+    if(settings.workers > 1 && strips.end(0) < radius) {
+        error = "strips of " + std::to_string(static_cast<int>(strips.end(0))) + " pixels are narrower than the largest radius " +
+                std::to_string(static_cast<int>(std::ceil(radius))) + ", use fewer workers";
+        return false;
+    }
+    if(settings.backend == Backend::Verlet) {
+        // Its lists would point at other particles every step.
+        error = "the verlet backend cannot step a changing set of particles";
+        return false;
+    }
+
+    std::vector<std::vector<WireParticle>> owned(settings.workers);
+    for(size_t i = 0; i < state.pos.size(); ++i) {
+        owned[strips.of(state.pos[i].x)].push_back(WireParticle{state.ids[i], state.colors[i], state.pos[i], state.vel[i]});
+    }
+
+    // Channel k joins strip k - 1 and strip k, links join the coordinator (first) and a worker.
+    std::vector<ChannelPair> borders(settings.workers > 1 ? settings.workers : 0);
+    std::vector<ChannelPair> links(settings.workers);
+    for(std::vector<ChannelPair> *channels : {&borders, &links}) {
+        for(ChannelPair &pair : *channels) {
+            if(!createChannel(settings.transport, settings.channelCapacity, pair, error)) {
+                return false;
+            }
+        }
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    // Output buffered before the fork would be written again by every worker.
+    fflush(stdout);
+    fflush(stderr);
+    std::vector<pid_t> workers;
+    for(int strip = 0; strip < settings.workers; ++strip) {
+        const pid_t pid = fork();
+        if(pid < 0) {
+            error = std::string("cannot start a worker: ") + std::strerror(errno);
+            StopWorkers(workers);
+            return false;
+        }
+        if(pid == 0) {
+            // Keep this worker's ends only, so a peer sees it go.
+            WorkerLinks workerLinks{.coordinator = links[strip].second.get()};
+            std::vector<std::unique_ptr<Channel>> kept;
+            kept.push_back(std::move(links[strip].second));
+            if(!borders.empty()) {
+                workerLinks.left = borders[strip].second.get();
+                workerLinks.right = borders[strips.right(strip)].first.get();
+                kept.push_back(std::move(borders[strip].second));
+                kept.push_back(std::move(borders[strips.right(strip)].first));
+            }
+            borders.clear();
+            links.clear();
+
+            std::string workerError;
+            const bool ok = RunWorker(strip, strips, config, std::move(owned[strip]), state.nextId, width, height, steps, settings, workerLinks, workerError);
+            if(!ok) {
+                fprintf(stderr, "worker %d: %s\n", strip, workerError.c_str());
+            }
+            kept.clear();
+            fflush(stderr);
+            _exit(ok ? 0 : 1);
+        }
+        workers.push_back(pid);
+    }
+
+    std::vector<Channel *> coordinator;
+    for(ChannelPair &pair : links) {
+        coordinator.push_back(pair.first.get());
+        pair.second.reset();
+    }
+    borders.clear();
+
+    // A worker that failed, or was killed, before sending its result would leave the others
+    // waiting for it.
+    std::vector<bool> exited(workers.size(), false);
+    const auto checkWorkers = [&](std::string &idleError) {
+        int status = 0;
+        pid_t pid;
+        while((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+            const size_t worker = std::find(workers.begin(), workers.end(), pid) - workers.begin();
+            if(worker < workers.size()) {
+                exited[worker] = true;
+            }
+            if(!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                idleError = "worker " + std::to_string(worker) + " failed";
+                return false;
+            }
+        }
+        return true;
+    };
+    std::vector<std::vector<std::byte>> results(workers.size());
+    const bool received = exchange(coordinator, {}, results, error, checkWorkers);
+    for(size_t worker = 0; worker < workers.size(); ++worker) {
+        if(!exited[worker]) {
+            if(!received) {
+                kill(workers[worker], SIGKILL);
+            }
+            waitpid(workers[worker], nullptr, 0);
+        }
+    }
+    if(!received) {
+        return false;
+    }
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::vector<WireParticle> particles;
+    stats.haloParticles = 0;
+    stats.migrations = 0;
+    for(const std::vector<std::byte> &message : results) {
+        WorkerResult result;
+        if(message.size() < sizeof(result)) {
+            error = "truncated worker result";
+            return false;
+        }
+        std::memcpy(&result, message.data(), sizeof(result));
+        stats.haloParticles += result.haloParticles;
+        stats.migrations += result.migrations;
+        AppendParticles(std::span(message).subspan(sizeof(result)), particles);
+    }
+    if(particles.size() != state.pos.size()) {
+        error = "the workers returned " + std::to_string(particles.size()) + " particles instead of " + std::to_string(state.pos.size());
+        return false;
+    }
+
+    std::sort(particles.begin(), particles.end(), [](const WireParticle &a, const WireParticle &b) { return a.id < b.id; });
+    for(size_t i = 0; i < particles.size(); ++i) {
+        state.ids[i] = particles[i].id;
+        state.colors[i] = particles[i].color;
+        state.pos[i] = particles[i].pos;
+        state.vel[i] = particles[i].vel;
+    }
+    return true;
+}
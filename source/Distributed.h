@@ -0,0 +1,45 @@
+#pragma once
+
+#include "Config.h"
+#include "Engine.h"
+#include "State.h"
+#include "Transport.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/// @brief How runDistributed splits the world over its worker processes.
+struct DistributedSettings {
+    /// Worker processes, each owning one vertical strip of the world
+    int workers = 2;
+    TransportKind transport = TransportKind::SharedMemory;
+    /// Any but Verlet, whose lists outlive the step
+    Backend backend = Backend::CellList;
+    size_t threadsPerWorker = 1;
+    /// Bytes of each direction of a shared memory channel
+    size_t channelCapacity = size_t{4} << 20;
+};
+
+struct DistributedStats {
+    /// Wall time from starting the workers to having every result back
+    double seconds = 0;
+    /// Halo particles sent between the workers and particles that moved to another strip, summed
+    /// over every step
+    uint64_t haloParticles = 0;
+    uint64_t migrations = 0;
+};
+
+/// @brief Runs steps of the periodic width x height world split into as many vertical strips of
+/// equal width as there are workers, each strip stepped by an Engine of its own in a forked
+/// process. Before every step a worker sends its neighbours the particles it owns within the
+/// largest interaction radius of their common border, the halo, and steps its particles together
+/// with the halo it received. Afterwards the particles that left its strip move to the neighbour
+/// owning them now. Only the particles of a strip and their halo are stepped there, so the forces
+/// come out the same as in a single Engine up to the order they are summed in.
+///
+/// Strips must be at least the largest radius wide and no particle may move farther than one
+/// strip per step. On success state holds the particles after the last step, in id order.
+/// Fork before any other thread of the calling process holds a lock the workers could need,
+/// i.e. call it before creating an Engine or a Simulation here.
+bool runDistributed(Config &config, State &state, int16_t width, int16_t height, int steps, const DistributedSettings &settings,
+                    DistributedStats &stats, std::string &error);
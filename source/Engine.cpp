@@ -0,0 +1,530 @@
+#include "Engine.h"
+#include "ConfigFunctions.h"
+#include "Physics.h"
+#include "Profiler.h"
+#include "Random.h"
+#include <algorithm>
+
+const char *toString(Backend backend) {
+    switch(backend) {
+    case Backend::BruteForce:
+        return "brute";
+    case Backend::CellList:
+        return "cells";
+    case Backend::QuadTree:
+        return "quadtree";
+    case Backend::Verlet:
+        return "verlet";
+    }
+    return "";
+}
+
+bool parseBackend(std::string_view name, Backend &backend) {
+    for(const Backend b : {Backend::BruteForce, Backend::CellList, Backend::QuadTree, Backend::Verlet}) {
+        if(name == toString(b)) {
+            backend = b;
+            return true;
+        }
+    }
+    return false;
+}
+
+Engine::Engine(Config &config, State &state, int16_t width, int16_t height, size_t threadsCount)
+    : mConfig(config), mState(state), mWidth(width), mHeight(height), mRandomSeed(threadRandom().next64()), mThreadPool(threadsCount) {}
+
+template <typename F>
+void Engine::parallelFor(size_t count, size_t chunkSize, F &&f) {
+    const uint64_t loop = mLoops++;
+    mThreadPool.parallelFor(count, chunkSize, [&](size_t begin, size_t end) {
+        RandomStreamScope stream(mRandomSeed, (loop << 32) | begin);
+        f(begin, end);
+    });
+}
+
+void Engine::step() {
+    PROFILE_SCOPE("Step");
+    if(mConfig.interactionsDirty) {
+        // Every force changes with the config.
+        std::fill(mStillSteps.begin(), mStillSteps.end(), 0);
+    }
+    {
+        PROFILE_SCOPE("Spatial sort");
+        if(mSpatialSorter.update(mState, mWidth, mHeight)) {
+            mNeighbourList.invalidate();
+        }
+    }
+    mPairs = 0;
+    mStats.neighbourListRebuilt = false;
+    mStats.particles = mState.pos.size();
+    mStats.awake = mStats.particles;
+    if(mBackend != Backend::CellList || mHalfPairs) {
+        // Only the full pair cell list step counts still steps.
+        resetSleep();
+    }
+
+    switch(mBackend) {
+    case Backend::BruteForce:
+        mHalfPairs ? stepBruteForceHalfPairs() : stepBruteForce();
+        break;
+    case Backend::CellList:
+        mHalfPairs ? stepCellListHalfPairs() : stepCellList(true);
+        break;
+    case Backend::QuadTree:
+        stepQuadTree();
+        break;
+    case Backend::Verlet:
+        stepVerlet();
+        break;
+    }
+
+    mStats.pairs = mPairs;
+}
+
+void Engine::setSleepSettings(const SleepSettings &settings) {
+    mSleepSettings = settings;
+    std::fill(mStillSteps.begin(), mStillSteps.end(), 0);
+}
+
+void Engine::stepBruteForce() {
+    const float width = mWidth;
+    const float height = mHeight;
+    const State &front = mState;
+    const size_t count = front.colors.size();
+    const InteractionTable &table = interactions(mConfig);
+    prepareBackBuffer(front, mBackState);
+
+    PROFILE_SCOPE("Force pass");
+    parallelFor(count, ChunkSize, [&](size_t begin, size_t end) {
+        mPairs.fetch_add((end - begin) * (count - 1), std::memory_order_relaxed);
+        for(size_t i = begin; i < end; ++i) {
+            Vec totalForce;
+
+            for(size_t j = 0; j < count; ++j) {
+                if(i == j) {
+                    continue;
+                }
+
+                const Vec direction = wrapDirection(Vec{front.pos[j].x - front.pos[i].x, front.pos[j].y - front.pos[i].y}, width, height);
+                totalForce.add(pairForce(table.at(front.colors[i], front.colors[j]), direction));
+            }
+
+            mBackState.pos[i] = front.pos[i];
+            mBackState.vel[i] = front.vel[i];
+            integrate(table, totalForce, mBackState.pos[i], mBackState.vel[i], width, height);
+        }
+    });
+
+    swapBuffers(mState, mBackState);
+}
+
+void Engine::stepCellList(bool sleep) {
+    const float width = mWidth;
+    const float height = mHeight;
+    const State &front = mState;
+    const size_t count = front.colors.size();
+    const InteractionTable &table = interactions(mConfig);
+    prepareBackBuffer(front, mBackState);
+
+    mCellList.build(front, table.maxRadius, width, height);
+    const ParticleArrays sorted = mCellList.sorted();
+
+    const bool sleeping = sleep && mSleepSettings.enabled && front.ids.size() == count;
+    if(!sleeping) {
+        resetSleep();
+    }
+    const uint32_t knownIds = sleeping ? prepareSleep() : 0;
+    const float stillSq = mSleepSettings.speed * mSleepSettings.speed;
+    mMoved.resize(sleeping ? count : 0);
+    std::atomic<uint64_t> awake = 0;
+
+    // Walk the particles in cell order so neighbouring chunks share their neighbour cells in cache.
+    PROFILE_SCOPE("Force pass");
+    parallelFor(count, ChunkSize, [&](size_t begin, size_t end) {
+        uint64_t pairs = 0;
+        uint64_t computed = 0;
+        for(size_t slot = begin; slot < end; ++slot) {
+            const size_t i = mCellList.index(slot);
+            if(sleeping && front.ids[i] < knownIds && asleep(front.ids[i])) {
+                mBackState.pos[i] = front.pos[i];
+                mBackState.vel[i] = Velocity{};
+                mMoved[slot] = 0;
+                continue;
+            }
+            const float x = sorted.x[slot];
+            const float y = sorted.y[slot];
+            const int c = sorted.colors[slot];
+
+            Vec totalForce;
+            mCellList.forEachNeighbourCell(x, y, [&](uint32_t from, uint32_t to) {
+                pairs += to - from;
+                totalForce.add(computeForce(mForceKernel, table, sorted, from, to, slot, x, y, c, width, height));
+            });
+
+            mBackState.pos[i] = front.pos[i];
+            mBackState.vel[i] = front.vel[i];
+            integrate(table, totalForce, mBackState.pos[i], mBackState.vel[i], width, height);
+            ++computed;
+            if(sleeping) {
+                const Vec move = wrapDirection(Vec{mBackState.pos[i].x - front.pos[i].x, mBackState.pos[i].y - front.pos[i].y}, width, height);
+                mMoved[slot] = move.x * move.x + move.y * move.y >= stillSq || front.ids[i] >= knownIds;
+            }
+        }
+        mPairs.fetch_add(pairs, std::memory_order_relaxed);
+        awake.fetch_add(computed, std::memory_order_relaxed);
+    });
+    mStats.awake = awake;
+
+    if(sleeping) {
+        updateSleep(knownIds);
+    }
+    swapBuffers(mState, mBackState);
+}
+
+uint32_t Engine::prepareSleep() {
+    const uint32_t nextId = mState.nextId;
+    uint32_t known = static_cast<uint32_t>(mStillSteps.size());
+    if(nextId < known) {
+        // Ids only grow, the world was replaced.
+        mStillSteps.clear();
+        known = 0;
+    }
+    mStillSteps.resize(nextId, 0);
+    return known;
+}
+
+void Engine::resetSleep() {
+    mStillSteps.clear();
+    mSleepParticles = 0;
+}
+
+void Engine::updateSleep(uint32_t knownIds) {
+    PROFILE_SCOPE("Sleep");
+    const float width = mWidth;
+    const float height = mHeight;
+    const size_t count = mMoved.size();
+    const float reach = interactions(mConfig).maxRadius;
+    const float reachSq = reach * reach;
+    const ParticleArrays sorted = mCellList.sorted();
+
+    // A removed particle leaves nothing behind in mMoved, so a removal wakes everything.
+    const size_t added = static_cast<size_t>(std::count_if(mState.ids.begin(), mState.ids.end(), [&](uint32_t id) { return id >= knownIds; }));
+    const bool removed = mSleepParticles + added > count;
+    mSleepParticles = count;
+    if(removed) {
+        std::fill(mStillSteps.begin(), mStillSteps.end(), 0);
+        return;
+    }
+
+    // Still particles are tested where they were, moving ones where they were and where they are
+    // now, so a particle coming into reach counts too.
+    const auto inReach = [&](float x, float y, uint32_t t) {
+        const Vec direction = wrapDirection(Vec{sorted.x[t] - x, sorted.y[t] - y}, width, height);
+        return direction.x * direction.x + direction.y * direction.y <= reachSq;
+    };
+    const auto movedInReach = [&](uint32_t s, uint32_t t) {
+        const Position now = mBackState.pos[mCellList.index(s)];
+        return inReach(sorted.x[s], sorted.y[s], t) || inReach(now.x, now.y, t);
+    };
+    // The cells around a moving particle's old cell hold everything in reach of it unless it
+    // crossed into another cell, those are looked at from where they are now too.
+    const auto crossed = [&](uint32_t s) {
+        const Position now = mBackState.pos[mCellList.index(s)];
+        return mCellList.cellX(now.x) != mCellList.cellX(sorted.x[s]) || mCellList.cellY(now.y) != mCellList.cellY(sorted.y[s]);
+    };
+    const auto disturbAround = [&](float x, float y, uint32_t s) {
+        mCellList.forEachNeighbourCell(x, y, [&](uint32_t begin, uint32_t end) {
+            for(uint32_t t = begin; t < end; ++t) {
+                if(mDisturbed[t] == 0 && movedInReach(s, t)) {
+                    mDisturbed[t] = 1;
+                }
+            }
+        });
+    };
+
+    mDisturbed.assign(mMoved.begin(), mMoved.end());
+    const size_t moved = static_cast<size_t>(std::count(mMoved.begin(), mMoved.end(), uint8_t{1}));
+    const bool scatter = moved * SleepScatterRatio <= count;
+    if(!scatter) {
+        // Mostly moving: every still particle looks for a moving one in its reach, which is
+        // usually among the first it checks.
+        parallelFor(count, ChunkSize, [&](size_t begin, size_t end) {
+            for(size_t s = begin; s < end; ++s) {
+                if(mDisturbed[s] != 0) {
+                    continue;
+                }
+                bool disturbed = false;
+                mCellList.forEachNeighbourCell(sorted.x[s], sorted.y[s], [&](uint32_t from, uint32_t to) {
+                    for(uint32_t t = from; t < to && !disturbed; ++t) {
+                        disturbed = mMoved[t] != 0 && movedInReach(t, static_cast<uint32_t>(s));
+                    }
+                });
+                mDisturbed[s] = disturbed;
+            }
+        });
+    }
+    // Mostly still: every moving particle disturbs the particles in its reach. When mostly moving
+    // only the few that crossed a cell border are left to spread.
+    for(uint32_t s = 0; s < count; ++s) {
+        if(mMoved[s] == 0) {
+            continue;
+        }
+        if(scatter) {
+            disturbAround(sorted.x[s], sorted.y[s], s);
+        }
+        if(crossed(s)) {
+            const Position now = mBackState.pos[mCellList.index(s)];
+            disturbAround(now.x, now.y, s);
+        }
+    }
+
+    parallelFor(count, ChunkSize, [&](size_t begin, size_t end) {
+        for(size_t s = begin; s < end; ++s) {
+            uint16_t &still = mStillSteps[mState.ids[mCellList.index(s)]];
+            still = mDisturbed[s] != 0 ? 0 : static_cast<uint16_t>(std::min<int>(still + 1, UINT16_MAX));
+        }
+    });
+}
+
+void Engine::stepQuadTree() {
+    const float width = mWidth;
+    const float height = mHeight;
+    const State &front = mState;
+    const size_t count = front.colors.size();
+    const InteractionTable &table = interactions(mConfig);
+    prepareBackBuffer(front, mBackState);
+
+    mQuadTree.build(front.pos, width, height);
+
+    const float radius = table.maxRadius;
+    mQuadTreeNeighbours.resize((count + ChunkSize - 1) / ChunkSize);
+    PROFILE_SCOPE("Force pass");
+    parallelFor(count, ChunkSize, [&](size_t begin, size_t end) {
+        std::vector<uint32_t> &neighbours = mQuadTreeNeighbours[begin / ChunkSize];
+        uint64_t pairs = 0;
+        for(size_t i = begin; i < end; ++i) {
+            Vec totalForce;
+
+            neighbours.clear();
+            mQuadTree.query(Boundry{.x = front.pos[i].x - radius,
+                                    .y = front.pos[i].y - radius,
+                                    .width = 2 * radius,
+                                    .height = 2 * radius},
+                            neighbours);
+            pairs += neighbours.size();
+
+            for(const uint32_t j : neighbours) {
+                if(i == j) {
+                    continue;
+                }
+
+                const Vec direction = wrapDirection(Vec{front.pos[j].x - front.pos[i].x, front.pos[j].y - front.pos[i].y}, width, height);
+                totalForce.add(pairForce(table.at(front.colors[i], front.colors[j]), direction));
+            }
+
+            mBackState.pos[i] = front.pos[i];
+            mBackState.vel[i] = front.vel[i];
+            integrate(table, totalForce, mBackState.pos[i], mBackState.vel[i], width, height);
+        }
+        mPairs.fetch_add(pairs, std::memory_order_relaxed);
+    });
+
+    swapBuffers(mState, mBackState);
+}
+
+void Engine::stepVerlet() {
+    const float width = mWidth;
+    const float height = mHeight;
+    const State &front = mState;
+    const size_t count = front.colors.size();
+    const InteractionTable &table = interactions(mConfig);
+    prepareBackBuffer(front, mBackState);
+
+    if(!mNeighbourList.isValid(front, table.maxRadius, mNeighbourSkin, width, height, mThreadPool, ChunkSize)) {
+        if(!mNeighbourList.build(front, table.maxRadius, mNeighbourSkin, width, height, mThreadPool, ChunkSize, mCellList)) {
+            // Too many pairs in reach to list them, evaluate the cells directly instead. The
+            // Verlet backend does not sleep, the particles stay awake.
+            stepCellList(false);
+            return;
+        }
+        mStats.neighbourListRebuilt = true;
+    }
+
+    splitPositions();
+    const ParticleArrays particles{mX.data(), mY.data(), front.colors.data()};
+
+    PROFILE_SCOPE("Force pass");
+    parallelFor(count, ChunkSize, [&](size_t begin, size_t end) {
+        uint64_t pairs = 0;
+        for(size_t i = begin; i < end; ++i) {
+            const std::span<const uint32_t> neighbours = mNeighbourList.neighbours(i);
+            pairs += neighbours.size();
+            const Vec totalForce = computeForce(mForceKernel, table, particles, neighbours, mX[i], mY[i], front.colors[i], width, height);
+
+            mBackState.pos[i] = front.pos[i];
+            mBackState.vel[i] = front.vel[i];
+            integrate(table, totalForce, mBackState.pos[i], mBackState.vel[i], width, height);
+        }
+        mPairs.fetch_add(pairs, std::memory_order_relaxed);
+    });
+
+    swapBuffers(mState, mBackState);
+}
+
+void Engine::stepBruteForceHalfPairs() {
+    const float width = mWidth;
+    const float height = mHeight;
+    const State &front = mState;
+    const size_t count = front.colors.size();
+    const InteractionTable &table = interactions(mConfig);
+    prepareBackBuffer(front, mBackState);
+
+    splitPositions();
+    const ParticleArrays particles{mX.data(), mY.data(), front.colors.data()};
+    mForceX.assign(count, 0);
+    mForceY.assign(count, 0);
+
+    // Particles are cut into blocks and every pair of blocks is one task. A round robin
+    // tournament schedules the tasks in rounds touching every block at most once, so a round
+    // runs in parallel without races and every force is summed in the same order on any
+    // number of threads. The first round pairs every block with itself.
+    const size_t blocks = (count + ChunkSize - 1) / ChunkSize;
+    const size_t players = blocks + blocks % 2;
+    const auto runPair = [&](size_t a, size_t b) {
+        const size_t aEnd = std::min(count, (a + 1) * ChunkSize);
+        const size_t bBegin = b * ChunkSize;
+        const size_t bEnd = std::min(count, (b + 1) * ChunkSize);
+        uint64_t pairs = 0;
+        for(size_t s = a * ChunkSize; s < aEnd; ++s) {
+            const size_t begin = a == b ? s + 1 : bBegin;
+            pairs += bEnd - begin;
+            const Vec force = computePairForces(mForceKernel, table, particles, begin, bEnd, mX[s], mY[s], front.colors[s], width, height,
+                                                mForceX.data(), mForceY.data());
+            mForceX[s] += force.x;
+            mForceY[s] += force.y;
+        }
+        mPairs.fetch_add(pairs, std::memory_order_relaxed);
+    };
+
+    PROFILE_SCOPE("Force pass");
+    parallelFor(blocks, 1, [&](size_t begin, size_t end) {
+        for(size_t block = begin; block < end; ++block) {
+            runPair(block, block);
+        }
+    });
+    for(size_t round = 0; round + 1 < players; ++round) {
+        mBlockPairs.clear();
+        for(size_t k = 0; k < players / 2; ++k) {
+            const size_t a = k == 0 ? players - 1 : (round + k) % (players - 1);
+            const size_t b = (round + players - 1 - k) % (players - 1);
+            if(a < blocks && b < blocks) {
+                mBlockPairs.emplace_back(static_cast<uint32_t>(a), static_cast<uint32_t>(b));
+            }
+        }
+        parallelFor(mBlockPairs.size(), 1, [&](size_t begin, size_t end) {
+            for(size_t task = begin; task < end; ++task) {
+                runPair(mBlockPairs[task].first, mBlockPairs[task].second);
+            }
+        });
+    }
+
+    integrateForces([](size_t i) { return i; });
+    swapBuffers(mState, mBackState);
+}
+
+void Engine::stepCellListHalfPairs() {
+    const float width = mWidth;
+    const float height = mHeight;
+    const State &front = mState;
+    const size_t count = front.colors.size();
+    const InteractionTable &table = interactions(mConfig);
+    prepareBackBuffer(front, mBackState);
+
+    mCellList.build(front, table.maxRadius, width, height);
+    const ParticleArrays sorted = mCellList.sorted();
+    mForceX.assign(count, 0);
+    mForceY.assign(count, 0);
+
+    PROFILE_SCOPE("Force pass");
+    // A task handles one row of cells: the pairs within the row and the pairs with the row
+    // below, so it writes forces of two rows. Tasks of even rows never share a row, neither do
+    // tasks of odd rows; with an odd number of rows the last one wraps onto row 0 and runs alone.
+    const int rows = mCellList.rows();
+    const int columns = mCellList.columns();
+    const auto runRow = [&](int row) {
+        // With fewer than three rows the row below is the row above, its pairs belong to row 0.
+        const bool withNext = rows >= 3 || (rows == 2 && row == 0);
+        const int next = (row + 1) % rows;
+        uint64_t pairs = 0;
+
+        const auto addRange = [&](size_t s, std::pair<uint32_t, uint32_t> range, Vec &force) {
+            pairs += range.second - range.first;
+            force.add(computePairForces(mForceKernel, table, sorted, range.first, range.second, sorted.x[s], sorted.y[s], sorted.colors[s],
+                                        width, height, mForceX.data(), mForceY.data()));
+        };
+
+        for(int cx = 0; cx < columns; ++cx) {
+            int neighbours[3];
+            const int neighboursCount = mCellList.neighbourColumns(cx, neighbours);
+            const auto [first, last] = mCellList.slots(cx, row);
+            for(uint32_t s = first; s < last; ++s) {
+                Vec force;
+                addRange(s, {s + 1, last}, force);
+                for(int n = 0; n < neighboursCount; ++n) {
+                    if(neighbours[n] > cx) {
+                        addRange(s, mCellList.slots(neighbours[n], row), force);
+                    }
+                }
+                if(withNext) {
+                    for(int n = 0; n < neighboursCount; ++n) {
+                        addRange(s, mCellList.slots(neighbours[n], next), force);
+                    }
+                }
+                mForceX[s] += force.x;
+                mForceY[s] += force.y;
+            }
+        }
+        mPairs.fetch_add(pairs, std::memory_order_relaxed);
+    };
+
+    const int lastPaired = rows - rows % 2;
+    for(const int parity : {0, 1}) {
+        const size_t tasks = static_cast<size_t>((lastPaired - parity + 1) / 2);
+        parallelFor(tasks, 1, [&](size_t begin, size_t end) {
+            for(size_t task = begin; task < end; ++task) {
+                runRow(static_cast<int>(2 * task) + parity);
+            }
+        });
+    }
+    if(rows % 2 == 1) {
+        runRow(rows - 1);
+    }
+
+    integrateForces([&](size_t i) { return mCellList.slot(i); });
+    swapBuffers(mState, mBackState);
+}
+
+void Engine::splitPositions() {
+    const std::vector<Position> &pos = mState.pos;
+    mX.resize(pos.size());
+    mY.resize(pos.size());
+    for(size_t i = 0; i < pos.size(); ++i) {
+        mX[i] = pos[i].x;
+        mY[i] = pos[i].y;
+    }
+}
+
+template <typename Slot>
+void Engine::integrateForces(Slot &&slot) {
+    const float width = mWidth;
+    const float height = mHeight;
+    const InteractionTable &table = interactions(mConfig);
+    PROFILE_SCOPE("Integration");
+    parallelFor(mState.pos.size(), ChunkSize, [&](size_t begin, size_t end) {
+        for(size_t i = begin; i < end; ++i) {
+            const size_t s = slot(i);
+            mBackState.pos[i] = mState.pos[i];
+            mBackState.vel[i] = mState.vel[i];
+            integrate(table, Vec{mForceX[s], mForceY[s]}, mBackState.pos[i], mBackState.vel[i], width, height);
+        }
+    });
+}
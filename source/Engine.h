@@ -0,0 +1,185 @@
+#pragma once
+
+#include "CellList.h"
+#include "Config.h"
+#include "ForceKernel.h"
+#include "NeighbourList.h"
+#include "QuadTree.h"
+#include "SpatialSort.h"
+#include "State.h"
+#include "ThreadPool.h"
+#include <atomic>
+#include <cstdint>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/// @brief Neighbour search used by the simulation step.
+enum class Backend {
+    BruteForce,
+    CellList,
+    QuadTree,
+    /// Cell list built at max radius + skin into per particle neighbour lists reused across steps
+    Verlet,
+};
+
+const char *toString(Backend backend);
+
+/// @brief Parses the name printed by toString (case sensitive). Returns false for unknown names.
+bool parseBackend(std::string_view name, Backend &backend);
+
+/// @brief Counters describing the work done by the last step.
+struct StepStats {
+    /// Particle pairs whose distance was evaluated
+    uint64_t pairs = 0;
+    /// Verlet backend: the neighbour lists were rebuilt before this step
+    bool neighbourListRebuilt = false;
+    /// Particles stepped, and those of them whose force was computed; the others were asleep
+    uint64_t particles = 0;
+    uint64_t awake = 0;
+
+    float awakeFraction() const { return particles > 0 ? static_cast<float>(awake) / particles : 1.0f; }
+};
+
+/// @brief When particles fall asleep. A particle is still in a step when it, and every particle
+/// within the largest interaction radius of it, moved less than `speed` pixels and no particle
+/// was added or came into that radius. After `steps` still steps in a row it falls asleep: it
+/// keeps its position, stops and its force is no longer computed, as it would come out the same
+/// while everything around it stays put. The first step that is not still wakes it up, so does a
+/// change of the config; removing particles wakes all of them.
+struct SleepSettings {
+    bool enabled = false;
+    float speed = 0.05f;
+    int steps = 30;
+};
+
+/// @brief The simulation without any window or renderer: advances the State one step at a time.
+/// Reads the front State, writes a back State and swaps them, so results do not depend on the
+/// order particles are processed in.
+/// Profiled phases: "Step", "Spatial sort", the index builds and "Force pass", which includes
+/// moving the particles. The half pair steps integrate after the pass, timed as a nested "Integration".
+class Engine {
+public:
+    Engine(Config &config, State &state, int16_t width, int16_t height, size_t threadsCount = std::thread::hardware_concurrency());
+
+    /// @brief Advances the simulation by one dt.
+    void step();
+
+    Backend backend() const { return mBackend; }
+    void setBackend(Backend backend) { mBackend = backend; }
+
+    /// @brief Evaluates every pair once and applies its force to both particles instead of once
+    /// per particle. Used by the brute force and cell list backends, the others ignore it.
+    bool halfPairs() const { return mHalfPairs; }
+    void setHalfPairs(bool halfPairs) { mHalfPairs = halfPairs; }
+
+    ForceKernel forceKernel() const { return mForceKernel; }
+    void setForceKernel(ForceKernel kernel) { mForceKernel = kernel; }
+
+    /// @brief Extra distance the Verlet lists reach beyond the max radius, in pixels. Larger
+    /// skins rebuild less often but list more pairs that are out of reach.
+    float neighbourSkin() const { return mNeighbourSkin; }
+    void setNeighbourSkin(float skin) { mNeighbourSkin = skin; }
+
+    /// @brief Lets still particles fall asleep. Used by the cell list backend with full pairs, the
+    /// others ignore it. Changing the settings wakes every particle.
+    const SleepSettings &sleepSettings() const { return mSleepSettings; }
+    void setSleepSettings(const SleepSettings &settings);
+
+    SpatialSorter &spatialSorter() { return mSpatialSorter; }
+    const NeighbourList &neighbourList() const { return mNeighbourList; }
+
+    const StepStats &lastStepStats() const { return mStats; }
+
+    /// @brief Positions from before the last step, index for index with the current state.
+    const std::vector<Position> &previousPositions() const { return mBackState.pos; }
+
+    Config &config() { return mConfig; }
+    State &state() { return mState; }
+    int16_t width() const { return mWidth; }
+    int16_t height() const { return mHeight; }
+    size_t threadsCount() const { return mThreadPool.threadsCount(); }
+
+private:
+    /// Particles handed to a worker at a time by the step
+    static constexpr size_t ChunkSize = 256;
+    /// Below one moving particle in this many the sleep update spreads the moves from the
+    /// moving particles instead of checking every still one
+    static constexpr size_t SleepScatterRatio = 8;
+
+    /// @brief mThreadPool.parallelFor with every chunk drawing from its own random stream, so the
+    /// random directions given to coincident particles do not depend on the threads count
+    template <typename F>
+    void parallelFor(size_t count, size_t chunkSize, F &&f);
+
+    void stepBruteForce();
+    void stepBruteForceHalfPairs();
+    /// sleep: let still particles fall asleep, when the sleep settings enable it
+    void stepCellList(bool sleep);
+    void stepCellListHalfPairs();
+    /// Copies the front positions into mX and mY
+    void splitPositions();
+    /// Moves every particle with the force accumulated in mForceX and mForceY at slot(i)
+    template <typename Slot>
+    void integrateForces(Slot &&slot);
+    /// Sizes the stillness counters for the particles of the front state, resetting them when
+    /// the world was replaced. Returns how many ids the counters knew before, particles with
+    /// larger ids are new.
+    uint32_t prepareSleep();
+    /// Counts the still steps of every particle after a cell list step, from mMoved. Particles
+    /// with ids from knownIds on are new.
+    void updateSleep(uint32_t knownIds);
+    /// Wakes every particle and forgets the last step's particles count. Called by the steps that
+    /// do not count still steps, a later sleeping step could not tell what happened meanwhile.
+    void resetSleep();
+    bool asleep(uint32_t id) const { return mStillSteps[id] >= mSleepSettings.steps; }
+    void stepQuadTree();
+    void stepVerlet();
+
+    Config &mConfig;
+    State &mState;
+    /// Written by the step while mState is read, then swapped with it
+    State mBackState;
+    int16_t mWidth;
+    int16_t mHeight;
+
+    StepStats mStats;
+    std::atomic<uint64_t> mPairs = 0;
+
+    Backend mBackend = Backend::CellList;
+    ForceKernel mForceKernel = detectForceKernel();
+    float mNeighbourSkin = 16;
+    bool mHalfPairs = false;
+
+    /// Seed of the random streams of the step loops, drawn from threadRandom on construction
+    uint64_t mRandomSeed;
+    /// Parallel loops run so far, tells the streams of successive loops apart
+    uint64_t mLoops = 0;
+
+    ThreadPool mThreadPool;
+    CellList mCellList;
+    QuadTree mQuadTree;
+    /// Query results of every chunk of the quadtree step, kept so their storage is reused
+    std::vector<std::vector<uint32_t>> mQuadTreeNeighbours;
+    NeighbourList mNeighbourList;
+    /// Positions of the front state split into x and y for the force kernels
+    AlignedVector<float> mX;
+    AlignedVector<float> mY;
+    /// Forces accumulated by the half pair steps
+    AlignedVector<float> mForceX;
+    AlignedVector<float> mForceY;
+    /// Block pairs of one round of the half pair brute force step
+    std::vector<std::pair<uint32_t, uint32_t>> mBlockPairs;
+    SpatialSorter mSpatialSorter;
+
+    SleepSettings mSleepSettings;
+    /// Still steps in a row of every particle, by id
+    std::vector<uint16_t> mStillSteps;
+    /// Whether the particle at a cell ordered slot moved or appeared in the last step
+    std::vector<uint8_t> mMoved;
+    /// Whether a particle at a cell ordered slot, or one within the max radius of it, moved
+    std::vector<uint8_t> mDisturbed;
+    /// Particles of the last sleeping step, to notice removed ones
+    size_t mSleepParticles = 0;
+};
@@ -0,0 +1,129 @@
+#include "EnttParticles.h"
+#include "Physics.h"
+#include <cmath>
+#include <numbers>
+#include <type_traits>
+
+namespace {
+
+/// Element i of a paged component storage
+template <typename T, typename Storage>
+T &At(Storage &storage, size_t i) {
+    constexpr size_t PageSize = entt::component_traits<std::remove_const_t<T>>::page_size;
+    return storage.raw()[i / PageSize][i % PageSize];
+}
+
+/// Components, packed entities and sparse array of a storage
+template <typename Storage>
+size_t StorageBytes(const Storage &storage, size_t elementSize) {
+    using Base = typename Storage::base_type;
+    return storage.capacity() * elementSize + storage.Base::capacity() * sizeof(entt::entity) + storage.extent() * sizeof(entt::entity);
+}
+} // namespace
+
+EnttParticles::EnttParticles(float width, float height)
+    : mWidth(width), mHeight(height), mGroup(mRegistry.group<Position, Velocity, ParticleColor>()) {}
+
+void EnttParticles::reserve(size_t capacity) {
+    mRegistry.storage<entt::entity>().reserve(capacity);
+    mRegistry.storage<Position>().reserve(capacity);
+    mRegistry.storage<Velocity>().reserve(capacity);
+    mRegistry.storage<ParticleColor>().reserve(capacity);
+}
+
+void EnttParticles::spawn(size_t count, const Disc &region, int color, Random &random) {
+    mEntities.resize(count);
+    mRegistry.create(mEntities.begin(), mEntities.end());
+
+    mPositions.resize(count);
+    for(Position &pos : mPositions) {
+        const float distance = region.radius * std::sqrt(random.uniform());
+        const float angle = random.uniform(0, 2 * std::numbers::pi_v<float>);
+        pos = Position{.x = wrapFloat(region.x + distance * std::cos(angle), mWidth),
+                       .y = wrapFloat(region.y + distance * std::sin(angle), mHeight)};
+    }
+    mRegistry.insert<Position>(mEntities.begin(), mEntities.end(), mPositions.begin());
+    mRegistry.insert<Velocity>(mEntities.begin(), mEntities.end(), Velocity{});
+    mRegistry.insert<ParticleColor>(mEntities.begin(), mEntities.end(), ParticleColor{color});
+}
+
+void EnttParticles::load(const State &state) {
+    clear();
+    const size_t count = state.pos.size();
+    mEntities.resize(count);
+    mRegistry.create(mEntities.begin(), mEntities.end());
+    mRegistry.insert<Position>(mEntities.begin(), mEntities.end(), state.pos.begin());
+    mRegistry.insert<Velocity>(mEntities.begin(), mEntities.end(), state.vel.begin());
+    for(size_t i = 0; i < count; ++i) {
+        mRegistry.emplace<ParticleColor>(mEntities[i], state.colors[i]);
+    }
+}
+
+size_t EnttParticles::erase(const Disc &region) {
+    const float radiusSq = region.radius * region.radius;
+    const auto &positions = mRegistry.storage<Position>();
+    mEntities.clear();
+    for(size_t i = 0; i < size(); ++i) {
+        const Position &pos = At<const Position>(positions, i);
+        const Vec d = wrapDirection(Vec{pos.x - region.x, pos.y - region.y}, mWidth, mHeight);
+        if(d.x * d.x + d.y * d.y <= radiusSq) {
+            mEntities.push_back(positions.data()[i]);
+        }
+    }
+    // Every storage moves its last element into the freed slot, the group stays packed.
+    mRegistry.destroy(mEntities.begin(), mEntities.end());
+    return mEntities.size();
+}
+
+void EnttParticles::clear() {
+    mRegistry.clear();
+}
+
+void EnttParticles::gather(State &state) const {
+    const size_t count = size();
+    // The group created the storages, the const registry hands out pointers to them.
+    const auto &positions = *mRegistry.storage<Position>();
+    const auto &velocities = *mRegistry.storage<Velocity>();
+    const auto &colors = *mRegistry.storage<ParticleColor>();
+
+    state.colors.resize(count);
+    state.pos.resize(count);
+    state.vel.resize(count);
+    state.ids.resize(count);
+    for(size_t i = 0; i < count; ++i) {
+        state.colors[i] = At<const ParticleColor>(colors, i).index;
+        state.pos[i] = At<const Position>(positions, i);
+        state.vel[i] = At<const Velocity>(velocities, i);
+        state.ids[i] = static_cast<uint32_t>(i);
+    }
+    state.nextId = static_cast<uint32_t>(count);
+}
+
+void EnttParticles::scatter(const State &state) {
+    auto &positions = mRegistry.storage<Position>();
+    auto &velocities = mRegistry.storage<Velocity>();
+    bool reordered = false;
+    for(size_t k = 0; k < state.ids.size(); ++k) {
+        const uint32_t i = state.ids[k];
+        At<Position>(positions, i) = state.pos[k];
+        At<Velocity>(velocities, i) = state.vel[k];
+        reordered |= i != k;
+    }
+    if(!reordered) {
+        return;
+    }
+
+    // Take over the engine's order, e.g. its spatial sort, so the next gather starts from it.
+    mRank.resize(positions.extent());
+    for(size_t k = 0; k < state.ids.size(); ++k) {
+        mRank[entt::to_entity(positions.data()[state.ids[k]])] = static_cast<uint32_t>(k);
+    }
+    // entt sorts so that iterating from the back is ascending, the largest rank comes first.
+    mGroup.sort([&](const entt::entity lhs, const entt::entity rhs) { return mRank[entt::to_entity(lhs)] > mRank[entt::to_entity(rhs)]; });
+}
+
+size_t EnttParticles::memoryBytes() const {
+    return StorageBytes(*mRegistry.storage<entt::entity>(), 0) + StorageBytes(*mRegistry.storage<Position>(), sizeof(Position)) +
+           StorageBytes(*mRegistry.storage<Velocity>(), sizeof(Velocity)) +
+           StorageBytes(*mRegistry.storage<ParticleColor>(), sizeof(ParticleColor));
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "ParticlePool.h"
+#include "Random.h"
+#include "State.h"
+#include <cstddef>
+#include <cstdint>
+#include <entt/entity/registry.hpp>
+#include <vector>
+
+/// @brief Color component of a particle, index into Config::particleColors.
+struct ParticleColor {
+    int index;
+};
+
+/// @brief The particles of a State kept as Position, Velocity and ParticleColor components of an
+/// entt::registry instead of plain vectors, so per particle tags can be added as empty components.
+/// An owning group packs the three components side by side: index i of every storage belongs to
+/// the same entity, in pages of entt::component_traits<T>::page_size elements.
+/// The Engine steps a State; gather() copies the components into one in packed order and scatter()
+/// copies the stepped positions and velocities back, see tools/StorageBench.cpp for what the round
+/// trip costs against stepping the State directly.
+class EnttParticles {
+public:
+    EnttParticles(float width, float height);
+
+    EnttParticles(const EnttParticles &) = delete;
+    EnttParticles &operator=(const EnttParticles &) = delete;
+
+    /// @brief Reserves room for capacity particles in every storage.
+    void reserve(size_t capacity);
+    size_t size() const { return mGroup.size(); }
+
+    /// @brief Same as ParticlePool::spawn, one entity per particle.
+    void spawn(size_t count, const Disc &region, int color, Random &random);
+    /// @brief Replaces all particles with the ones of state.
+    void load(const State &state);
+
+    /// @brief Destroys every particle in region. Returns how many were destroyed.
+    size_t erase(const Disc &region);
+    void clear();
+
+    /// @brief Copies the particles into state in packed order. The ids of state are the packed
+    /// indices, valid until the next structural change.
+    void gather(State &state) const;
+    /// @brief Copies the positions and velocities of a state filled by gather() back. When the
+    /// engine reordered the state the group is sorted the same way.
+    void scatter(const State &state);
+
+    /// @brief Bytes allocated by the storages, including the sparse arrays and the entity pool.
+    size_t memoryBytes() const;
+
+    entt::registry &registry() { return mRegistry; }
+
+    /// @brief Calls f(entity, Position &, Velocity &, ParticleColor &) for every particle.
+    template <typename F>
+    void each(F &&f) {
+        mGroup.each(f);
+    }
+
+private:
+    using Group = decltype(std::declval<entt::registry &>().group<Position, Velocity, ParticleColor>());
+
+    float mWidth;
+    float mHeight;
+    entt::registry mRegistry;
+    Group mGroup;
+    /// Scratch for bulk creation and destruction
+    std::vector<entt::entity> mEntities;
+    std::vector<Position> mPositions;
+    /// Index in the engine's order of every entity, by entity index
+    std::vector<uint32_t> mRank;
+};
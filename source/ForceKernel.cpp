@@ -0,0 +1,522 @@
+#include "ForceKernel.h"
+#include "Physics.h"
+#include <algorithm>
+#include <cstddef>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#    define PARTICLES_X86 1
+#    include <immintrin.h>
+#    if defined(_MSC_VER)
+#        include <intrin.h>
+#    endif
+#endif
+
+#if defined(PARTICLES_X86) && (defined(__GNUC__) || defined(__clang__))
+#    define PARTICLES_TARGET_SSE __attribute__((target("sse4.1")))
+#    define PARTICLES_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#    define PARTICLES_TARGET_SSE
+#    define PARTICLES_TARGET_AVX2
+#endif
+
+namespace {
+
+/// @brief Force the particle at index j exerts on a particle of color c at (x, y).
+Vec ScalarPairForce(const InteractionTable &table, const ParticleArrays &particles, size_t j, float x, float y, int c, float width, float height) {
+    const Vec direction = wrapDirection(Vec{particles.x[j] - x, particles.y[j] - y}, width, height);
+    return pairForce(table.at(c, particles.colors[j]), direction);
+}
+
+/// @brief Particles [begin, end) of the arrays, without the one at self.
+struct RangeSource {
+    size_t begin;
+    size_t end;
+    size_t self;
+
+    size_t size() const { return end - begin; }
+    size_t index(size_t k) const { return begin + k; }
+    bool skips(size_t k) const { return begin + k == self; }
+    /// Lane of [k, k + lanes) holding self, -1 if none
+    int skippedLane(size_t k, int lanes) const { return self >= begin + k && self < begin + k + lanes ? static_cast<int>(self - begin - k) : -1; }
+};
+
+/// @brief Particles picked from the arrays by an index list.
+struct ListSource {
+    const uint32_t *indices;
+    size_t count;
+
+    size_t size() const { return count; }
+    size_t index(size_t k) const { return indices[k]; }
+    bool skips(size_t) const { return false; }
+    int skippedLane(size_t, int) const { return -1; }
+};
+
+template <typename Source>
+Vec ComputeForceScalar(const InteractionTable &table, const ParticleArrays &particles, const Source &source, float x, float y, int c, float width, float height) {
+    Vec totalForce;
+    for(size_t k = 0; k < source.size(); ++k) {
+        if(!source.skips(k)) {
+            totalForce.add(ScalarPairForce(table, particles, source.index(k), x, y, c, width, height));
+        }
+    }
+    return totalForce;
+}
+
+Vec ComputePairForcesScalar(const InteractionTable &table, const ParticleArrays &particles, size_t begin, size_t end, float x, float y, int c, float width,
+                            float height, float *forcesX, float *forcesY) {
+    Vec totalForce;
+    for(size_t t = begin; t < end; ++t) {
+        const int other = particles.colors[t];
+        const Vec direction = wrapDirection(Vec{particles.x[t] - x, particles.y[t] - y}, width, height);
+        Vec reaction;
+        addPairForces(table.at(c, other), table.at(other, c), direction, totalForce, reaction);
+        forcesX[t] += reaction.x;
+        forcesY[t] += reaction.y;
+    }
+    return totalForce;
+}
+
+#if defined(PARTICLES_X86)
+
+/// @brief Adds the scalar force of every lane in mask. Used for the rare coincident particles,
+/// whose direction is random.
+template <typename Source>
+void AddLanes(int mask, Vec &totalForce, const InteractionTable &table, const ParticleArrays &particles, const Source &source, size_t k, float x, float y, int c,
+              float width, float height) {
+    for(; mask != 0; mask &= mask - 1) {
+        int lane = 0;
+        while(((mask >> lane) & 1) == 0) {
+            ++lane;
+        }
+        totalForce.add(ScalarPairForce(table, particles, source.index(k + lane), x, y, c, width, height));
+    }
+}
+
+/// @brief Loads lanes [k, k + 4) of a contiguous range, the fast path of the SSE kernel.
+PARTICLES_TARGET_SSE bool LoadFullLanes(const ParticleArrays &particles, const RangeSource &source, size_t k, __m128 &xs, __m128 &ys) {
+    const size_t j = source.begin + k;
+    if(source.size() - k < 4 || source.skippedLane(k, 4) >= 0) {
+        return false;
+    }
+    xs = _mm_loadu_ps(particles.x + j);
+    ys = _mm_loadu_ps(particles.y + j);
+    return true;
+}
+
+PARTICLES_TARGET_SSE bool LoadFullLanes(const ParticleArrays &, const ListSource &, size_t, __m128 &, __m128 &) {
+    return false;
+}
+
+template <typename Source>
+PARTICLES_TARGET_SSE Vec ComputeForceSSE(const InteractionTable &table, const ParticleArrays &particles, const Source &source, float x, float y, int c, float width,
+                                         float height) {
+    constexpr int Lanes = 4;
+
+    const __m128 px = _mm_set1_ps(x);
+    const __m128 py = _mm_set1_ps(y);
+    const __m128 w = _mm_set1_ps(width);
+    const __m128 h = _mm_set1_ps(height);
+    const __m128 halfW = _mm_set1_ps(0.5f * width);
+    const __m128 halfH = _mm_set1_ps(0.5f * height);
+    const __m128 negHalfW = _mm_set1_ps(-0.5f * width);
+    const __m128 negHalfH = _mm_set1_ps(-0.5f * height);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const size_t row = static_cast<size_t>(c) * table.colorsCount;
+
+    __m128 fx = zero;
+    __m128 fy = zero;
+    Vec scalarForce;
+
+    for(size_t k = 0; k < source.size(); k += Lanes) {
+        const int count = static_cast<int>(std::min<size_t>(Lanes, source.size() - k));
+
+        // SSE has neither masked loads nor gathers. Lanes past the end and the skipped particle
+        // are filled with the particle itself and masked out, pair parameters are loaded per lane.
+        __m128 validMask;
+        __m128 xs;
+        __m128 ys;
+        int32_t pairs[Lanes];
+        if(LoadFullLanes(particles, source, k, xs, ys)) {
+            validMask = _mm_castsi128_ps(_mm_set1_epi32(-1));
+            for(int lane = 0; lane < Lanes; ++lane) {
+                pairs[lane] = static_cast<int32_t>(row) + particles.colors[source.index(k + lane)];
+            }
+        } else {
+            alignas(16) float laneX[Lanes];
+            alignas(16) float laneY[Lanes];
+            alignas(16) int32_t valid[Lanes];
+            for(int lane = 0; lane < Lanes; ++lane) {
+                const bool isValid = lane < count && !source.skips(k + lane);
+                const size_t n = isValid ? source.index(k + lane) : 0;
+                valid[lane] = isValid ? -1 : 0;
+                laneX[lane] = isValid ? particles.x[n] : x;
+                laneY[lane] = isValid ? particles.y[n] : y;
+                pairs[lane] = static_cast<int32_t>(row) + (isValid ? particles.colors[n] : 0);
+            }
+            validMask = _mm_castsi128_ps(_mm_load_si128(reinterpret_cast<const __m128i *>(valid)));
+            xs = _mm_load_ps(laneX);
+            ys = _mm_load_ps(laneY);
+        }
+        const Interaction &i0 = table.pairs[pairs[0]];
+        const Interaction &i1 = table.pairs[pairs[1]];
+        const Interaction &i2 = table.pairs[pairs[2]];
+        const Interaction &i3 = table.pairs[pairs[3]];
+        const __m128 minDistanceSq = _mm_setr_ps(i0.minDistanceSq, i1.minDistanceSq, i2.minDistanceSq, i3.minDistanceSq);
+        const __m128 radiusSq = _mm_setr_ps(i0.radiusSq, i1.radiusSq, i2.radiusSq, i3.radiusSq);
+
+        __m128 dx = _mm_sub_ps(xs, px);
+        __m128 dy = _mm_sub_ps(ys, py);
+        dx = _mm_sub_ps(dx, _mm_and_ps(_mm_cmpgt_ps(dx, halfW), w));
+        dx = _mm_add_ps(dx, _mm_and_ps(_mm_cmplt_ps(dx, negHalfW), w));
+        dy = _mm_sub_ps(dy, _mm_and_ps(_mm_cmpgt_ps(dy, halfH), h));
+        dy = _mm_add_ps(dy, _mm_and_ps(_mm_cmplt_ps(dy, negHalfH), h));
+
+        const __m128 distanceSq = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+        const __m128 inMinDistance = _mm_and_ps(_mm_cmplt_ps(distanceSq, minDistanceSq), validMask);
+        const __m128 inRadius = _mm_and_ps(_mm_cmplt_ps(distanceSq, radiusSq), validMask);
+        const __m128 inRange = _mm_or_ps(inMinDistance, inRadius);
+        if(_mm_movemask_ps(inRange) == 0) {
+            continue;
+        }
+
+        const __m128 invMinDistance = _mm_setr_ps(i0.invMinDistance, i1.invMinDistance, i2.invMinDistance, i3.invMinDistance);
+        const __m128 invRadius = _mm_setr_ps(i0.invRadius, i1.invRadius, i2.invRadius, i3.invRadius);
+        const __m128 repulsion = _mm_setr_ps(i0.repulsion, i1.repulsion, i2.repulsion, i3.repulsion);
+        const __m128 attraction = _mm_setr_ps(i0.attraction, i1.attraction, i2.attraction, i3.attraction);
+
+        const __m128 distance = _mm_sqrt_ps(distanceSq);
+        const __m128 repulsionFactor = _mm_mul_ps(repulsion, _mm_sub_ps(one, _mm_mul_ps(distance, invMinDistance)));
+        const __m128 attractionFactor = _mm_mul_ps(attraction, _mm_sub_ps(one, _mm_mul_ps(distance, invRadius)));
+        const __m128 factor = _mm_add_ps(_mm_and_ps(repulsionFactor, inMinDistance), _mm_and_ps(attractionFactor, inRadius));
+
+        const __m128 coincident = _mm_and_ps(_mm_cmpeq_ps(distanceSq, zero), inRange);
+        const int coincidentMask = _mm_movemask_ps(coincident);
+        if(coincidentMask != 0) {
+            AddLanes(coincidentMask, scalarForce, table, particles, source, k, x, y, c, width, height);
+        }
+
+        const __m128 scale = _mm_and_ps(_mm_div_ps(factor, distance), _mm_andnot_ps(coincident, inRange));
+        fx = _mm_add_ps(fx, _mm_mul_ps(dx, scale));
+        fy = _mm_add_ps(fy, _mm_mul_ps(dy, scale));
+    }
+
+    alignas(16) float sx[Lanes];
+    alignas(16) float sy[Lanes];
+    _mm_store_ps(sx, fx);
+    _mm_store_ps(sy, fy);
+    for(int lane = 0; lane < Lanes; ++lane) {
+        scalarForce.x += sx[lane];
+        scalarForce.y += sy[lane];
+    }
+    return scalarForce;
+}
+
+static_assert(sizeof(Interaction) == 8 * sizeof(float), "the AVX2 kernel indexes records with a shift by 3");
+
+/// @brief Gathers one field of the interaction records of every lane in mask, zero in the others.
+PARTICLES_TARGET_AVX2 __m256 GatherField(const float *records, size_t offset, __m256i record, __m256 mask) {
+    return _mm256_mask_i32gather_ps(_mm256_setzero_ps(), records + offset / sizeof(float), record, mask, 4);
+}
+
+/// @brief Loads x, y and color of the valid lanes [k, k + 8) of a contiguous range.
+PARTICLES_TARGET_AVX2 void LoadLanes(const ParticleArrays &particles, const RangeSource &source, size_t k, __m256i valid, __m256 &xs, __m256 &ys, __m256i &colors) {
+    const size_t j = source.begin + k;
+    xs = _mm256_maskload_ps(particles.x + j, valid);
+    ys = _mm256_maskload_ps(particles.y + j, valid);
+    colors = _mm256_maskload_epi32(reinterpret_cast<const int *>(particles.colors + j), valid);
+}
+
+/// @brief Gathers x, y and color of the valid lanes [k, k + 8) of an index list.
+PARTICLES_TARGET_AVX2 void LoadLanes(const ParticleArrays &particles, const ListSource &source, size_t k, __m256i valid, __m256 &xs, __m256 &ys, __m256i &colors) {
+    const __m256i indices = _mm256_maskload_epi32(reinterpret_cast<const int *>(source.indices + k), valid);
+    const __m256 validMask = _mm256_castsi256_ps(valid);
+    xs = _mm256_mask_i32gather_ps(_mm256_setzero_ps(), particles.x, indices, validMask, 4);
+    ys = _mm256_mask_i32gather_ps(_mm256_setzero_ps(), particles.y, indices, validMask, 4);
+    colors = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), reinterpret_cast<const int *>(particles.colors), indices, valid, 4);
+}
+
+template <typename Source>
+PARTICLES_TARGET_AVX2 Vec ComputeForceAVX2(const InteractionTable &table, const ParticleArrays &particles, const Source &source, float x, float y, int c, float width,
+                                           float height) {
+    constexpr int Lanes = 8;
+
+    const __m256 px = _mm256_set1_ps(x);
+    const __m256 py = _mm256_set1_ps(y);
+    const __m256 w = _mm256_set1_ps(width);
+    const __m256 h = _mm256_set1_ps(height);
+    const __m256 halfW = _mm256_set1_ps(0.5f * width);
+    const __m256 halfH = _mm256_set1_ps(0.5f * height);
+    const __m256 negHalfW = _mm256_set1_ps(-0.5f * width);
+    const __m256 negHalfH = _mm256_set1_ps(-0.5f * height);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256i row = _mm256_set1_epi32(c * table.colorsCount);
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+    const float *records = reinterpret_cast<const float *>(table.pairs.data());
+
+    __m256 fx = zero;
+    __m256 fy = zero;
+    Vec scalarForce;
+
+    for(size_t k = 0; k < source.size(); k += Lanes) {
+        const int count = static_cast<int>(std::min<size_t>(Lanes, source.size() - k));
+        __m256i valid = _mm256_cmpgt_epi32(_mm256_set1_epi32(count), lanes);
+        if(const int skipped = source.skippedLane(k, Lanes); skipped >= 0) {
+            valid = _mm256_andnot_si256(_mm256_cmpeq_epi32(lanes, _mm256_set1_epi32(skipped)), valid);
+        }
+        const __m256 validMask = _mm256_castsi256_ps(valid);
+
+        // Masked loads keep the tail from reading past the arrays and masked gathers leave
+        // the pair parameters of invalid lanes at zero.
+        __m256 xs;
+        __m256 ys;
+        __m256i colors;
+        LoadLanes(particles, source, k, valid, xs, ys, colors);
+        __m256 dx = _mm256_sub_ps(xs, px);
+        __m256 dy = _mm256_sub_ps(ys, py);
+        const __m256i record = _mm256_slli_epi32(_mm256_add_epi32(row, colors), 3);
+        const __m256 minDistanceSq = GatherField(records, offsetof(Interaction, minDistanceSq), record, validMask);
+        const __m256 radiusSq = GatherField(records, offsetof(Interaction, radiusSq), record, validMask);
+
+        dx = _mm256_sub_ps(dx, _mm256_and_ps(_mm256_cmp_ps(dx, halfW, _CMP_GT_OQ), w));
+        dx = _mm256_add_ps(dx, _mm256_and_ps(_mm256_cmp_ps(dx, negHalfW, _CMP_LT_OQ), w));
+        dy = _mm256_sub_ps(dy, _mm256_and_ps(_mm256_cmp_ps(dy, halfH, _CMP_GT_OQ), h));
+        dy = _mm256_add_ps(dy, _mm256_and_ps(_mm256_cmp_ps(dy, negHalfH, _CMP_LT_OQ), h));
+
+        // Invalid lanes gathered zero squared distances, so both comparisons are false for them.
+        const __m256 distanceSq = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+        const __m256 inMinDistance = _mm256_cmp_ps(distanceSq, minDistanceSq, _CMP_LT_OQ);
+        const __m256 inRadius = _mm256_cmp_ps(distanceSq, radiusSq, _CMP_LT_OQ);
+        const __m256 inRange = _mm256_or_ps(inMinDistance, inRadius);
+        if(_mm256_movemask_ps(inRange) == 0) {
+            continue;
+        }
+
+        const __m256 invMinDistance = GatherField(records, offsetof(Interaction, invMinDistance), record, inMinDistance);
+        const __m256 repulsion = GatherField(records, offsetof(Interaction, repulsion), record, inMinDistance);
+        const __m256 invRadius = GatherField(records, offsetof(Interaction, invRadius), record, inRadius);
+        const __m256 attraction = GatherField(records, offsetof(Interaction, attraction), record, inRadius);
+
+        const __m256 distance = _mm256_sqrt_ps(distanceSq);
+        const __m256 repulsionFactor = _mm256_mul_ps(repulsion, _mm256_sub_ps(one, _mm256_mul_ps(distance, invMinDistance)));
+        const __m256 attractionFactor = _mm256_mul_ps(attraction, _mm256_sub_ps(one, _mm256_mul_ps(distance, invRadius)));
+        const __m256 factor = _mm256_add_ps(_mm256_and_ps(repulsionFactor, inMinDistance), _mm256_and_ps(attractionFactor, inRadius));
+
+        const __m256 coincident = _mm256_and_ps(_mm256_cmp_ps(distanceSq, zero, _CMP_EQ_OQ), inRange);
+        const int coincidentMask = _mm256_movemask_ps(coincident);
+        if(coincidentMask != 0) {
+            AddLanes(coincidentMask, scalarForce, table, particles, source, k, x, y, c, width, height);
+        }
+
+        const __m256 scale = _mm256_and_ps(_mm256_div_ps(factor, distance), _mm256_andnot_ps(coincident, inRange));
+        fx = _mm256_add_ps(fx, _mm256_mul_ps(dx, scale));
+        fy = _mm256_add_ps(fy, _mm256_mul_ps(dy, scale));
+    }
+
+    alignas(32) float sx[Lanes];
+    alignas(32) float sy[Lanes];
+    _mm256_store_ps(sx, fx);
+    _mm256_store_ps(sy, fy);
+    for(int lane = 0; lane < Lanes; ++lane) {
+        scalarForce.x += sx[lane];
+        scalarForce.y += sy[lane];
+    }
+    return scalarForce;
+}
+
+PARTICLES_TARGET_AVX2 Vec ComputePairForcesAVX2(const InteractionTable &table, const ParticleArrays &particles, size_t begin, size_t end, float x, float y, int c,
+                                                float width, float height, float *forcesX, float *forcesY) {
+    constexpr int Lanes = 8;
+
+    const __m256 px = _mm256_set1_ps(x);
+    const __m256 py = _mm256_set1_ps(y);
+    const __m256 w = _mm256_set1_ps(width);
+    const __m256 h = _mm256_set1_ps(height);
+    const __m256 halfW = _mm256_set1_ps(0.5f * width);
+    const __m256 halfH = _mm256_set1_ps(0.5f * height);
+    const __m256 negHalfW = _mm256_set1_ps(-0.5f * width);
+    const __m256 negHalfH = _mm256_set1_ps(-0.5f * height);
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256i row = _mm256_set1_epi32(c * table.colorsCount);
+    const __m256i column = _mm256_set1_epi32(c);
+    const __m256i colorsCount = _mm256_set1_epi32(table.colorsCount);
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+    const float *records = reinterpret_cast<const float *>(table.pairs.data());
+
+    __m256 fx = zero;
+    __m256 fy = zero;
+    Vec scalarForce;
+
+    for(size_t t = begin; t < end; t += Lanes) {
+        const int count = static_cast<int>(std::min<size_t>(Lanes, end - t));
+        const __m256i valid = _mm256_cmpgt_epi32(_mm256_set1_epi32(count), lanes);
+        const __m256 validMask = _mm256_castsi256_ps(valid);
+
+        __m256 dx = _mm256_sub_ps(_mm256_maskload_ps(particles.x + t, valid), px);
+        __m256 dy = _mm256_sub_ps(_mm256_maskload_ps(particles.y + t, valid), py);
+        const __m256i colors = _mm256_maskload_epi32(reinterpret_cast<const int *>(particles.colors + t), valid);
+        // (c, other) holds the force on the particle, (other, c) the force on the range.
+        const __m256i recordIJ = _mm256_slli_epi32(_mm256_add_epi32(row, colors), 3);
+        const __m256i recordJI = _mm256_slli_epi32(_mm256_add_epi32(_mm256_mullo_epi32(colors, colorsCount), column), 3);
+        const __m256 minDistanceSqIJ = GatherField(records, offsetof(Interaction, minDistanceSq), recordIJ, validMask);
+        const __m256 radiusSqIJ = GatherField(records, offsetof(Interaction, radiusSq), recordIJ, validMask);
+        const __m256 minDistanceSqJI = GatherField(records, offsetof(Interaction, minDistanceSq), recordJI, validMask);
+        const __m256 radiusSqJI = GatherField(records, offsetof(Interaction, radiusSq), recordJI, validMask);
+
+        dx = _mm256_sub_ps(dx, _mm256_and_ps(_mm256_cmp_ps(dx, halfW, _CMP_GT_OQ), w));
+        dx = _mm256_add_ps(dx, _mm256_and_ps(_mm256_cmp_ps(dx, negHalfW, _CMP_LT_OQ), w));
+        dy = _mm256_sub_ps(dy, _mm256_and_ps(_mm256_cmp_ps(dy, halfH, _CMP_GT_OQ), h));
+        dy = _mm256_add_ps(dy, _mm256_and_ps(_mm256_cmp_ps(dy, negHalfH, _CMP_LT_OQ), h));
+
+        const __m256 distanceSq = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+        const __m256 inMinDistanceIJ = _mm256_cmp_ps(distanceSq, minDistanceSqIJ, _CMP_LT_OQ);
+        const __m256 inRadiusIJ = _mm256_cmp_ps(distanceSq, radiusSqIJ, _CMP_LT_OQ);
+        const __m256 inMinDistanceJI = _mm256_cmp_ps(distanceSq, minDistanceSqJI, _CMP_LT_OQ);
+        const __m256 inRadiusJI = _mm256_cmp_ps(distanceSq, radiusSqJI, _CMP_LT_OQ);
+        const __m256 inRange = _mm256_or_ps(_mm256_or_ps(inMinDistanceIJ, inRadiusIJ), _mm256_or_ps(inMinDistanceJI, inRadiusJI));
+        if(_mm256_movemask_ps(inRange) == 0) {
+            continue;
+        }
+
+        const __m256 coincident = _mm256_and_ps(_mm256_cmp_ps(distanceSq, zero, _CMP_EQ_OQ), inRange);
+        const __m256 distance = _mm256_sqrt_ps(distanceSq);
+        const __m256 invDistance = _mm256_and_ps(_mm256_andnot_ps(coincident, inRange), _mm256_div_ps(one, distance));
+
+        const __m256 invMinDistanceIJ = GatherField(records, offsetof(Interaction, invMinDistance), recordIJ, inMinDistanceIJ);
+        const __m256 repulsionIJ = GatherField(records, offsetof(Interaction, repulsion), recordIJ, inMinDistanceIJ);
+        const __m256 invRadiusIJ = GatherField(records, offsetof(Interaction, invRadius), recordIJ, inRadiusIJ);
+        const __m256 attractionIJ = GatherField(records, offsetof(Interaction, attraction), recordIJ, inRadiusIJ);
+        const __m256 invMinDistanceJI = GatherField(records, offsetof(Interaction, invMinDistance), recordJI, inMinDistanceJI);
+        const __m256 repulsionJI = GatherField(records, offsetof(Interaction, repulsion), recordJI, inMinDistanceJI);
+        const __m256 invRadiusJI = GatherField(records, offsetof(Interaction, invRadius), recordJI, inRadiusJI);
+        const __m256 attractionJI = GatherField(records, offsetof(Interaction, attraction), recordJI, inRadiusJI);
+
+        const __m256 factorIJ = _mm256_add_ps(
+            _mm256_and_ps(_mm256_mul_ps(repulsionIJ, _mm256_sub_ps(one, _mm256_mul_ps(distance, invMinDistanceIJ))), inMinDistanceIJ),
+            _mm256_and_ps(_mm256_mul_ps(attractionIJ, _mm256_sub_ps(one, _mm256_mul_ps(distance, invRadiusIJ))), inRadiusIJ));
+        const __m256 factorJI = _mm256_add_ps(
+            _mm256_and_ps(_mm256_mul_ps(repulsionJI, _mm256_sub_ps(one, _mm256_mul_ps(distance, invMinDistanceJI))), inMinDistanceJI),
+            _mm256_and_ps(_mm256_mul_ps(attractionJI, _mm256_sub_ps(one, _mm256_mul_ps(distance, invRadiusJI))), inRadiusJI));
+
+        const __m256 scaleIJ = _mm256_mul_ps(factorIJ, invDistance);
+        const __m256 scaleJI = _mm256_mul_ps(factorJI, invDistance);
+        fx = _mm256_add_ps(fx, _mm256_mul_ps(dx, scaleIJ));
+        fy = _mm256_add_ps(fy, _mm256_mul_ps(dy, scaleIJ));
+
+        const __m256 reactionX = _mm256_sub_ps(_mm256_maskload_ps(forcesX + t, valid), _mm256_mul_ps(dx, scaleJI));
+        const __m256 reactionY = _mm256_sub_ps(_mm256_maskload_ps(forcesY + t, valid), _mm256_mul_ps(dy, scaleJI));
+        _mm256_maskstore_ps(forcesX + t, valid, reactionX);
+        _mm256_maskstore_ps(forcesY + t, valid, reactionY);
+
+        // Coincident lanes got no vector force, they push in random directions.
+        for(int mask = _mm256_movemask_ps(coincident); mask != 0; mask &= mask - 1) {
+            int lane = 0;
+            while(((mask >> lane) & 1) == 0) {
+                ++lane;
+            }
+            const size_t n = t + lane;
+            Vec reaction;
+            addPairForces(table.at(c, particles.colors[n]), table.at(particles.colors[n], c), Vec{}, scalarForce, reaction);
+            forcesX[n] += reaction.x;
+            forcesY[n] += reaction.y;
+        }
+    }
+
+    alignas(32) float sx[Lanes];
+    alignas(32) float sy[Lanes];
+    _mm256_store_ps(sx, fx);
+    _mm256_store_ps(sy, fy);
+    for(int lane = 0; lane < Lanes; ++lane) {
+        scalarForce.x += sx[lane];
+        scalarForce.y += sy[lane];
+    }
+    return scalarForce;
+}
+#endif
+} // namespace
+
+ForceKernel detectForceKernel() {
+#if defined(PARTICLES_X86) && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    const int maxLeaf = info[0];
+    __cpuid(info, 1);
+    const bool sse41 = (info[2] & (1 << 19)) != 0;
+    const bool osAvx = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 && (_xgetbv(0) & 0x6) == 0x6;
+    bool avx2 = false;
+    if(maxLeaf >= 7 && osAvx) {
+        __cpuidex(info, 7, 0);
+        avx2 = (info[1] & (1 << 5)) != 0;
+    }
+    if(avx2) {
+        return ForceKernel::AVX2;
+    }
+    if(sse41) {
+        return ForceKernel::SSE;
+    }
+#elif defined(PARTICLES_X86)
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2")) {
+        return ForceKernel::AVX2;
+    }
+    if(__builtin_cpu_supports("sse4.1")) {
+        return ForceKernel::SSE;
+    }
+#endif
+    return ForceKernel::Scalar;
+}
+
+const char *toString(ForceKernel kernel) {
+    switch(kernel) {
+    case ForceKernel::Scalar:
+        return "Scalar";
+    case ForceKernel::SSE:
+        return "SSE";
+    case ForceKernel::AVX2:
+        return "AVX2";
+    }
+    return "";
+}
+
+namespace {
+
+template <typename Source>
+Vec ComputeForce(ForceKernel kernel, const InteractionTable &table, const ParticleArrays &particles, const Source &source, float x, float y, int c, float width,
+                 float height) {
+    switch(kernel) {
+#if defined(PARTICLES_X86)
+    case ForceKernel::AVX2:
+        return ComputeForceAVX2(table, particles, source, x, y, c, width, height);
+    case ForceKernel::SSE:
+        return ComputeForceSSE(table, particles, source, x, y, c, width, height);
+#endif
+    default:
+        return ComputeForceScalar(table, particles, source, x, y, c, width, height);
+    }
+}
+
+} // namespace
+
+Vec computeForce(ForceKernel kernel, const InteractionTable &table, const ParticleArrays &particles, size_t begin, size_t end, size_t self,
+                 float x, float y, int c, float width, float height) {
+    return ComputeForce(kernel, table, particles, RangeSource{begin, end, self}, x, y, c, width, height);
+}
+
+Vec computeForce(ForceKernel kernel, const InteractionTable &table, const ParticleArrays &particles, std::span<const uint32_t> indices,
+                 float x, float y, int c, float width, float height) {
+    return ComputeForce(kernel, table, particles, ListSource{indices.data(), indices.size()}, x, y, c, width, height);
+}
+
+Vec computePairForces(ForceKernel kernel, const InteractionTable &table, const ParticleArrays &particles, size_t begin, size_t end,
+                      float x, float y, int c, float width, float height, float *forcesX, float *forcesY) {
+#if defined(PARTICLES_X86)
+    if(kernel == ForceKernel::AVX2) {
+        return ComputePairForcesAVX2(table, particles, begin, end, x, y, c, width, height, forcesX, forcesY);
+    }
+#endif
+    return ComputePairForcesScalar(table, particles, begin, end, x, y, c, width, height, forcesX, forcesY);
+}
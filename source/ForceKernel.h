@@ -0,0 +1,43 @@
+#pragma once
+
+#include "Config.h"
+#include "Vec.h"
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+/// @brief Instruction set used to evaluate the pair forces.
+enum class ForceKernel {
+    Scalar,
+    SSE,
+    AVX2,
+};
+
+/// @brief Returns the widest kernel supported by the CPU running the program.
+ForceKernel detectForceKernel();
+
+const char *toString(ForceKernel kernel);
+
+/// @brief Particles stored as separate x, y and color arrays.
+struct ParticleArrays {
+    const float *x;
+    const float *y;
+    const int32_t *colors;
+};
+
+/// @brief Sums the forces particles [begin, end) of the arrays exert on a particle of color c at (x, y)
+/// in a periodic width x height world. The particle at index self is skipped when it is in the range.
+/// Every kernel gives the same result as pairForce up to float rounding.
+Vec computeForce(ForceKernel kernel, const InteractionTable &table, const ParticleArrays &particles, size_t begin, size_t end, size_t self,
+                 float x, float y, int c, float width, float height);
+
+/// @brief Same as above for the particles picked from the arrays by an index list.
+Vec computeForce(ForceKernel kernel, const InteractionTable &table, const ParticleArrays &particles, std::span<const uint32_t> indices,
+                 float x, float y, int c, float width, float height);
+
+/// @brief Pair-symmetric variant: evaluates every pair of the particle of color c at (x, y) with particles
+/// [begin, end) of the arrays once. Returns the force on the particle and adds the force it exerts on every
+/// particle t of the range to (forcesX[t], forcesY[t]). The range must not contain the particle itself.
+/// The SSE kernel has no pair-symmetric variant and uses the scalar one.
+Vec computePairForces(ForceKernel kernel, const InteractionTable &table, const ParticleArrays &particles, size_t begin, size_t end,
+                      float x, float y, int c, float width, float height, float *forcesX, float *forcesY);
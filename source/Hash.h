@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/// FNV-1a start value, the hash of no bytes
+constexpr uint64_t FnvOffset = 14695981039346656037ull;
+constexpr uint64_t FnvPrime = 1099511628211ull;
+
+/// @brief Folds size bytes at data into the 64 bit FNV-1a hash.
+inline uint64_t fnv1a(uint64_t hash, const void *data, size_t size) {
+    const auto *bytes = static_cast<const unsigned char *>(data);
+    for(size_t i = 0; i < size; ++i) {
+        hash = (hash ^ bytes[i]) * FnvPrime;
+    }
+    return hash;
+}
+
+/// @brief Folds the bytes of a plain value into the hash.
+template <typename T>
+uint64_t fnv1a(uint64_t hash, const T &value) {
+    return fnv1a(hash, &value, sizeof(T));
+}
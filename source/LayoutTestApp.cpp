@@ -1,5 +1,6 @@
 #include "ConfigFunctions.h"
 #include "LayoutTestApp.h"
+#include "WorldFile.h"
 
 
 #include <backends/imgui_impl_sdl3.h>
@@ -12,7 +13,12 @@
 #include <SDL3/SDL_render.h>
 #include <SDL3/SDL_video.h>
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
 #include <string>
+#include <string_view>
 
 namespace {
 
@@ -35,20 +41,6 @@ void DrawFrame(SDL_Renderer *renderer, float w = 3) {
     SDL_RenderFillRect(renderer, &right);
 }
 
-/// @brief Renders
-void RenderTexture(SDL_Renderer *renderer, SDL_Texture *texture, float x, float y, int size, float r, float g, float b) {
-    const float offset = size / 2;
-    SDL_FRect dst{.x = x - offset,
-                  .y = y - offset,
-                  .w = static_cast<float>(size),
-                  .h = static_cast<float>(size)};
-
-    SDL_SetTextureColorMod(texture, static_cast<char>(255 * r),
-                           static_cast<char>(255 * g),
-                           static_cast<char>(255 * b));
-    SDL_RenderTexture(renderer, texture, nullptr, &dst);
-}
-
 /// @brief Scales the textureSize to fit the availableSpace and conserving the original aspect ratio
 ImVec2 ScaleToFit(ImVec2 textureSize, ImVec2 availableSpace) {
     const float ratio = std::min(availableSpace.x / textureSize.x, availableSpace.y / textureSize.y);
@@ -88,6 +80,19 @@ std::unique_ptr<IApp> CreateLayoutTestApp(Config &config, State &state, int16_t
     }
     SDL_Texture_Handle spriteTexture(SDL_CreateTextureFromSurface(renderer.get(), surface.get()), SDL_DestroyTexture);
     SDL_Texture_Handle backBuffer(SDL_CreateTexture(renderer.get(), SDL_PIXELFORMAT_ABGR8888, SDL_TEXTUREACCESS_TARGET, width, height), SDL_DestroyTexture);
+    SDL_Texture_Handle splatTexture(SDL_CreateTexture(renderer.get(), SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STREAMING, width, height), SDL_DestroyTexture);
+    if(splatTexture == nullptr) {
+        printf("Splat texture could not be created! SDL Error: %s\n", SDL_GetError());
+        return nullptr;
+    }
+    SDL_Texture_Handle densityTexture(SDL_CreateTexture(renderer.get(), SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STREAMING,
+                                                        width / DensityRenderer::TileSize, height / DensityRenderer::TileSize),
+                                      SDL_DestroyTexture);
+    if(densityTexture == nullptr) {
+        printf("Density texture could not be created! SDL Error: %s\n", SDL_GetError());
+        return nullptr;
+    }
+    SDL_SetTextureScaleMode(densityTexture.get(), SDL_SCALEMODE_LINEAR);
 
     // ####################################
     // ## IMGUI
@@ -105,20 +110,30 @@ std::unique_ptr<IApp> CreateLayoutTestApp(Config &config, State &state, int16_t
     ImGui_ImplSDL3_InitForSDLRenderer(window.get(), renderer.get());
     ImGui_ImplSDLRenderer3_Init(renderer.get());
 
-    return std::make_unique<LayoutTestApp>(config, state, width, height, std::move(window), std::move(renderer), std::move(surface), std::move(spriteTexture), std::move(backBuffer));
+    return std::make_unique<LayoutTestApp>(config, state, width, height, std::move(window), std::move(renderer), std::move(surface), std::move(spriteTexture), std::move(backBuffer), std::move(splatTexture), std::move(densityTexture));
 }
 
 LayoutTestApp::LayoutTestApp(Config &config, State &state, int16_t width, int16_t height, SDL_Window_Handle window, SDL_Renderer_Handle renderer, SDL_Surface_Handle surface,
-                             SDL_Texture_Handle spriteTexture, SDL_Texture_Handle backBuffer)
-    : mConfig(config), mState(state), mWidth(width),
+                             SDL_Texture_Handle spriteTexture, SDL_Texture_Handle backBuffer, SDL_Texture_Handle splatTexture, SDL_Texture_Handle densityTexture)
+    : mConfig(config), mState(state),
+      mEngine(config, state, width, height),
+      mSimulation(mEngine),
+      mUiConfig(config),
+      mWidth(width),
       mHeight(height),
       mWindow(std::move(window)),
       mRenderer(std::move(renderer)),
       mSurface(std::move(surface)),
       mSpriteTexture(std::move(spriteTexture)),
-      mBackBuffer(std::move(backBuffer)) {
-
-    
+      mBackBuffer(std::move(backBuffer)),
+      mSplatTexture(std::move(splatTexture)),
+      mDensityTexture(std::move(densityTexture)),
+      mCamera(width, height) {
+    // Without a GPU the sprites are drawn one pixel at a time by SDL anyway.
+    const char *rendererName = SDL_GetRendererName(mRenderer.get());
+    if(rendererName != nullptr && std::string_view(rendererName) == SDL_SOFTWARE_RENDERER) {
+        mRenderMode = RenderMode::Splats;
+    }
 }
 
 LayoutTestApp::~LayoutTestApp() {
@@ -136,20 +151,25 @@ LayoutTestApp::~LayoutTestApp() {
 
 void LayoutTestApp::Run() {
     bool quit = false;
+    mSimulation.start();
 
     while(!quit) {
+        PROFILE_SCOPE("Frame");
+        mProfilerWindow.frame();
         quit = Update();
         Render();
     }
+
+    mSimulation.stop();
 }
 
 bool LayoutTestApp::Update() {
+    PROFILE_SCOPE("Poll events");
     const ImGuiIO &io = ImGui::GetIO();
     const ImVec2 mousePos = io.MousePos;
     if (mousePos.x >= mGameTopLeft.x && mousePos.y >= mGameTopLeft.y && mousePos.x < mGameTopLeft.x + mGameSize.x && mousePos.y < mGameTopLeft.y + mGameSize.y) {
         const Position factor{mWidth/mGameSize.x, mHeight/mGameSize.y};        
-        mGamePosition.x = (mousePos.x - mGameTopLeft.x) * factor.x;
-        mGamePosition.y = (mousePos.y - mGameTopLeft.y) * factor.y;
+        mGamePosition = mCamera.toWorld(Position{(mousePos.x - mGameTopLeft.x) * factor.x, (mousePos.y - mGameTopLeft.y) * factor.y});
     } else {
         mGamePosition.x = -1;
         mGamePosition.y = -1;
@@ -164,11 +184,36 @@ bool LayoutTestApp::Update() {
 
         if (e.type == SDL_EVENT_MOUSE_BUTTON_DOWN && e.button.button == 1) {
             if (mGamePosition.x != -1 && mGamePosition.y != -1) {
-                const int c = 1;
-                AddParticle(mState, mGamePosition.x, mGamePosition.y, c);            
+                // A loaded world may have a single color.
+                const int c = std::min(1, mUiConfig.colorsCount - 1);
+                mSimulation.push(AddParticleCommand{mGamePosition.x, mGamePosition.y, c});            
             } 
         }
 
+        if(e.type == SDL_EVENT_KEY_DOWN && e.key.key == SDLK_HOME) {
+            mCamera.reset();
+        }
+
+        if(e.type == SDL_EVENT_KEY_DOWN && e.key.key == SDLK_P) {
+            mProfilerWindow.dumpTrace("trace.json");
+        }
+
+        if(e.type == SDL_EVENT_KEY_DOWN && e.key.key == SDLK_F5) {
+            SaveWorld();
+        }
+
+        if(e.type == SDL_EVENT_KEY_DOWN && e.key.key == SDLK_F9) {
+            LoadWorld();
+        }
+
+        if(e.type == SDL_EVENT_KEY_DOWN && e.key.key == SDLK_R) {
+            if(mSimulation.recording()) {
+                mSimulation.push(StopRecordingCommand{});
+            } else {
+                mSimulation.push(StartRecordingCommand{TrajectoryPath});
+            }
+        }
+
         if(e.type == SDL_EVENT_QUIT) {
             return true;
         }
@@ -177,13 +222,27 @@ bool LayoutTestApp::Update() {
 }
 
 void LayoutTestApp::Render() {
-    SDL_SetRenderTarget(mRenderer.get(), mBackBuffer.get());
-
     constexpr ImVec4 blackColor = ImVec4(0.0f, 0.0f, 0.0f, 1.0f);
-    SDL_SetRenderDrawColor(mRenderer.get(), (Uint8)(blackColor.x * 255), (Uint8)(blackColor.y * 255), (Uint8)(blackColor.z * 255), (Uint8)(blackColor.w * 255));
-    SDL_RenderClear(mRenderer.get());
+    const Snapshot &snapshot = mSimulation.snapshot();
+    SDL_Texture *gameTexture = mBackBuffer.get();
+    // Discs whose centre is just outside the view still show in part.
+    mViewCuller.update(snapshot, mCamera, mWidth, mHeight, mUiConfig.particleSize / 2.0f, std::chrono::steady_clock::now());
+    // The game view is as large as the window until ImGui laid it out once
+    const double viewPixels = mGameSize.x > 0 ? static_cast<double>(mGameSize.x) * mGameSize.y : static_cast<double>(mWidth) * mHeight;
+    mDensityActive = mAutoDensity && DensityRenderer::wanted(mViewCuller.positions().size(), viewPixels, mDensityActive);
+    if(mRenderMode == RenderMode::Density || mDensityActive) {
+        RenderDensity();
+        gameTexture = mDensityTexture.get();
+    } else if(mRenderMode == RenderMode::Splats) {
+        RenderSplats();
+        gameTexture = mSplatTexture.get();
+    } else {
+        SDL_SetRenderTarget(mRenderer.get(), mBackBuffer.get());
+        SDL_SetRenderDrawColor(mRenderer.get(), (Uint8)(blackColor.x * 255), (Uint8)(blackColor.y * 255), (Uint8)(blackColor.z * 255), (Uint8)(blackColor.w * 255));
+        SDL_RenderClear(mRenderer.get());
 
-    RenderParticles();
+        RenderParticles();
+    }
 
     SDL_SetRenderTarget(mRenderer.get(), nullptr);
     SDL_SetRenderDrawColor(mRenderer.get(), (Uint8)(blackColor.x * 255), (Uint8)(blackColor.y * 255), (Uint8)(blackColor.z * 255), (Uint8)(blackColor.w * 255));
@@ -206,7 +265,8 @@ void LayoutTestApp::Render() {
 
     const ImVec2 textureOffset = ImVec2{(availableSpace.x - desiredTextureSize.x) / 2, (availableSpace.y - desiredTextureSize.y) / 2};
     ImGui::SetCursorPos(ImVec2{textureOffset.x, textureOffset.y + titlebarHeight});
-    ImGui::Image((ImTextureID)(intptr_t)mBackBuffer.get(), desiredTextureSize);
+    ImGui::Image((ImTextureID)(intptr_t)gameTexture, desiredTextureSize);
+    UpdateCamera();
 
     mGameTopLeft.x = textureOffset.x;
     mGameTopLeft.y = textureOffset.y + titlebarHeight;
@@ -217,17 +277,24 @@ void LayoutTestApp::Render() {
     ImGui::PopStyleVar();
 
     ImGui::Begin("Utils");
-    // RenderConfig(mConfig);
+    // if(RenderConfig(mUiConfig)) {
+    //     mSimulation.push(SetConfigCommand{mUiConfig});
+    // }
     RenderDebugInfo();
     ImGui::End();
 
+    ImGui::Begin("Profiler");
+    mProfilerWindow.render();
+    ImGui::End();
+
     ImGui::Render();
 
+    PROFILE_SCOPE("Present");
     ImGui_ImplSDLRenderer3_RenderDrawData(ImGui::GetDrawData(), mRenderer.get());
     SDL_RenderPresent(mRenderer.get());
 }
 
-void LayoutTestApp::RenderConfig(Config &config) {
+bool LayoutTestApp::RenderConfig(Config &config) {
     int currentColor = 3;
     constexpr ImVec2 colorBoxSize(25.0f, 25.0f);
 
@@ -323,17 +390,45 @@ void LayoutTestApp::RenderConfig(Config &config) {
         draw_list->PopClipRect();
     }
 
-    ImGui::SliderFloat("matrix", &config.matrix[lastSelectedY][lastSelectedX],
-                       -1.0f, 1.0f);
+    bool changed = false;
+    changed |= ImGui::SliderFloat("matrix", &config.matrix[lastSelectedY][lastSelectedX],
+                                  -1.0f, 1.0f);
 
     ImGui::Separator();
-    ImGui::SliderFloat("rMax", &config.rMax, 0.01f, 1.0f);
+    changed |= ImGui::SliderFloat("rMax", &config.rMax, 0.01f, 1.0f);
     ImGui::SliderInt("size", &config.particleSize, 2, 20);
 
     ImGui::Separator();
-    ImGui::SliderFloat("dt", &config.dt, 0.01f, 1.0f);
-    ImGui::SliderFloat("Friction", &config.friction, 0.01f, 1.0f);
-    ImGui::SliderFloat("k", &config.k, 0.01f, 1.0f);
+    changed |= ImGui::SliderFloat("dt", &config.dt, 0.01f, 1.0f);
+    changed |= ImGui::SliderFloat("Friction", &config.friction, 0.01f, 1.0f);
+    changed |= ImGui::SliderFloat("k", &config.k, 0.01f, 1.0f);
+
+    if(changed) {
+        invalidateInteractions(config);
+    }
+    return changed;
+}
+
+void LayoutTestApp::SaveWorld() {
+    mSimulation.push(SaveWorldCommand{WorldPath});
+}
+
+void LayoutTestApp::LoadWorld() {
+    Config config;
+    State state;
+    int width = 0;
+    int height = 0;
+    std::string error;
+    if(!loadWorld(WorldPath, config, state, width, height, error)) {
+        printf("Could not load the world: %s\n", error.c_str());
+        return;
+    }
+    if(width != mWidth || height != mHeight) {
+        printf("Could not load the world: saved in a %dx%d world, this one is %dx%d\n", width, height, mWidth, mHeight);
+        return;
+    }
+    mUiConfig = config;
+    mSimulation.push(SetWorldCommand{std::move(config), std::move(state)});
 }
 
 void LayoutTestApp::RenderDebugInfo() {
@@ -345,17 +440,100 @@ void LayoutTestApp::RenderDebugInfo() {
 
     float gamePos[4] = {mGamePosition.x, mGamePosition.y, 0, 0};
     ImGui::InputFloat2("gamePos", gamePos);
+
+    ImGui::Text("Simulation: %.0f Hz", mSimulation.stepsPerSecond());
+    ImGui::Text("Render: %.0f FPS", ImGui::GetIO().Framerate);
+    if(mSimulation.recording()) {
+        ImGui::TextColored(ImVec4(1.0f, 0.3f, 0.3f, 1.0f), "Recording to %s (R to stop)", TrajectoryPath);
+    }
+
+    bool turbo = mSimulation.turbo();
+    if(ImGui::Checkbox("Turbo", &turbo)) {
+        mSimulation.setTurbo(turbo);
+    }
+    ImGui::SameLine();
+    bool sleeping = mSimulation.sleeping();
+    if(ImGui::Checkbox("Sleep", &sleeping)) {
+        mSimulation.setSleeping(sleeping);
+    }
+    if(sleeping) {
+        ImGui::SameLine();
+        ImGui::Text("%.0f%% awake", 100 * mSimulation.awakeFraction());
+    }
+
+    int mode = static_cast<int>(mRenderMode);
+    ImGui::Text("Render mode");
+    ImGui::RadioButton("Sprites", &mode, static_cast<int>(RenderMode::Sprites));
+    ImGui::SameLine();
+    ImGui::RadioButton("CPU splats", &mode, static_cast<int>(RenderMode::Splats));
+    ImGui::SameLine();
+    ImGui::RadioButton("Density", &mode, static_cast<int>(RenderMode::Density));
+    mRenderMode = static_cast<RenderMode>(mode);
+    ImGui::Checkbox("Density when crowded", &mAutoDensity);
+    ImGui::Text("Zoom %.1fx, %zu particles in view", mCamera.zoom(), mViewCuller.positions().size());
+    ImGui::SameLine();
+    if(ImGui::Button("Reset view")) {
+        mCamera.reset();
+    }
+    if(mDensityActive) {
+        ImGui::SameLine();
+        ImGui::TextDisabled("(active)");
+    }
+}
+
+void LayoutTestApp::UpdateCamera() {
+    if(!ImGui::IsItemHovered()) {
+        return;
+    }
+    const ImGuiIO &io = ImGui::GetIO();
+    const ImVec2 topLeft = ImGui::GetItemRectMin();
+    const ImVec2 size = ImGui::GetItemRectSize();
+    if(size.x <= 0 || size.y <= 0) {
+        return;
+    }
+    // The view is drawn at world size and scaled into the window.
+    const Position scale{mWidth / size.x, mHeight / size.y};
+    if(io.MouseWheel != 0) {
+        const Position anchor{(io.MousePos.x - topLeft.x) * scale.x, (io.MousePos.y - topLeft.y) * scale.y};
+        mCamera.zoomAt(std::pow(1.25f, io.MouseWheel), anchor);
+    }
+    if(ImGui::IsMouseDown(ImGuiMouseButton_Middle) || ImGui::IsMouseDown(ImGuiMouseButton_Right)) {
+        mCamera.pan(io.MouseDelta.x * scale.x, io.MouseDelta.y * scale.y);
+    }
 }
 
 void LayoutTestApp::RenderParticles() {
-  for (size_t i = 0; i < mState.pos.size(); ++i) {
-    const Position &pos = mState.pos[i];
-    const int col = mState.colors[i];
-    const Rgb rgb = mConfig.particleColors[col];
+    PROFILE_SCOPE("Draw particles");
+    mParticleRenderer.render(mRenderer.get(), mSpriteTexture.get(), mUiConfig, mViewCuller.colors(), mViewCuller.positions(), mCamera.zoom());
+}
 
-    const float screenX = pos.x;
-    const float screenY = pos.y;
+void LayoutTestApp::RenderSplats() {
+    PROFILE_SCOPE("Draw particles");
+    void *pixels = nullptr;
+    int pitch = 0;
+    if(!SDL_LockTexture(mSplatTexture.get(), nullptr, &pixels, &pitch)) {
+        printf("Could not lock the splat texture: %s\n", SDL_GetError());
+        mRenderMode = RenderMode::Sprites;
+        return;
+    }
+    Config viewConfig = mUiConfig;
+    viewConfig.particleSize = static_cast<int>(std::lround(mUiConfig.particleSize * mCamera.zoom()));
+    const PixelBuffer target{static_cast<uint8_t *>(pixels), pitch, mWidth, mHeight};
+    mSplatRasterizer.render(target, viewConfig, mViewCuller.colors(), mViewCuller.positions());
+    SDL_UnlockTexture(mSplatTexture.get());
+}
 
-    RenderTexture(mRenderer.get(), mSpriteTexture.get(), screenX, screenY, mConfig.particleSize, rgb.r, rgb.g, rgb.b);
-  }    
-}
\ No newline at end of file
+void LayoutTestApp::RenderDensity() {
+    PROFILE_SCOPE("Draw particles");
+    void *pixels = nullptr;
+    int pitch = 0;
+    if(!SDL_LockTexture(mDensityTexture.get(), nullptr, &pixels, &pitch)) {
+        printf("Could not lock the density texture: %s\n", SDL_GetError());
+        mRenderMode = RenderMode::Sprites;
+        mAutoDensity = false;
+        return;
+    }
+    const PixelBuffer target{static_cast<uint8_t *>(pixels), pitch, mDensityTexture->w, mDensityTexture->h};
+    mDensityRenderer.render(target, mWidth, mHeight, mUiConfig, mViewCuller.colors(), mViewCuller.positions());
+    SDL_UnlockTexture(mDensityTexture.get());
+}
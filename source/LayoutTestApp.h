@@ -1,6 +1,13 @@
 #pragma once
 
+#include "Camera.h"
 #include "IApp.h"
+#include "ParticleRenderer.h"
+#include "DensityRenderer.h"
+#include "ProfilerWindow.h"
+#include "Simulation.h"
+#include "SplatRasterizer.h"
+#include "ViewCuller.h"
 #include <memory>
 
 struct SDL_Renderer;
@@ -15,10 +22,20 @@ using SDL_Window_Handle = std::unique_ptr<SDL_Window, void (*)(SDL_Window*)>;
 
 std::unique_ptr<IApp> CreateLayoutTestApp(Config& config, State& state, int16_t width, int16_t height);
 
+/// @brief How the game view is drawn
+enum class RenderMode {
+    /// A tinted copy of res/circle.png per particle, drawn by the SDL renderer into mBackBuffer
+    Sprites,
+    /// Discs rasterized on the CPU straight into the streaming mSplatTexture, see SplatRasterizer
+    Splats,
+    /// Particles counted per texel and tone-mapped into the streaming mDensityTexture, see DensityRenderer
+    Density,
+};
+
 class LayoutTestApp : public IApp {
 public:
     LayoutTestApp(Config& config, State& state, int16_t width, int16_t height, SDL_Window_Handle window, SDL_Renderer_Handle renderer, SDL_Surface_Handle surface,
-		 SDL_Texture_Handle spriteTexture, SDL_Texture_Handle backBuffer);
+		 SDL_Texture_Handle spriteTexture, SDL_Texture_Handle backBuffer, SDL_Texture_Handle splatTexture, SDL_Texture_Handle densityTexture);
     ~LayoutTestApp();
 
 	void Run() override;
@@ -26,12 +43,29 @@ public:
 private:
 	bool Update();
 	void Render();
-    void RenderConfig(Config& config);
+    /// @brief Returns true when a setting the simulation depends on was changed
+    bool RenderConfig(Config& config);
     void RenderDebugInfo();
+    /// @brief F5 and F9: save the simulated world to WorldPath and load it back
+    void SaveWorld();
+    void LoadWorld();
+    /// @brief Mouse wheel zooms the game view around the cursor, dragging with the middle or
+    /// right button pans it. Called right after the view's ImGui::Image.
+    void UpdateCamera();
+    /// @brief The Render* functions draw the particles mViewCuller picked, in view pixels
     void RenderParticles();
+    /// @brief Rasterizes the particles into mSplatTexture
+    void RenderSplats();
+    /// @brief Draws the particle density into mDensityTexture
+    void RenderDensity();
 
     Config& mConfig;
     State& mState;
+    /// Owned by the simulation thread while it runs
+    Engine mEngine;
+    Simulation mSimulation;
+    /// Copy of the config edited by the UI and used for drawing, sent to the simulation when it changes
+    Config mUiConfig;
     int16_t mWidth;
     int16_t mHeight;    
     SDL_Window_Handle mWindow;
@@ -39,8 +73,27 @@ private:
     SDL_Surface_Handle mSurface;
     SDL_Texture_Handle mSpriteTexture;
     SDL_Texture_Handle mBackBuffer;
+    SDL_Texture_Handle mSplatTexture;
+    SDL_Texture_Handle mDensityTexture;
+    ParticleRenderer mParticleRenderer;
+    SplatRasterizer mSplatRasterizer;
+    DensityRenderer mDensityRenderer;
+    Camera mCamera;
+    /// Particles drawn this frame, interpolated between the last two steps
+    ViewCuller mViewCuller;
+    /// Mode picked in the UI
+    RenderMode mRenderMode = RenderMode::Sprites;
+    /// Switch to the density map while the particles are too dense to tell apart
+    bool mAutoDensity = true;
+    bool mDensityActive = false;
+    ProfilerWindow mProfilerWindow;
+
+    static constexpr const char* WorldPath = "world.particles";
+    /// R starts and stops recording the trajectory here
+    static constexpr const char* TrajectoryPath = "trajectory.ptraj";
 
     Position mGameTopLeft{};
     Position mGameSize{};
+    /// World point under the mouse, -1 when the mouse is outside the game view
     Position mGamePosition{};
-};
\ No newline at end of file
+};
\ No newline at end of file
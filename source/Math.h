@@ -1,18 +1,12 @@
 #pragma once
-#include <cstdlib>
-#include <random>
+#include "Random.h"
 
 inline float frand() {
-	constexpr int max = 10000;
-	return static_cast<float>(rand() % max) / max;
+	return threadRandom().uniform();
 }
 
 inline float rand(float min, float max) {
-	std::random_device dev;
-    std::mt19937 rng(dev());
-    std::uniform_real_distribution<> dist(min, max);
-
-    return static_cast<float>(dist(rng));
+	return threadRandom().uniform(min, max);
 }
 
 inline float warp(float x)
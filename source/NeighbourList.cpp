@@ -0,0 +1,102 @@
+#include "NeighbourList.h"
+#include "Physics.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <numbers>
+
+bool NeighbourList::isValid(const State &state, float cutoff, float skin, float width, float height, ThreadPool &pool,
+                            size_t chunkSize) {
+    // Adding or clearing particles moves nextId, reordering them goes through invalidate().
+    if(!mValid || state.pos.size() != mCount || state.nextId != mNextId || cutoff != mCutoff || skin != mSkin) {
+        return false;
+    }
+
+    const float maxDisplacementSq = 0.25f * skin * skin;
+    std::atomic<bool> moved = false;
+    pool.parallelFor(mCount, chunkSize, [&](size_t begin, size_t end) {
+        if(moved.load(std::memory_order_relaxed)) {
+            return;
+        }
+        for(size_t i = begin; i < end; ++i) {
+            const Vec displacement = wrapDirection(Vec{state.pos[i].x - mBuildPositions[i].x, state.pos[i].y - mBuildPositions[i].y},
+                                                   width, height);
+            if(displacement.x * displacement.x + displacement.y * displacement.y > maxDisplacementSq) {
+                moved.store(true, std::memory_order_relaxed);
+                return;
+            }
+        }
+    });
+    return !moved;
+}
+
+bool NeighbourList::build(const State &state, float cutoff, float skin, float width, float height, ThreadPool &pool,
+                          size_t chunkSize, CellList &cellList) {
+    PROFILE_SCOPE("Index build: neighbour lists");
+    const size_t count = state.pos.size();
+    const float listRadius = cutoff + skin;
+    const float listRadiusSq = listRadius * listRadius;
+
+    // Lists grow with N^2 times the share of the world a list covers, evenly spread particles
+    // give a fair estimate.
+    const double coverage = std::min(1.0, std::numbers::pi * listRadiusSq / (static_cast<double>(width) * height));
+    if(static_cast<double>(count) * count * coverage > MaxPairs) {
+        mValid = false;
+        return false;
+    }
+
+    cellList.build(state, listRadius, width, height);
+
+    mOffsets.resize(count + 1);
+    mOffsets[0] = 0;
+    mChunkNeighbours.resize((count + chunkSize - 1) / chunkSize);
+
+    const ParticleArrays sorted = cellList.sorted();
+    pool.parallelFor(count, chunkSize, [&](size_t begin, size_t end) {
+        std::vector<uint32_t> &neighbours = mChunkNeighbours[begin / chunkSize];
+        neighbours.clear();
+        for(size_t i = begin; i < end; ++i) {
+            const Position p = state.pos[i];
+            const size_t self = cellList.slot(i);
+            const size_t first = neighbours.size();
+            cellList.forEachNeighbourCell(p.x, p.y, [&](uint32_t from, uint32_t to) {
+                // Branchless compaction: every candidate is written, only the ones in range are kept.
+                size_t n = neighbours.size();
+                neighbours.resize(n + (to - from));
+                uint32_t *out = neighbours.data();
+                for(uint32_t s = from; s < to; ++s) {
+                    // Distance the short way around, without the branches of wrapDirection.
+                    float dx = std::abs(sorted.x[s] - p.x);
+                    float dy = std::abs(sorted.y[s] - p.y);
+                    dx = std::min(dx, width - dx);
+                    dy = std::min(dy, height - dy);
+                    out[n] = cellList.index(s);
+                    n += (dx * dx + dy * dy <= listRadiusSq) & (s != self);
+                }
+                neighbours.resize(n);
+            });
+            mOffsets[i + 1] = static_cast<uint32_t>(neighbours.size() - first);
+        }
+    });
+
+    // Chunks cover consecutive particles, so concatenating them in order gives the CSR array.
+    for(size_t i = 0; i < count; ++i) {
+        mOffsets[i + 1] += mOffsets[i];
+    }
+    mNeighbours.resize(mOffsets[count]);
+    size_t offset = 0;
+    for(const std::vector<uint32_t> &neighbours : mChunkNeighbours) {
+        std::copy(neighbours.begin(), neighbours.end(), mNeighbours.begin() + offset);
+        offset += neighbours.size();
+    }
+
+    mBuildPositions.assign(state.pos.begin(), state.pos.end());
+    mCount = count;
+    mNextId = state.nextId;
+    mCutoff = cutoff;
+    mSkin = skin;
+    mValid = true;
+    ++mBuildsCount;
+    return true;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "CellList.h"
+#include "State.h"
+#include "ThreadPool.h"
+#include <cstdint>
+#include <span>
+#include <vector>
+
+/// @brief Verlet neighbour lists: for every particle the indices of all particles within
+/// `cutoff + skin` when the lists were built, stored back to back in one CSR array.
+/// Particles move little per step compared to the interaction radii, so the same lists stay
+/// correct for many steps: as long as no particle moved more than skin / 2 since the build,
+/// no pair can have come closer than cutoff without being listed.
+/// A list holds every particle within reach, so lists get long when the radii are large
+/// compared to the world and the particles many.
+class NeighbourList {
+public:
+    /// @brief Forces the next isValid() to fail, e.g. after the particles were reordered.
+    void invalidate() { mValid = false; }
+
+    /// @brief True when the lists were built for the same particles and cutoff and no particle
+    /// moved more than skin / 2 since.
+    bool isValid(const State &state, float cutoff, float skin, float width, float height, ThreadPool &pool, size_t chunkSize);
+
+    /// @brief Rebuilds the lists for all particles, binning them with cellList. Returns false
+    /// without building when the lists would hold more than MaxPairs entries.
+    bool build(const State &state, float cutoff, float skin, float width, float height, ThreadPool &pool, size_t chunkSize,
+               CellList &cellList);
+
+    /// @brief Indices of the particles listed around particle i.
+    std::span<const uint32_t> neighbours(size_t i) const {
+        return {mNeighbours.data() + mOffsets[i], mNeighbours.data() + mOffsets[i + 1]};
+    }
+
+    /// @brief Listed pairs, each counted once per direction.
+    size_t pairsCount() const { return mNeighbours.size(); }
+
+    uint64_t buildsCount() const { return mBuildsCount; }
+
+    /// Entries the lists may hold, 512 MB of indices
+    static constexpr size_t MaxPairs = size_t(1) << 27;
+
+private:
+    /// Start of every particle's list in mNeighbours, one past the end for the last one
+    std::vector<uint32_t> mOffsets;
+    std::vector<uint32_t> mNeighbours;
+    /// Lists of every chunk of particles, built in parallel and concatenated into mNeighbours
+    std::vector<std::vector<uint32_t>> mChunkNeighbours;
+    /// Positions at the last build
+    std::vector<Position> mBuildPositions;
+
+    size_t mCount = 0;
+    uint32_t mNextId = 0;
+    float mCutoff = 0;
+    float mSkin = 0;
+    bool mValid = false;
+    uint64_t mBuildsCount = 0;
+};
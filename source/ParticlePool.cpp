@@ -0,0 +1,115 @@
+#include "ParticlePool.h"
+#include "Physics.h"
+#include <algorithm>
+#include <cmath>
+#include <numbers>
+
+void ParticlePool::reserve(size_t capacity) {
+    mState.colors.reserve(capacity);
+    mState.pos.reserve(capacity);
+    mState.vel.reserve(capacity);
+    mState.ids.reserve(capacity);
+}
+
+uint32_t ParticlePool::spawn(size_t count, const Disc &region, int color, Random &random) {
+    const size_t begin = size();
+    const size_t end = begin + count;
+    if(end > capacity()) {
+        reserve(std::max(end, 2 * capacity()));
+    }
+    mState.colors.resize(end, color);
+    mState.pos.resize(end);
+    mState.vel.resize(end, Velocity{});
+    mState.ids.resize(end);
+
+    const uint32_t firstId = mState.nextId;
+    // Keep the table complete if it was, otherwise the next lookup rebuilds it anyway.
+    const bool extendTable = mIndexOfId.size() == firstId;
+    for(size_t i = begin; i < end; ++i) {
+        // The square root spreads the particles evenly over the area instead of crowding the centre.
+        const float distance = region.radius * std::sqrt(random.uniform());
+        const float angle = random.uniform(0, 2 * std::numbers::pi_v<float>);
+        mState.pos[i] = Position{.x = wrapFloat(region.x + distance * std::cos(angle), mWidth),
+                                 .y = wrapFloat(region.y + distance * std::sin(angle), mHeight)};
+        mState.ids[i] = mState.nextId++;
+        if(extendTable) {
+            mIndexOfId.push_back(static_cast<uint32_t>(i));
+        }
+    }
+    return firstId;
+}
+
+bool ParticlePool::remove(uint32_t id) {
+    const uint32_t index = indexOf(id);
+    if(index == UINT32_MAX) {
+        return false;
+    }
+    removeAt(index);
+    return true;
+}
+
+size_t ParticlePool::erase(const Disc &region) {
+    const float radiusSq = region.radius * region.radius;
+    size_t removed = 0;
+    size_t i = 0;
+    while(i < size()) {
+        const Vec d = wrapDirection(Vec{mState.pos[i].x - region.x, mState.pos[i].y - region.y}, mWidth, mHeight);
+        if(d.x * d.x + d.y * d.y <= radiusSq) {
+            // The last particle takes this slot and is tested next.
+            removeAt(i);
+            ++removed;
+        } else {
+            ++i;
+        }
+    }
+    return removed;
+}
+
+void ParticlePool::clear() {
+    ClearParticles(mState);
+    mIndexOfId.assign(mState.nextId, UINT32_MAX);
+}
+
+uint32_t ParticlePool::indexOf(uint32_t id) {
+    if(id >= mState.nextId) {
+        return UINT32_MAX;
+    }
+    if(id >= mIndexOfId.size()) {
+        rebuildIndexOfId();
+    }
+    const uint32_t index = mIndexOfId[id];
+    if(index == UINT32_MAX || (index < mState.ids.size() && mState.ids[index] == id)) {
+        return index;
+    }
+    // The arrays were reordered or added to since the table was built.
+    rebuildIndexOfId();
+    return mIndexOfId[id];
+}
+
+void ParticlePool::removeAt(size_t index) {
+    const size_t last = size() - 1;
+    const uint32_t id = mState.ids[index];
+    if(index != last) {
+        mState.colors[index] = mState.colors[last];
+        mState.pos[index] = mState.pos[last];
+        mState.vel[index] = mState.vel[last];
+        mState.ids[index] = mState.ids[last];
+        if(mState.ids[index] < mIndexOfId.size()) {
+            mIndexOfId[mState.ids[index]] = static_cast<uint32_t>(index);
+        }
+    }
+    if(id < mIndexOfId.size()) {
+        mIndexOfId[id] = UINT32_MAX;
+    }
+    mState.colors.pop_back();
+    mState.pos.pop_back();
+    mState.vel.pop_back();
+    mState.ids.pop_back();
+}
+
+void ParticlePool::rebuildIndexOfId() {
+    mIndexOfId.assign(mState.nextId, UINT32_MAX);
+    for(size_t i = 0; i < mState.ids.size(); ++i) {
+        mIndexOfId[mState.ids[i]] = static_cast<uint32_t>(i);
+    }
+}
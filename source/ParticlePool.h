@@ -0,0 +1,59 @@
+#pragma once
+
+#include "Random.h"
+#include "State.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/// @brief Disc of the periodic world, e.g. the area under the brush. May cross the edges, its
+/// radius must stay below half the world size.
+struct Disc {
+    float x;
+    float y;
+    float radius;
+};
+
+/// @brief Adds and removes particles of a State in bulk.
+/// spawn() grows every array once for the whole batch instead of once per particle, and
+/// remove() moves the last particle into the freed slot so no array is shifted. Removal changes
+/// indices, so particles are referred to by their stable id; indexOf() looks ids up in a table kept
+/// in step with the pool's own changes and rebuilt when something else reordered the arrays, e.g.
+/// the SpatialSorter.
+class ParticlePool {
+public:
+    ParticlePool(State &state, float width, float height) : mState(state), mWidth(width), mHeight(height) {}
+
+    /// @brief Reserves room for capacity particles in every array.
+    void reserve(size_t capacity);
+    size_t capacity() const { return mState.pos.capacity(); }
+    size_t size() const { return mState.pos.size(); }
+
+    /// @brief Adds count particles of color at rest, spread uniformly over region and wrapped into
+    /// the world. Their ids are consecutive, the first one is returned.
+    uint32_t spawn(size_t count, const Disc &region, int color, Random &random);
+
+    /// @brief Removes the particle with the given id. Returns false if there is none.
+    bool remove(uint32_t id);
+    /// @brief Removes every particle in region. Returns how many were removed.
+    size_t erase(const Disc &region);
+    /// @brief Removes all particles. Ids are not reused.
+    void clear();
+
+    /// @brief Current index of the particle with the given id, or UINT32_MAX if it is gone.
+    uint32_t indexOf(uint32_t id);
+
+    /// @brief Forgets the id table, call it after replacing the whole state.
+    void invalidate() { mIndexOfId.clear(); }
+
+private:
+    void removeAt(size_t index);
+    void rebuildIndexOfId();
+
+    State &mState;
+    float mWidth;
+    float mHeight;
+    /// Index of every id below its size, UINT32_MAX for removed ids. Entries of particles moved
+    /// by someone else are stale and caught by indexOf.
+    std::vector<uint32_t> mIndexOfId;
+};
@@ -0,0 +1,47 @@
+#include "ParticleRenderer.h"
+#include <algorithm>
+
+void ParticleRenderer::render(SDL_Renderer *renderer, SDL_Texture *sprite, const Config &config, std::span<const int> colors,
+                              std::span<const Position> pos, float zoom) {
+    const size_t count = pos.size();
+    if(count == 0) {
+        return;
+    }
+
+    mColors.clear();
+    for(const Rgb &rgb : config.particleColors) {
+        mColors.push_back(SDL_FColor{rgb.r, rgb.g, rgb.b, 1.0f});
+    }
+
+    const float size = static_cast<float>(config.particleSize) * zoom;
+    const float offset = size / 2;
+    const size_t batch = std::min(count, MaxParticlesPerBatch);
+    mVertices.resize(batch * 4);
+    growIndices(batch);
+
+    for(size_t first = 0; first < count; first += batch) {
+        const size_t last = std::min(count, first + batch);
+        SDL_Vertex *vertex = mVertices.data();
+        for(size_t i = first; i < last; ++i) {
+            const float x = pos[i].x - offset;
+            const float y = pos[i].y - offset;
+            const SDL_FColor color = mColors[colors[i]];
+
+            *vertex++ = SDL_Vertex{SDL_FPoint{x, y}, color, SDL_FPoint{0, 0}};
+            *vertex++ = SDL_Vertex{SDL_FPoint{x + size, y}, color, SDL_FPoint{1, 0}};
+            *vertex++ = SDL_Vertex{SDL_FPoint{x + size, y + size}, color, SDL_FPoint{1, 1}};
+            *vertex++ = SDL_Vertex{SDL_FPoint{x, y + size}, color, SDL_FPoint{0, 1}};
+        }
+
+        const int particles = static_cast<int>(last - first);
+        SDL_RenderGeometry(renderer, sprite, mVertices.data(), particles * 4, mIndices.data(), particles * 6);
+    }
+}
+
+void ParticleRenderer::growIndices(size_t particlesCount) {
+    // Two triangles per quad, the pattern only depends on the particle's place in the batch.
+    for(size_t i = mIndices.size() / 6; i < particlesCount; ++i) {
+        const int v = static_cast<int>(i * 4);
+        mIndices.insert(mIndices.end(), {v, v + 1, v + 2, v, v + 2, v + 3});
+    }
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "Config.h"
+#include "State.h"
+#include <span>
+#include <vector>
+
+#include <SDL3/SDL_render.h>
+
+/// @brief Draws all particles with as few SDL_RenderGeometry calls as possible: every particle is
+/// a quad of four vertices carrying its color, so no texture state changes between particles.
+/// The vertex and index buffers are kept between frames and only grow.
+class ParticleRenderer {
+public:
+    /// @brief Draws every particle as a `config.particleSize` wide copy of sprite,
+    /// tinted with the particle's color. A zoom above 1 draws them that much wider.
+    void render(SDL_Renderer *renderer, SDL_Texture *sprite, const Config &config, std::span<const int> colors,
+                std::span<const Position> pos, float zoom = 1);
+
+    void render(SDL_Renderer *renderer, SDL_Texture *sprite, const Config &config, const State &state) {
+        render(renderer, sprite, config, state.colors, state.pos);
+    }
+
+private:
+    /// Particles submitted per SDL_RenderGeometry call, keeps single batches within what
+    /// renderer backends handle comfortably
+    static constexpr size_t MaxParticlesPerBatch = 1 << 16;
+
+    void growIndices(size_t particlesCount);
+
+    std::vector<SDL_Vertex> mVertices;
+    std::vector<int> mIndices;
+    std::vector<SDL_FColor> mColors;
+};
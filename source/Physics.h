@@ -0,0 +1,111 @@
+#pragma once
+
+#include "Config.h"
+#include "Math.h"
+#include "State.h"
+#include "Vec.h"
+
+/// @brief Wraps a direction so it points along the shortest path in the periodic world.
+inline Vec wrapDirection(Vec direction, float width, float height) {
+    if(direction.x > 0.5f * width) {
+        direction.x -= width;
+    } else if(direction.x < -0.5f * width) {
+        direction.x += width;
+    }
+    if(direction.y > 0.5f * height) {
+        direction.y -= height;
+    } else if(direction.y < -0.5f * height) {
+        direction.y += height;
+    }
+    return direction;
+}
+
+/// @brief Computes the force a particle exerts on another one when it is placed at the
+/// (already wrapped) direction from it, interaction being the parameters of their color pair.
+inline Vec pairForce(const Interaction &interaction, Vec direction) {
+    const float distanceSq = direction.x * direction.x + direction.y * direction.y;
+    if(distanceSq >= interaction.radiusSq && distanceSq >= interaction.minDistanceSq) {
+        return Vec{};
+    }
+
+    const float distance = std::sqrt(distanceSq);
+    direction.normalize();
+
+    Vec totalForce;
+    if(distance < interaction.minDistance) {
+        const float factor = interaction.repulsion * (1 - distance * interaction.invMinDistance);
+
+        Vec force = distance != 0 ? direction : randomVec();
+        force.mul(factor);
+        totalForce.add(force);
+    }
+
+    if(distance < interaction.radius) {
+        const float factor = interaction.attraction * (1 - distance * interaction.invRadius);
+
+        Vec force = distance != 0 ? direction : randomVec();
+        force.mul(factor);
+        totalForce.add(force);
+    }
+    return totalForce;
+}
+
+/// @brief Signed force along the unit direction at a distance greater than 0, the same
+/// magnitude pairForce gives.
+inline float forceMagnitude(const Interaction &interaction, float distance) {
+    float magnitude = 0;
+    if(distance < interaction.minDistance) {
+        magnitude += interaction.repulsion * (1 - distance * interaction.invMinDistance);
+    }
+    if(distance < interaction.radius) {
+        magnitude += interaction.attraction * (1 - distance * interaction.invRadius);
+    }
+    return magnitude;
+}
+
+/// @brief Adds the forces two particles i and j exert on each other, direction pointing from
+/// i to j (already wrapped), ij and ji the parameters of (color i, color j) and (color j, color i).
+/// Distance and direction are computed once for both sides.
+inline void addPairForces(const Interaction &ij, const Interaction &ji, Vec direction, Vec &forceOnI, Vec &forceOnJ) {
+    const float distanceSq = direction.x * direction.x + direction.y * direction.y;
+    if(distanceSq >= ij.radiusSq && distanceSq >= ij.minDistanceSq && distanceSq >= ji.radiusSq && distanceSq >= ji.minDistanceSq) {
+        return;
+    }
+    if(distanceSq == 0) {
+        // Coincident particles push each other in independent random directions.
+        forceOnI.add(pairForce(ij, direction));
+        forceOnJ.add(pairForce(ji, direction));
+        return;
+    }
+
+    const float distance = std::sqrt(distanceSq);
+    const float invDistance = 1 / distance;
+    const float onI = forceMagnitude(ij, distance) * invDistance;
+    const float onJ = forceMagnitude(ji, distance) * invDistance;
+    forceOnI.x += direction.x * onI;
+    forceOnI.y += direction.y * onI;
+    forceOnJ.x -= direction.x * onJ;
+    forceOnJ.y -= direction.y * onJ;
+}
+
+/// @brief Wraps a coordinate back into [0, l].
+inline float wrapFloat(float v, float l) {
+    if(v < 0) {
+        return v + l;
+    } else if(v > l) {
+        return v - l;
+    }
+    return v;
+}
+
+/// @brief Applies friction and the accumulated force to the velocity, then moves the particle.
+inline void integrate(const InteractionTable &table, Vec totalForce, Position &pos, Velocity &vel, float width, float height) {
+    totalForce.mul(table.dt);
+    vel.x *= (table.friction);
+    vel.y *= (table.friction);
+    vel.x += totalForce.x;
+    vel.y += totalForce.y;
+
+    pos.x = wrapFloat(pos.x + vel.x, width);
+    pos.y = wrapFloat(pos.y + vel.y, height);
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <cstdint>
+
+/// @brief 8 bit RGBA pixels, red first in memory (SDL_PIXELFORMAT_RGBA32), e.g. a locked
+/// streaming texture.
+struct PixelBuffer {
+    uint8_t *pixels;
+    /// Bytes from the start of one row to the next
+    int pitch;
+    int width;
+    int height;
+};
@@ -0,0 +1,159 @@
+#include "Profiler.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string_view>
+
+namespace {
+
+/// Samples kept per thread, a few seconds of every phase at a few hundred steps and frames a second
+constexpr size_t RingCapacity = 1 << 14;
+
+/// Single writer ring of samples. Slots are atomics so a reader racing the writer reads stale
+/// values instead of undefined behaviour; the written counter tells it which ones to drop.
+struct Ring {
+    struct Slot {
+        std::atomic<const char *> name{nullptr};
+        std::atomic<uint64_t> begin{0};
+        std::atomic<uint64_t> end{0};
+    };
+
+    std::unique_ptr<Slot[]> slots = std::make_unique<Slot[]>(RingCapacity);
+    std::atomic<uint64_t> written{0};
+    uint32_t thread = 0;
+};
+
+std::mutex gRingsMutex;
+/// Rings are never freed, the samples of a thread that exited stay readable
+std::vector<std::unique_ptr<Ring>> gRings;
+
+Ring &ThreadRing() {
+    thread_local Ring *ring = [] {
+        std::lock_guard lock(gRingsMutex);
+        gRings.push_back(std::make_unique<Ring>());
+        gRings.back()->thread = static_cast<uint32_t>(gRings.size() - 1);
+        return gRings.back().get();
+    }();
+    return *ring;
+}
+
+float Percentile(const std::vector<float> &sorted, float p) {
+    const size_t rank = static_cast<size_t>(p * static_cast<float>(sorted.size() - 1) + 0.5f);
+    return sorted[std::min(rank, sorted.size() - 1)];
+}
+
+void WriteJsonString(std::FILE *file, const char *text) {
+    std::fputc('"', file);
+    for(const char *c = text; *c != '\0'; ++c) {
+        if(*c == '"' || *c == '\\') {
+            std::fputc('\\', file);
+        }
+        std::fputc(*c, file);
+    }
+    std::fputc('"', file);
+}
+} // namespace
+
+uint64_t profileNow() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+void profileRecord(const char *name, uint64_t begin, uint64_t end) {
+    Ring &ring = ThreadRing();
+    const uint64_t index = ring.written.load(std::memory_order_relaxed);
+    Ring::Slot &slot = ring.slots[index % RingCapacity];
+    // A collector reading any of the stores below sees the counter of the samples before too.
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.name.store(name, std::memory_order_relaxed);
+    slot.begin.store(begin, std::memory_order_relaxed);
+    slot.end.store(end, std::memory_order_relaxed);
+    ring.written.store(index + 1, std::memory_order_release);
+}
+
+std::vector<ProfileEvent> collectProfileEvents(uint64_t since) {
+    std::vector<ProfileEvent> events;
+    std::lock_guard lock(gRingsMutex);
+    for(const std::unique_ptr<Ring> &ring : gRings) {
+        const uint64_t written = ring->written.load(std::memory_order_acquire);
+        const uint64_t first = written > RingCapacity ? written - RingCapacity : 0;
+        const size_t start = events.size();
+        for(uint64_t index = first; index < written; ++index) {
+            const Ring::Slot &slot = ring->slots[index % RingCapacity];
+            events.push_back(ProfileEvent{slot.name.load(std::memory_order_relaxed), slot.begin.load(std::memory_order_relaxed),
+                                          slot.end.load(std::memory_order_relaxed), ring->thread});
+        }
+
+        // The writer may have overwritten the oldest samples while they were copied, and may be
+        // in the middle of overwriting one more. The fence keeps the slot loads above before the
+        // second look at the counter.
+        std::atomic_thread_fence(std::memory_order_acquire);
+        const uint64_t after = ring->written.load(std::memory_order_relaxed);
+        const uint64_t valid = after >= RingCapacity ? after - RingCapacity + 1 : 0;
+        const size_t dropped = static_cast<size_t>(std::min(written, std::max(valid, first)) - first);
+        events.erase(events.begin() + static_cast<std::ptrdiff_t>(start),
+                     events.begin() + static_cast<std::ptrdiff_t>(start + dropped));
+        events.erase(std::remove_if(events.begin() + static_cast<std::ptrdiff_t>(start), events.end(),
+                                    [&](const ProfileEvent &event) { return event.end < since; }),
+                     events.end());
+    }
+    return events;
+}
+
+std::vector<ProfilePhaseStats> profilePhaseStats(const std::vector<ProfileEvent> &events) {
+    // Equal literals of different translation units can have different addresses.
+    std::map<std::string_view, std::vector<float>> durations;
+    for(const ProfileEvent &event : events) {
+        durations[event.name].push_back(static_cast<float>(event.end - event.begin) * 1e-6f);
+    }
+
+    std::vector<ProfilePhaseStats> stats;
+    for(auto &[name, values] : durations) {
+        std::sort(values.begin(), values.end());
+        stats.push_back(ProfilePhaseStats{name.data(), values.size(), Percentile(values, 0.5f), Percentile(values, 0.95f),
+                                          Percentile(values, 0.99f)});
+    }
+    return stats;
+}
+
+bool writeChromeTrace(const std::string &path, const std::vector<ProfileEvent> &events, std::string &error) {
+    std::FILE *file = std::fopen(path.c_str(), "w");
+    if(file == nullptr) {
+        error = "cannot create " + path + ": " + std::strerror(errno);
+        return false;
+    }
+
+    uint64_t origin = UINT64_MAX;
+    uint32_t threads = 0;
+    for(const ProfileEvent &event : events) {
+        origin = std::min(origin, event.begin);
+        threads = std::max(threads, event.thread + 1);
+    }
+
+    std::fputs("{\"displayTimeUnit\": \"ms\", \"traceEvents\": [", file);
+    bool first = true;
+    for(uint32_t thread = 0; thread < threads; ++thread) {
+        std::fprintf(file, "%s\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %u, \"args\": {\"name\": \"thread %u\"}}",
+                     first ? "" : ",", thread, thread);
+        first = false;
+    }
+    for(const ProfileEvent &event : events) {
+        std::fputs(first ? "\n{\"name\": " : ",\n{\"name\": ", file);
+        first = false;
+        WriteJsonString(file, event.name);
+        std::fprintf(file, ", \"ph\": \"X\", \"pid\": 1, \"tid\": %u, \"ts\": %.3f, \"dur\": %.3f}", event.thread,
+                     static_cast<double>(event.begin - origin) * 1e-3, static_cast<double>(event.end - event.begin) * 1e-3);
+    }
+    std::fputs("\n]}\n", file);
+
+    if(std::fclose(file) != 0) {
+        error = "cannot write " + path + ": " + std::strerror(errno);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/// @brief Scoped timers for the hot paths of the app and the engine.
+///
+/// PROFILE_SCOPE("Force pass") times the rest of the enclosing scope. Every thread writes its
+/// samples into its own ring buffer without locks; a reader collects the recent samples of all
+/// threads for statistics or a Chrome trace. Names must be string literals, only the pointer is
+/// stored. Built without PARTICLES_PROFILER the macro expands to nothing.
+#if PARTICLES_PROFILER
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+#else
+#define PROFILE_SCOPE(name)
+#endif
+
+/// @brief Nanoseconds on the steady clock.
+uint64_t profileNow();
+
+/// @brief Stores a sample in the calling thread's ring, overwriting its oldest sample when full.
+void profileRecord(const char *name, uint64_t begin, uint64_t end);
+
+class ProfileScope {
+public:
+    explicit ProfileScope(const char *name) : mName(name), mBegin(profileNow()) {}
+    ~ProfileScope() { profileRecord(mName, mBegin, profileNow()); }
+
+    ProfileScope(const ProfileScope &) = delete;
+    ProfileScope &operator=(const ProfileScope &) = delete;
+
+private:
+    const char *mName;
+    uint64_t mBegin;
+};
+
+struct ProfileEvent {
+    const char *name;
+    uint64_t begin;
+    uint64_t end;
+    /// Order in which the thread recorded its first sample, 0 for the first thread
+    uint32_t thread;
+};
+
+/// @brief Samples of every thread that ended at or after since, oldest first per thread. Samples
+/// overwritten while they were read are left out.
+std::vector<ProfileEvent> collectProfileEvents(uint64_t since);
+
+struct ProfilePhaseStats {
+    const char *name;
+    size_t count;
+    /// Durations in milliseconds
+    float p50;
+    float p95;
+    float p99;
+};
+
+/// @brief Duration percentiles of every name in events, sorted by name.
+std::vector<ProfilePhaseStats> profilePhaseStats(const std::vector<ProfileEvent> &events);
+
+/// @brief Writes events as a Chrome trace_event JSON file, open it in chrome://tracing or Perfetto.
+/// Returns false and sets error on failure.
+bool writeChromeTrace(const std::string &path, const std::vector<ProfileEvent> &events, std::string &error);
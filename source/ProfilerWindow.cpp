@@ -0,0 +1,83 @@
+#include "ProfilerWindow.h"
+#include <algorithm>
+#include <cstdio>
+#include <imgui.h>
+
+namespace {
+
+uint64_t Nanoseconds(float seconds) {
+    return static_cast<uint64_t>(static_cast<double>(seconds) * 1e9);
+}
+} // namespace
+
+void ProfilerWindow::frame() {
+    const uint64_t now = profileNow();
+    if(mLastFrame != 0) {
+        mFrameTimes[mFrameTimesOffset] = static_cast<float>(now - mLastFrame) * 1e-6f;
+        mFrameTimesOffset = (mFrameTimesOffset + 1) % FrameTimesCount;
+    }
+    mLastFrame = now;
+}
+
+void ProfilerWindow::render() {
+    float average = 0;
+    float worst = 0;
+    for(const float time : mFrameTimes) {
+        average += time;
+        worst = std::max(worst, time);
+    }
+    average /= FrameTimesCount;
+
+    char overlay[64];
+    snprintf(overlay, sizeof(overlay), "avg %.2f ms, max %.2f ms", average, worst);
+    ImGui::PlotLines("frame ms", mFrameTimes.data(), static_cast<int>(FrameTimesCount), static_cast<int>(mFrameTimesOffset), overlay, 0.0f,
+                     std::max(worst, 1.0f), ImVec2(0, 60));
+
+#if PARTICLES_PROFILER
+    const uint64_t now = profileNow();
+    if(now - mLastStats >= Nanoseconds(StatsPeriod)) {
+        mStats = profilePhaseStats(collectProfileEvents(now - Nanoseconds(StatsWindow)));
+        mLastStats = now;
+    }
+
+    if(ImGui::BeginTable("phases", 5, ImGuiTableFlags_RowBg | ImGuiTableFlags_BordersInnerV)) {
+        ImGui::TableSetupColumn("phase");
+        ImGui::TableSetupColumn("count");
+        ImGui::TableSetupColumn("p50 ms");
+        ImGui::TableSetupColumn("p95 ms");
+        ImGui::TableSetupColumn("p99 ms");
+        ImGui::TableHeadersRow();
+        for(const ProfilePhaseStats &phase : mStats) {
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(phase.name);
+            ImGui::TableNextColumn();
+            ImGui::Text("%zu", phase.count);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", phase.p50);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", phase.p95);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", phase.p99);
+        }
+        ImGui::EndTable();
+    }
+    ImGui::TextDisabled("P: dump the last 5 s as a Chrome trace");
+#else
+    ImGui::TextDisabled("Built without PARTICLES_PROFILER, phases are not timed");
+#endif
+
+    if(!mStatus.empty()) {
+        ImGui::TextUnformatted(mStatus.c_str());
+    }
+}
+
+void ProfilerWindow::dumpTrace(const std::string &path, float seconds) {
+    const std::vector<ProfileEvent> events = collectProfileEvents(profileNow() - Nanoseconds(seconds));
+    std::string error;
+    if(writeChromeTrace(path, events, error)) {
+        mStatus = "Wrote " + std::to_string(events.size()) + " events to " + path;
+    } else {
+        mStatus = error;
+    }
+}
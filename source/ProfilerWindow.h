@@ -0,0 +1,37 @@
+#pragma once
+
+#include "Profiler.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/// @brief ImGui panel of the profiler: a rolling graph of the frame times and the p50, p95 and
+/// p99 durations of every profiled phase over the last few seconds.
+class ProfilerWindow {
+public:
+    /// @brief Call once per frame, measures the time since the previous call.
+    void frame();
+
+    /// @brief Draws the panel into the current ImGui window.
+    void render();
+
+    /// @brief Writes the samples of the last `seconds` of every thread to path as a Chrome trace.
+    void dumpTrace(const std::string &path, float seconds = 5);
+
+private:
+    static constexpr size_t FrameTimesCount = 240;
+    /// Phases are summarized over this many seconds, every StatsPeriod seconds
+    static constexpr float StatsWindow = 2;
+    static constexpr float StatsPeriod = 0.5f;
+
+    std::array<float, FrameTimesCount> mFrameTimes{};
+    size_t mFrameTimesOffset = 0;
+    uint64_t mLastFrame = 0;
+
+    std::vector<ProfilePhaseStats> mStats;
+    uint64_t mLastStats = 0;
+    /// Result of the last dump, shown under the table
+    std::string mStatus;
+};
@@ -0,0 +1,129 @@
+#include "QuadTree.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <numeric>
+
+namespace {
+
+struct Interval {
+    float from;
+    float to;
+};
+
+/// @brief Splits [from, to] into at most two intervals inside the periodic range [0, length].
+int SplitPeriodic(float from, float to, float length, Interval (&out)[2]) {
+    if(to - from >= length) {
+        out[0] = {0, length};
+        return 1;
+    }
+    if(from < 0) {
+        out[0] = {from + length, length};
+        out[1] = {0, to};
+        return 2;
+    }
+    if(to > length) {
+        out[0] = {from, length};
+        out[1] = {0, to - length};
+        return 2;
+    }
+    out[0] = {from, to};
+    return 1;
+}
+} // namespace
+
+void QuadTree::build(const std::vector<Position> &pos, float width, float height) {
+    PROFILE_SCOPE("Index build: quadtree");
+    mPos = &pos;
+    mWidth = width;
+    mHeight = height;
+
+    mIndices.resize(pos.size());
+    std::iota(mIndices.begin(), mIndices.end(), 0u);
+
+    mNodes.clear();
+    mNodes.push_back(Node{.boundry = Boundry{0, 0, width, height}, .first = 0, .count = static_cast<uint32_t>(pos.size())});
+
+    mStack.clear();
+    mStack.emplace_back(0, 0);
+    while(!mStack.empty()) {
+        const auto [nodeIndex, depth] = mStack.back();
+        mStack.pop_back();
+
+        const Node node = mNodes[nodeIndex];
+        if(node.count <= mCapacity || depth >= mMaxDepth) {
+            continue;
+        }
+
+        const float hw = node.boundry.width / 2;
+        const float hh = node.boundry.height / 2;
+        const float midX = node.boundry.x + hw;
+        const float midY = node.boundry.y + hh;
+
+        // Partition the node's range into north/south and then each half into west/east.
+        const auto begin = mIndices.begin() + node.first;
+        const auto end = begin + node.count;
+        const auto south = std::partition(begin, end, [&](uint32_t i) { return pos[i].y < midY; });
+        const auto northEast = std::partition(begin, south, [&](uint32_t i) { return pos[i].x < midX; });
+        const auto southEast = std::partition(south, end, [&](uint32_t i) { return pos[i].x < midX; });
+
+        const auto offset = [&](auto it) { return static_cast<uint32_t>(it - mIndices.begin()); };
+        const uint32_t bounds[5] = {node.first, offset(northEast), offset(south), offset(southEast), node.first + node.count};
+        const Boundry quadrants[4] = {
+            Boundry{node.boundry.x, node.boundry.y, hw, hh},
+            Boundry{midX, node.boundry.y, hw, hh},
+            Boundry{node.boundry.x, midY, hw, hh},
+            Boundry{midX, midY, hw, hh},
+        };
+
+        const uint32_t children = static_cast<uint32_t>(mNodes.size());
+        mNodes[nodeIndex].children = children;
+        for(int q = 0; q < 4; ++q) {
+            mNodes.push_back(Node{.boundry = quadrants[q], .first = bounds[q], .count = bounds[q + 1] - bounds[q]});
+            mStack.emplace_back(children + q, depth + 1);
+        }
+    }
+}
+
+void QuadTree::query(const Boundry &boundry, std::vector<uint32_t> &found) const {
+    if(mNodes.empty()) {
+        return;
+    }
+
+    Interval xs[2];
+    Interval ys[2];
+    const int xsCount = SplitPeriodic(boundry.x, boundry.x + boundry.width, mWidth, xs);
+    const int ysCount = SplitPeriodic(boundry.y, boundry.y + boundry.height, mHeight, ys);
+    for(int y = 0; y < ysCount; ++y) {
+        for(int x = 0; x < xsCount; ++x) {
+            queryPiece(Boundry{xs[x].from, ys[y].from, xs[x].to - xs[x].from, ys[y].to - ys[y].from}, found);
+        }
+    }
+}
+
+void QuadTree::queryPiece(const Boundry &boundry, std::vector<uint32_t> &found) const {
+    const std::vector<Position> &pos = *mPos;
+
+    uint32_t stack[3 * MaxDepth + 4];
+    int top = 0;
+    stack[top++] = 0;
+    while(top > 0) {
+        const Node &node = mNodes[stack[--top]];
+        if(!Overlaps(node.boundry, boundry)) {
+            continue;
+        }
+
+        if(node.children != 0) {
+            for(uint32_t q = 0; q < 4; ++q) {
+                stack[top++] = node.children + q;
+            }
+            continue;
+        }
+
+        for(uint32_t k = node.first; k < node.first + node.count; ++k) {
+            const uint32_t i = mIndices[k];
+            if(Contains(boundry, pos[i])) {
+                found.push_back(i);
+            }
+        }
+    }
+}
@@ -1,8 +1,10 @@
 #pragma once
 #include "State.h"
-#include <memory>
+#include <algorithm>
+#include <cstdint>
 #include <vector>
 
+/// @brief Axis aligned rectangle described by its top left corner and size.
 struct Boundry
 {
     float x;
@@ -10,93 +12,60 @@ struct Boundry
     float width;
     float height;
 };
-bool Contains(const Boundry &b, const Position &p)
+
+inline bool Contains(const Boundry &b, const Position &p)
 {
     return p.x >= b.x && p.y >= b.y &&
-           p.x < b.x + b.width && p.y < b.y + b.height;
+           p.x <= b.x + b.width && p.y <= b.y + b.height;
 }
-bool Overlaps(const Boundry &lhs, const Boundry &rhs)
+
+inline bool Overlaps(const Boundry &lhs, const Boundry &rhs)
 {
-    return false;
+    return lhs.x <= rhs.x + rhs.width && rhs.x <= lhs.x + lhs.width &&
+           lhs.y <= rhs.y + rhs.height && rhs.y <= lhs.y + lhs.height;
 }
 
+/// @brief Point quadtree over the periodic world, stored as one contiguous node array.
+/// Every node owns a range of a single index array, so building is a sequence of in-place
+/// partitions and a query returns particle indices. The arrays are reused between builds.
 class QuadTree
 {
 public:
-    QuadTree(Boundry boundry, size_t capacity) : mBoundry(std::move(boundry)), mCapacity(capacity)
-    {
-    }
+    /// Deepest level a node can be split to, also bounds the traversal stack
+    static constexpr int MaxDepth = 48;
 
-    void insert(Position point)
+    explicit QuadTree(size_t capacity = 16, int maxDepth = 16) : mCapacity(capacity), mMaxDepth(std::min(maxDepth, MaxDepth))
     {
-        if (!Contains(mBoundry, point))
-        {
-            return;
-        }
-
-        if (mPoints.size() < mCapacity)
-        {
-            mPoints.emplace_back(std::move(point));
-        }
-        else
-        {
-            if (!mDivided)
-            {
-                subdivide();
-            }
-
-            mNorthEast->insert(point);
-            mNorthWest->insert(point);
-            mSouthEast->insert(point);
-            mSouthWest->insert(point);
-        }
     }
 
-    void query(const Boundry &boundry, std::vector<Position> &found)
-    {
-        if (!Overlaps(mBoundry, boundry))
-        {
-            return;
-        }
+    /// @brief Rebuilds the tree over all positions in a width x height world.
+    void build(const std::vector<Position> &pos, float width, float height);
 
-        for (const Position& p: mPoints) {
-            if (Contains(boundry, p)) {
-                found.push_back(p);
-            }
-        }
+    /// @brief Appends to found the index of every particle inside the rectangle. The rectangle
+    /// may extend past the edges of the world, it then wraps around to the opposite side.
+    void query(const Boundry &boundry, std::vector<uint32_t> &found) const;
 
-        if (mDivided)
-        {
-            mNorthEast->query(boundry, found);
-            mNorthWest->query(boundry, found);
-            mSouthEast->query(boundry, found);
-            mSouthWest->query(boundry, found);
-        }
-    }
+    size_t nodesCount() const { return mNodes.size(); }
 
 private:
-    void subdivide()
+    struct Node
     {
-        const float x = mBoundry.x;
-        const float y = mBoundry.y;
-        const float hw = mBoundry.width / 2;
-        const float hh = mBoundry.height / 2;
+        Boundry boundry;
+        uint32_t first = 0;
+        uint32_t count = 0;
+        /// Index of the first of four consecutive children, 0 for leaves (the root is never a child)
+        uint32_t children = 0;
+    };
 
-        mNorthEast = std::make_unique<QuadTree>(Boundry{x + hw, y - hh, hw, hh}, mCapacity);
-        mNorthWest = std::make_unique<QuadTree>(Boundry{x - hw, y - hh, hw, hh}, mCapacity);
-        mSouthEast = std::make_unique<QuadTree>(Boundry{x + hw, y + hh, hw, hh}, mCapacity);
-        mSouthWest = std::make_unique<QuadTree>(Boundry{x - hw, y + hh, hw, hh}, mCapacity);
+    void queryPiece(const Boundry &boundry, std::vector<uint32_t> &found) const;
 
-        mDivided = true;
-    }
-
-    Boundry mBoundry;
-    std::vector<Position> mPoints;
     size_t mCapacity;
-    bool mDivided = false;
+    int mMaxDepth;
+    float mWidth = 0;
+    float mHeight = 0;
+    const std::vector<Position> *mPos = nullptr;
 
-    std::unique_ptr<QuadTree> mNorthWest;
-    std::unique_ptr<QuadTree> mNorthEast;
-    std::unique_ptr<QuadTree> mSouthWest;
-    std::unique_ptr<QuadTree> mSouthEast;
-};
\ No newline at end of file
+    std::vector<Node> mNodes;
+    std::vector<uint32_t> mIndices;
+    std::vector<std::pair<uint32_t, int>> mStack;
+};
@@ -0,0 +1,55 @@
+#include "Random.h"
+#include <atomic>
+#include <random>
+
+namespace {
+
+uint64_t SplitMix(uint64_t &state) {
+    uint64_t z = (state += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+uint64_t DeviceSeed() {
+    std::random_device device;
+    return (static_cast<uint64_t>(device()) << 32) | device();
+}
+
+std::atomic<uint64_t> gSeed = DeviceSeed();
+/// Stream of the next thread that draws for the first time, 0 belongs to the thread that seeded
+std::atomic<uint64_t> gNextStream = 1;
+
+struct ThreadRandom {
+    Random random{gSeed.load(std::memory_order_relaxed), gNextStream.fetch_add(1, std::memory_order_relaxed)};
+};
+
+thread_local ThreadRandom tThreadRandom;
+} // namespace
+
+void Random::reseed(uint64_t seed, uint64_t stream) {
+    // Mixing the stream through SplitMix before the seed keeps nearby (seed, stream) pairs apart.
+    uint64_t state = seed ^ SplitMix(stream);
+    const uint64_t a = SplitMix(state);
+    const uint64_t b = SplitMix(state);
+    mS[0] = static_cast<uint32_t>(a);
+    mS[1] = static_cast<uint32_t>(a >> 32);
+    mS[2] = static_cast<uint32_t>(b);
+    mS[3] = static_cast<uint32_t>(b >> 32);
+    if((mS[0] | mS[1] | mS[2] | mS[3]) == 0) {
+        mS[0] = 1;
+    }
+}
+
+void setRandomSeed(uint64_t seed) {
+    gSeed.store(seed, std::memory_order_relaxed);
+    tThreadRandom.random.reseed(seed, 0);
+}
+
+uint64_t randomSeed() {
+    return gSeed.load(std::memory_order_relaxed);
+}
+
+Random &threadRandom() {
+    return tThreadRandom.random;
+}
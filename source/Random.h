@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+
+/// @brief xoshiro128+ generator. Small (16 bytes), fast and good enough for the float draws of the
+/// simulation. A (seed, stream) pair always gives the same sequence, so independent streams can be
+/// handed to chunks of a parallel loop and the result does not depend on which thread runs them.
+class Random {
+public:
+    explicit Random(uint64_t seed = 0, uint64_t stream = 0) { reseed(seed, stream); }
+
+    void reseed(uint64_t seed, uint64_t stream = 0);
+
+    uint32_t next() {
+        const uint32_t result = mS[0] + mS[3];
+        const uint32_t t = mS[1] << 9;
+        mS[2] ^= mS[0];
+        mS[3] ^= mS[1];
+        mS[1] ^= mS[2];
+        mS[0] ^= mS[3];
+        mS[2] ^= t;
+        mS[3] = (mS[3] << 11) | (mS[3] >> 21);
+        return result;
+    }
+
+    uint64_t next64() { return (static_cast<uint64_t>(next()) << 32) | next(); }
+
+    /// @brief Uniform float in [0, 1).
+    float uniform() { return static_cast<float>(next() >> 8) * 0x1p-24f; }
+
+    /// @brief Uniform float in [min, max).
+    float uniform(float min, float max) { return min + (max - min) * uniform(); }
+
+    /// @brief Uniform integer in [0, n), n > 0.
+    uint32_t below(uint32_t n) { return static_cast<uint32_t>((static_cast<uint64_t>(next()) * n) >> 32); }
+
+private:
+    uint32_t mS[4];
+};
+
+/// @brief Seeds every generator handed out by threadRandom from now on and reseeds the calling
+/// thread's one. Until it is called the seed is picked from std::random_device once per process.
+void setRandomSeed(uint64_t seed);
+uint64_t randomSeed();
+
+/// @brief The calling thread's generator. The first use on a thread seeds it with randomSeed() and
+/// a stream number unique to the thread; setRandomSeed gives the calling thread stream 0, so draws
+/// made on one thread after seeding are reproducible.
+Random &threadRandom();
+
+/// @brief Replaces the calling thread's generator with the (seed, stream) one until the scope ends.
+/// Parallel loops open one per chunk so every draw depends on the chunk and not on the thread.
+class RandomStreamScope {
+public:
+    RandomStreamScope(uint64_t seed, uint64_t stream) : mSaved(threadRandom()) { threadRandom().reseed(seed, stream); }
+    ~RandomStreamScope() { threadRandom() = mSaved; }
+
+    RandomStreamScope(const RandomStreamScope &) = delete;
+    RandomStreamScope &operator=(const RandomStreamScope &) = delete;
+
+private:
+    Random mSaved;
+};
@@ -0,0 +1,202 @@
+#include "SharedState.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr size_t RoundUp(size_t size, size_t alignment) {
+    return (size + alignment - 1) / alignment * alignment;
+}
+
+constexpr size_t SlotsOffset = RoundUp(sizeof(SharedStateHeader), 64);
+
+size_t SlotSize(size_t capacity) {
+    return RoundUp(sizeof(SharedSlotHeader) + capacity * (sizeof(Position) + sizeof(Velocity) + sizeof(int32_t)), 64);
+}
+
+/// Particle arrays of a slot, positions first
+struct SlotArrays {
+    std::byte *pos;
+    std::byte *vel;
+    std::byte *colors;
+};
+
+SlotArrays Arrays(std::byte *slot, size_t capacity) {
+    std::byte *pos = slot + sizeof(SharedSlotHeader);
+    std::byte *vel = pos + capacity * sizeof(Position);
+    return SlotArrays{pos, vel, vel + capacity * sizeof(Velocity)};
+}
+} // namespace
+
+StatePublisher::~StatePublisher() {
+    close();
+}
+
+bool StatePublisher::open(const std::string &name, size_t capacity, int width, int height, std::string &error, uint32_t slotsCount) {
+    close();
+    if(slotsCount < 2) {
+        error = "a shared state ring needs at least two slots";
+        return false;
+    }
+
+    // A publisher that crashed left its object behind, readers still mapping it keep their copy.
+    shm_unlink(name.c_str());
+    const int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if(fd < 0) {
+        error = "cannot create shared memory " + name + ": " + std::strerror(errno);
+        return false;
+    }
+    const size_t slotSize = SlotSize(capacity);
+    const size_t size = SlotsOffset + slotsCount * slotSize;
+    void *memory = MAP_FAILED;
+    if(ftruncate(fd, static_cast<off_t>(size)) == 0) {
+        memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    const int mapError = errno;
+    ::close(fd);
+    if(memory == MAP_FAILED) {
+        shm_unlink(name.c_str());
+        error = "cannot map shared memory " + name + ": " + std::strerror(mapError);
+        return false;
+    }
+
+    // The new object is zero filled, the atomics start out at 0.
+    auto *header = static_cast<SharedStateHeader *>(memory);
+    header->version = SharedStateVersion;
+    header->slotsCount = slotsCount;
+    header->capacity = capacity;
+    header->slotSize = slotSize;
+    header->width = width;
+    header->height = height;
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(header->magic, SharedStateMagic, sizeof(SharedStateMagic));
+
+    mName = name;
+    mHeader = header;
+    mSize = size;
+    mPublished = 0;
+    mDropped = 0;
+    return true;
+}
+
+void StatePublisher::close() {
+    if(mHeader == nullptr) {
+        return;
+    }
+    mHeader->closed.store(1, std::memory_order_release);
+    munmap(mHeader, mSize);
+    shm_unlink(mName.c_str());
+    mHeader = nullptr;
+    mSize = 0;
+}
+
+bool StatePublisher::publish(const State &state, uint64_t step, uint64_t configHash) {
+    const size_t count = state.pos.size();
+    if(count > mHeader->capacity) {
+        ++mDropped;
+        return false;
+    }
+
+    const uint64_t frame = mPublished;
+    auto *slotBytes = reinterpret_cast<std::byte *>(mHeader) + SlotsOffset + frame % mHeader->slotsCount * mHeader->slotSize;
+    auto &slot = *reinterpret_cast<SharedSlotHeader *>(slotBytes);
+    const uint64_t sequence = slot.sequence.load(std::memory_order_relaxed);
+    slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+    // Readers seeing any of the writes below see the odd sequence too.
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot.frame.store(frame, std::memory_order_relaxed);
+    slot.step.store(step, std::memory_order_relaxed);
+    slot.count.store(count, std::memory_order_relaxed);
+    slot.configHash.store(configHash, std::memory_order_relaxed);
+    const SlotArrays arrays = Arrays(slotBytes, mHeader->capacity);
+    std::memcpy(arrays.pos, state.pos.data(), count * sizeof(Position));
+    std::memcpy(arrays.vel, state.vel.data(), count * sizeof(Velocity));
+    std::memcpy(arrays.colors, state.colors.data(), count * sizeof(int32_t));
+
+    slot.sequence.store(sequence + 2, std::memory_order_release);
+    mHeader->published.store(++mPublished, std::memory_order_release);
+    return true;
+}
+
+SharedStateReader::~SharedStateReader() {
+    close();
+}
+
+bool SharedStateReader::open(const std::string &name, std::string &error) {
+    close();
+    const int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if(fd < 0) {
+        error = "cannot open shared memory " + name + ": " + std::strerror(errno);
+        return false;
+    }
+    struct stat info {};
+    void *memory = MAP_FAILED;
+    if(fstat(fd, &info) == 0 && static_cast<size_t>(info.st_size) >= SlotsOffset) {
+        memory = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+    if(memory == MAP_FAILED) {
+        error = "cannot map shared memory " + name;
+        return false;
+    }
+
+    const auto *header = static_cast<const SharedStateHeader *>(memory);
+    const size_t size = static_cast<size_t>(info.st_size);
+    const bool ready = std::memcmp(header->magic, SharedStateMagic, sizeof(SharedStateMagic)) == 0;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if(!ready || header->version != SharedStateVersion || header->slotsCount == 0 ||
+       header->slotSize < SlotSize(header->capacity) || SlotsOffset + header->slotsCount * header->slotSize > size) {
+        munmap(memory, size);
+        error = name + " is not a shared state stream of version " + std::to_string(SharedStateVersion);
+        return false;
+    }
+    mHeader = header;
+    mSize = size;
+    return true;
+}
+
+void SharedStateReader::close() {
+    if(mHeader == nullptr) {
+        return;
+    }
+    munmap(const_cast<SharedStateHeader *>(mHeader), mSize);
+    mHeader = nullptr;
+    mSize = 0;
+}
+
+bool SharedStateReader::read(uint64_t frame, Frame &out) const {
+    if(frame >= published()) {
+        return false;
+    }
+    const auto *slotBytes = reinterpret_cast<const std::byte *>(mHeader) + SlotsOffset + frame % mHeader->slotsCount * mHeader->slotSize;
+    const auto &slot = *reinterpret_cast<const SharedSlotHeader *>(slotBytes);
+    const uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+    if(sequence % 2 != 0 || slot.frame.load(std::memory_order_relaxed) != frame) {
+        return false;
+    }
+
+    // A torn count stays within the slot, valid() tells it apart.
+    const size_t count = std::min<uint64_t>(slot.count.load(std::memory_order_relaxed), mHeader->capacity);
+    const SlotArrays arrays = Arrays(const_cast<std::byte *>(slotBytes), mHeader->capacity);
+    out.frame = frame;
+    out.step = slot.step.load(std::memory_order_relaxed);
+    out.configHash = slot.configHash.load(std::memory_order_relaxed);
+    out.pos = std::span(reinterpret_cast<const Position *>(arrays.pos), count);
+    out.vel = std::span(reinterpret_cast<const Velocity *>(arrays.vel), count);
+    out.colors = std::span(reinterpret_cast<const int32_t *>(arrays.colors), count);
+    out.mSlot = &slot;
+    out.mSequence = sequence;
+    return valid(out);
+}
+
+bool SharedStateReader::valid(const Frame &frame) const {
+    // Orders the reads of the frame before the second look at the sequence.
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return frame.mSlot != nullptr && frame.mSlot->sequence.load(std::memory_order_relaxed) == frame.mSequence;
+}
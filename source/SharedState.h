@@ -0,0 +1,136 @@
+#pragma once
+
+#include "State.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+
+/// @brief Shared memory layout of a live state stream.
+///
+/// A SharedStateHeader, then slotsCount slots of slotSize bytes. Frame f, the f-th published step,
+/// is written to slot f % slotsCount: a SharedSlotHeader followed by the particles' positions,
+/// velocities and colors as three arrays of capacity entries, in the publisher's particle order.
+/// Every slot is guarded by a seqlock: its sequence is odd while the publisher writes it, readers
+/// read the slot in place and only trust what they read when the sequence is even and did not
+/// change meanwhile. The publisher never waits for readers, a reader slower than slotsCount steps
+/// loses frames.
+constexpr char SharedStateMagic[8] = {'P', 'A', 'R', 'T', 'L', 'I', 'V', 'E'};
+constexpr uint32_t SharedStateVersion = 1;
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "the shared state needs lock free 64 bit atomics");
+static_assert(sizeof(int) == sizeof(int32_t), "colors are shared as 32 bit integers");
+
+struct SharedStateHeader {
+    /// Written last when the publisher opens the stream
+    char magic[8];
+    uint32_t version;
+    uint32_t slotsCount;
+    /// Particles one slot holds, and bytes from one slot to the next
+    uint64_t capacity;
+    uint64_t slotSize;
+    int32_t width;
+    int32_t height;
+    /// Frames published so far, the newest complete one is published - 1
+    alignas(64) std::atomic<uint64_t> published;
+    /// Set when the publisher closes the stream, no frame follows
+    std::atomic<uint32_t> closed;
+};
+
+struct SharedSlotHeader {
+    alignas(64) std::atomic<uint64_t> sequence;
+    std::atomic<uint64_t> frame;
+    std::atomic<uint64_t> step;
+    std::atomic<uint64_t> count;
+    /// configHash() of the config the step ran with
+    std::atomic<uint64_t> configHash;
+};
+
+/// @brief Publishes every step's particles into a POSIX shared memory ring other processes read
+/// from. publish() copies the three arrays into the next slot and returns, it never waits for a
+/// reader.
+class StatePublisher {
+public:
+    StatePublisher() = default;
+    ~StatePublisher();
+
+    StatePublisher(const StatePublisher &) = delete;
+    StatePublisher &operator=(const StatePublisher &) = delete;
+
+    /// @brief Creates the shared memory object name (e.g. "/particles"), replacing a stale one
+    /// left by a publisher that did not close it, with slotsCount slots of capacity particles.
+    /// Returns false and sets error on failure.
+    bool open(const std::string &name, size_t capacity, int width, int height, std::string &error, uint32_t slotsCount = 4);
+    /// @brief Tells the readers the stream ended and removes the name. Attached readers keep
+    /// their mapping until they close it.
+    void close();
+    bool isOpen() const { return mHeader != nullptr; }
+
+    /// @brief Writes the particles of state as the frame of the given step. Returns false when
+    /// the frame was dropped because it has more particles than a slot holds.
+    bool publish(const State &state, uint64_t step, uint64_t configHash);
+
+    uint64_t framesPublished() const { return mPublished; }
+    uint64_t framesDropped() const { return mDropped; }
+
+private:
+    std::string mName;
+    SharedStateHeader *mHeader = nullptr;
+    size_t mSize = 0;
+    uint64_t mPublished = 0;
+    uint64_t mDropped = 0;
+};
+
+/// @brief Read only view of a stream published by a StatePublisher. Frames are read in place,
+/// nothing is copied and the publisher does not know the reader is there.
+class SharedStateReader {
+public:
+    /// @brief One published frame. The arrays point into the shared memory and may be rewritten
+    /// by the publisher while they are read: anything computed from them only holds when valid()
+    /// still returns true afterwards.
+    struct Frame {
+        uint64_t frame = 0;
+        uint64_t step = 0;
+        uint64_t configHash = 0;
+        std::span<const Position> pos;
+        std::span<const Velocity> vel;
+        std::span<const int32_t> colors;
+
+    private:
+        friend class SharedStateReader;
+        const SharedSlotHeader *mSlot = nullptr;
+        uint64_t mSequence = 0;
+    };
+
+    SharedStateReader() = default;
+    ~SharedStateReader();
+
+    SharedStateReader(const SharedStateReader &) = delete;
+    SharedStateReader &operator=(const SharedStateReader &) = delete;
+
+    /// @brief Maps the stream name read only. Fails while the publisher is still creating it.
+    /// Returns false and sets error on failure.
+    bool open(const std::string &name, std::string &error);
+    void close();
+    bool isOpen() const { return mHeader != nullptr; }
+
+    int width() const { return mHeader->width; }
+    int height() const { return mHeader->height; }
+    uint32_t slotsCount() const { return mHeader->slotsCount; }
+
+    /// @brief Frames published so far.
+    uint64_t published() const { return mHeader->published.load(std::memory_order_acquire); }
+    /// @brief Whether the publisher closed the stream. Frames published before stay readable.
+    bool closed() const { return mHeader->closed.load(std::memory_order_acquire) != 0; }
+
+    /// @brief Starts reading frame. Returns false when it was not published yet, was already
+    /// overwritten, or is being overwritten right now.
+    bool read(uint64_t frame, Frame &out) const;
+    /// @brief Whether the frame's slot was left alone since read() returned it.
+    bool valid(const Frame &frame) const;
+
+private:
+    const SharedStateHeader *mHeader = nullptr;
+    size_t mSize = 0;
+};
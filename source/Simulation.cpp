@@ -0,0 +1,228 @@
+#include "Simulation.h"
+#include "ConfigFunctions.h"
+#include "Physics.h"
+#include "Profiler.h"
+#include "WorldFile.h"
+#include <algorithm>
+#include <cstdio>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+template <typename... Fs>
+struct Overloaded : Fs... {
+    using Fs::operator()...;
+};
+
+/// Turbo steps run between two checks for commands and stop requests
+constexpr int TurboBatch = 8;
+
+/// Fraction of the step period elapsed since the snapshot was published, 1 when there is nothing
+/// to interpolate
+float InterpolationAlpha(const Snapshot &snapshot, Clock::time_point now) {
+    if(snapshot.stepPeriod.count() <= 0) {
+        return 1;
+    }
+    return std::clamp(std::chrono::duration<float>(now - snapshot.time) / snapshot.stepPeriod, 0.0f, 1.0f);
+}
+
+Position Interpolate(Position from, Position to, float alpha, float width, float height) {
+    const Vec move = wrapDirection(Vec{to.x - from.x, to.y - from.y}, width, height);
+    return Position{wrapFloat(from.x + alpha * move.x, width), wrapFloat(from.y + alpha * move.y, height)};
+}
+
+} // namespace
+
+void interpolatePositions(const Snapshot &snapshot, float width, float height, Clock::time_point now, std::vector<Position> &out) {
+    out.resize(snapshot.pos.size());
+
+    const float alpha = InterpolationAlpha(snapshot, now);
+    const size_t interpolated = alpha < 1 ? std::min(snapshot.previous.size(), snapshot.pos.size()) : 0;
+    for(size_t i = 0; i < interpolated; ++i) {
+        out[i] = Interpolate(snapshot.previous[i], snapshot.pos[i], alpha, width, height);
+    }
+    std::copy(snapshot.pos.begin() + interpolated, snapshot.pos.end(), out.begin() + interpolated);
+}
+
+void interpolatePositions(const Snapshot &snapshot, float width, float height, Clock::time_point now, std::span<const uint32_t> indices,
+                          std::vector<Position> &out) {
+    out.resize(indices.size());
+
+    const float alpha = InterpolationAlpha(snapshot, now);
+    const size_t interpolated = alpha < 1 ? std::min(snapshot.previous.size(), snapshot.pos.size()) : 0;
+    for(size_t k = 0; k < indices.size(); ++k) {
+        const uint32_t i = indices[k];
+        out[k] = i < interpolated ? Interpolate(snapshot.previous[i], snapshot.pos[i], alpha, width, height) : snapshot.pos[i];
+    }
+}
+
+Simulation::Simulation(Engine &engine)
+    : mEngine(engine), mPool(engine.state(), engine.width(), engine.height()) {}
+
+Simulation::~Simulation() {
+    stop();
+}
+
+void Simulation::start() {
+    if(mThread.joinable()) {
+        return;
+    }
+    // The render loop can draw before the thread finished its first step.
+    publish(Clock::duration{});
+    mThread = std::jthread([this](std::stop_token stop) { run(stop); });
+}
+
+void Simulation::stop() {
+    if(!mThread.joinable()) {
+        return;
+    }
+    mThread.request_stop();
+    mThread.join();
+    mRecorder.close();
+    mRecording = false;
+}
+
+bool Simulation::push(Command &&command) {
+    return mCommands.push(std::move(command));
+}
+
+const Snapshot &Simulation::snapshot() {
+    mSnapshots.update();
+    return mSnapshots.front();
+}
+
+void Simulation::run(std::stop_token stop) {
+    Clock::time_point lastTick = Clock::now();
+    Clock::time_point lastMeasurement = lastTick;
+    uint64_t measuredSteps = mSteps;
+    Clock::duration accumulator{};
+
+    while(!stop.stop_requested()) {
+        const float stepRate = std::max(MinStepRate, mStepRate.load());
+        const Clock::duration period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<float>(1 / stepRate));
+
+        if(mTurbo) {
+            for(int i = 0; i < TurboBatch; ++i) {
+                drainCommands();
+                step();
+                if(!mSnapshots.pending()) {
+                    publish(Clock::duration{});
+                }
+            }
+            lastTick = Clock::now();
+            accumulator = {};
+        } else {
+            const Clock::time_point now = Clock::now();
+            accumulator += now - lastTick;
+            lastTick = now;
+
+            const int maxSteps = std::max(1, mMaxCatchUpSteps.load());
+            int steps = 0;
+            while(accumulator >= period && steps < maxSteps) {
+                drainCommands();
+                step();
+                accumulator -= period;
+                ++steps;
+            }
+            if(steps == maxSteps) {
+                // Too far behind, the backlog is dropped rather than chased.
+                accumulator = std::min(accumulator, period);
+            }
+            if(steps > 0) {
+                publish(period);
+            }
+            std::this_thread::sleep_until(lastTick + (period - accumulator));
+        }
+
+        const Clock::time_point now = Clock::now();
+        const std::chrono::duration<float> sinceMeasurement = now - lastMeasurement;
+        if(sinceMeasurement.count() >= 1.0f) {
+            mStepsPerSecond = (mSteps - measuredSteps) / sinceMeasurement.count();
+            lastMeasurement = now;
+            measuredSteps = mSteps;
+        }
+    }
+}
+
+void Simulation::drainCommands() {
+    PROFILE_SCOPE("Commands");
+    Config &config = mEngine.config();
+    State &state = mEngine.state();
+
+    Command command;
+    while(mCommands.pop(command)) {
+        std::visit(Overloaded{
+                       [&](AddParticleCommand &add) { AddParticle(state, add.x, add.y, add.color); },
+                       [&](ClearParticlesCommand &) { mPool.clear(); },
+                       [&](SpawnParticlesCommand &spawn) { mPool.spawn(spawn.count, spawn.region, spawn.color, threadRandom()); },
+                       [&](EraseParticlesCommand &erase) { mPool.erase(erase.region); },
+                       [&](SetConfigCommand &set) {
+                           config = std::move(set.config);
+                           invalidateInteractions(config);
+                       },
+                       [&](SaveWorldCommand &save) {
+                           std::string error;
+                           if(saveWorld(save.path, config, state, mEngine.width(), mEngine.height(), error)) {
+                               printf("Saved %zu particles to %s\n", state.pos.size(), save.path.c_str());
+                           } else {
+                               fprintf(stderr, "Could not save the world: %s\n", error.c_str());
+                           }
+                       },
+                       [&](SetWorldCommand &set) {
+                           config = std::move(set.config);
+                           state = std::move(set.state);
+                           mPool.invalidate();
+                           invalidateInteractions(config);
+                       },
+                       [&](StartRecordingCommand &start) {
+                           std::string error;
+                           if(mRecorder.open(start.path, mEngine.width(), mEngine.height(), error)) {
+                               printf("Recording to %s\n", start.path.c_str());
+                           } else {
+                               fprintf(stderr, "Could not record: %s\n", error.c_str());
+                           }
+                           mRecording = mRecorder.isOpen();
+                       },
+                       [&](StopRecordingCommand &) {
+                           if(mRecorder.isOpen()) {
+                               mRecorder.close();
+                               printf("Recorded %llu frames, %llu dropped\n", static_cast<unsigned long long>(mRecorder.framesWritten()),
+                                      static_cast<unsigned long long>(mRecorder.framesDropped()));
+                           }
+                           mRecording = false;
+                       },
+                   },
+                   command);
+    }
+}
+
+void Simulation::step() {
+    if(mEngine.sleepSettings().enabled != mSleeping) {
+        SleepSettings settings = mEngine.sleepSettings();
+        settings.enabled = mSleeping;
+        mEngine.setSleepSettings(settings);
+    }
+    mEngine.step();
+    mAwakeFraction = mEngine.lastStepStats().awakeFraction();
+    ++mSteps;
+    if(mRecorder.isOpen()) {
+        PROFILE_SCOPE("Record trajectory");
+        mRecorder.record(mEngine.state(), mSteps);
+    }
+}
+
+void Simulation::publish(Clock::duration stepPeriod) {
+    PROFILE_SCOPE("Publish");
+    const State &state = mEngine.state();
+    const std::vector<Position> &previous = mEngine.previousPositions();
+
+    Snapshot &snapshot = mSnapshots.back();
+    snapshot.colors.assign(state.colors.begin(), state.colors.end());
+    snapshot.pos.assign(state.pos.begin(), state.pos.end());
+    snapshot.previous.assign(previous.begin(), previous.begin() + std::min(previous.size(), state.pos.size()));
+    snapshot.step = mSteps;
+    snapshot.time = Clock::now();
+    snapshot.stepPeriod = stepPeriod;
+    mSnapshots.publish();
+}
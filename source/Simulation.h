@@ -0,0 +1,175 @@
+#pragma once
+
+#include "Config.h"
+#include "Engine.h"
+#include "ParticlePool.h"
+#include "SpscQueue.h"
+#include "State.h"
+#include "Trajectory.h"
+#include "TripleBuffer.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <thread>
+#include <variant>
+#include <vector>
+
+struct AddParticleCommand {
+    float x;
+    float y;
+    int color;
+};
+
+struct ClearParticlesCommand {};
+
+/// @brief Adds count particles of one color spread over a disc, see ParticlePool::spawn.
+struct SpawnParticlesCommand {
+    Disc region;
+    uint32_t count;
+    int color;
+};
+
+/// @brief Removes every particle in a disc.
+struct EraseParticlesCommand {
+    Disc region;
+};
+
+/// @brief Replaces the whole simulation config, e.g. after an edit in the UI or a new random config.
+struct SetConfigCommand {
+    Config config;
+};
+
+/// @brief Writes the current config and state to a world file, see saveWorld.
+struct SaveWorldCommand {
+    std::string path;
+};
+
+/// @brief Replaces the config and all particles, e.g. with a world loaded from a file.
+struct SetWorldCommand {
+    Config config;
+    State state;
+};
+
+/// @brief Starts recording every step to a trajectory file, see TrajectoryRecorder.
+struct StartRecordingCommand {
+    std::string path;
+};
+
+struct StopRecordingCommand {};
+
+/// @brief Change requested by the UI thread, applied by the simulation thread between two steps.
+using Command = std::variant<AddParticleCommand, ClearParticlesCommand, SpawnParticlesCommand, EraseParticlesCommand, SetConfigCommand,
+                             SaveWorldCommand, SetWorldCommand, StartRecordingCommand, StopRecordingCommand>;
+
+/// @brief What the render loop needs of a finished step.
+struct Snapshot {
+    std::vector<int> colors;
+    std::vector<Position> pos;
+    /// Positions one step earlier, index for index with pos. Shorter than pos for particles
+    /// added right before the step.
+    std::vector<Position> previous;
+    /// Steps done by the simulation when the snapshot was taken
+    uint64_t step = 0;
+    /// When the snapshot was published and how long until the next step is due; 0 when the
+    /// simulation does not run at a fixed rate and there is nothing to interpolate
+    std::chrono::steady_clock::time_point time;
+    std::chrono::steady_clock::duration stepPeriod{};
+};
+
+/// @brief Positions to draw at `now`: the snapshot's previous positions moved towards the
+/// current ones by the fraction of the step period elapsed since it was published. Particles
+/// crossing the world's edge move along the short way around.
+void interpolatePositions(const Snapshot &snapshot, float width, float height, std::chrono::steady_clock::time_point now,
+                          std::vector<Position> &out);
+
+/// @brief Same as above for the particles with the given indices only, out[k] is where particle
+/// indices[k] is drawn.
+void interpolatePositions(const Snapshot &snapshot, float width, float height, std::chrono::steady_clock::time_point now,
+                          std::span<const uint32_t> indices, std::vector<Position> &out);
+
+/// @brief Runs an Engine on its own thread. Commands are queued by the UI thread and drained
+/// before every step; finished steps are published as a Snapshot the render loop picks up
+/// without waiting on the simulation.
+/// Steps are paced by a fixed timestep: elapsed wall time is accumulated and consumed in whole
+/// steps of 1 / stepRate seconds, so the simulated time per second does not depend on the
+/// frame rate or the machine. When the machine falls behind at most maxCatchUpSteps are run
+/// back to back and the remaining backlog is dropped, the simulation slows down instead of
+/// spiralling. In turbo mode steps run back to back and a snapshot is only published when the
+/// render loop picked up the previous one.
+/// Once started, the engine together with its Config and State belongs to the simulation
+/// thread and must only be changed through push().
+class Simulation {
+public:
+    explicit Simulation(Engine &engine);
+    ~Simulation();
+
+    Simulation(const Simulation &) = delete;
+    Simulation &operator=(const Simulation &) = delete;
+
+    void start();
+    /// @brief Finishes the current step and joins the thread, then closes the trajectory being
+    /// recorded. Queued commands are dropped.
+    void stop();
+
+    /// @brief Queues a command for the next step boundary. Returns false when the queue is full.
+    bool push(Command &&command);
+
+    /// @brief The latest finished step, valid until the next call. Render thread only.
+    const Snapshot &snapshot();
+
+    /// @brief Simulation steps per second of wall time, rates below MinStepRate run at MinStepRate.
+    void setStepRate(float stepsPerSecond) { mStepRate = stepsPerSecond; }
+    float stepRate() const { return mStepRate; }
+
+    /// @brief Most steps run back to back to catch up with the wall clock.
+    void setMaxCatchUpSteps(int steps) { mMaxCatchUpSteps = steps; }
+    int maxCatchUpSteps() const { return mMaxCatchUpSteps; }
+
+    /// @brief Runs steps as fast as possible, for fast-forwarding.
+    void setTurbo(bool turbo) { mTurbo = turbo; }
+    bool turbo() const { return mTurbo; }
+
+    /// @brief Steps per second measured over the last second.
+    float stepsPerSecond() const { return mStepsPerSecond; }
+
+    /// @brief Lets still particles fall asleep, see SleepSettings. Applied before the next step.
+    void setSleeping(bool sleeping) { mSleeping = sleeping; }
+    bool sleeping() const { return mSleeping; }
+    /// @brief Fraction of the particles whose force the last step computed.
+    float awakeFraction() const { return mAwakeFraction; }
+
+    /// @brief A trajectory is being recorded.
+    bool recording() const { return mRecording; }
+
+private:
+    static constexpr size_t CommandsCapacity = 4096;
+    /// Slowest step rate, a zero rate would make the step period infinite
+    static constexpr float MinStepRate = 1.0f;
+
+    void run(std::stop_token stop);
+    void drainCommands();
+    void step();
+    void publish(std::chrono::steady_clock::duration stepPeriod);
+
+    Engine &mEngine;
+    /// Adds and removes the engine's particles for the spawn and erase commands
+    ParticlePool mPool;
+    uint64_t mSteps = 0;
+
+    SpscQueue<Command, CommandsCapacity> mCommands;
+    TripleBuffer<Snapshot> mSnapshots;
+
+    std::atomic<float> mStepRate = 60;
+    std::atomic<int> mMaxCatchUpSteps = 4;
+    std::atomic<bool> mTurbo = false;
+    std::atomic<float> mStepsPerSecond = 0;
+    std::atomic<bool> mSleeping = false;
+    std::atomic<float> mAwakeFraction = 1;
+    std::atomic<bool> mRecording = false;
+
+    TrajectoryRecorder mRecorder;
+
+    std::jthread mThread;
+};
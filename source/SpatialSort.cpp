@@ -0,0 +1,149 @@
+#include "SpatialSort.h"
+#include <algorithm>
+#include <array>
+
+namespace {
+
+/// @brief Spreads the low 16 bits of v to the even bits of the result.
+uint32_t SpreadBits(uint32_t v) {
+    v &= 0xffff;
+    v = (v | (v << 8)) & 0x00ff00ff;
+    v = (v | (v << 4)) & 0x0f0f0f0f;
+    v = (v | (v << 2)) & 0x33333333;
+    v = (v | (v << 1)) & 0x55555555;
+    return v;
+}
+
+/// @brief Z-order index of a position quantized to 16 bits per axis.
+uint32_t MortonKey(const Position &p, float scaleX, float scaleY) {
+    const uint32_t x = static_cast<uint32_t>(std::clamp(p.x * scaleX, 0.0f, 65535.0f));
+    const uint32_t y = static_cast<uint32_t>(std::clamp(p.y * scaleY, 0.0f, 65535.0f));
+    return SpreadBits(x) | (SpreadBits(y) << 1);
+}
+
+/// @brief Reorders values through scratch, which is left holding the old order's storage so the
+/// next sort does not allocate.
+template <typename T>
+void Permute(std::vector<T> &values, const std::vector<uint32_t> &permutation, std::vector<T> &scratch) {
+    scratch.resize(permutation.size());
+    for(size_t i = 0; i < permutation.size(); ++i) {
+        scratch[i] = values[permutation[i]];
+    }
+    values.swap(scratch);
+}
+} // namespace
+
+bool SpatialSorter::update(State &state, float width, float height) {
+    ++mStepsSinceSort;
+
+    bool due = mSettings.interval > 0 && mStepsSinceSort >= mSettings.interval;
+    if(!due && mSettings.checkInterval > 0 && mStepsSinceSort % mSettings.checkInterval == 0) {
+        due = disorder(state, width, height) > mSettings.disorderThreshold;
+    }
+    if(!due) {
+        return false;
+    }
+
+    sort(state, width, height);
+    return true;
+}
+
+void SpatialSorter::sort(State &state, float width, float height) {
+    mStepsSinceSort = 0;
+    ++mSortsCount;
+
+    const size_t count = state.pos.size();
+    const float scaleX = 65535.0f / width;
+    const float scaleY = 65535.0f / height;
+
+    mKeys.resize(count);
+    mPermutation.resize(count);
+    mScratchKeys.resize(count);
+    mScratchPermutation.resize(count);
+    for(size_t i = 0; i < count; ++i) {
+        mKeys[i] = MortonKey(state.pos[i], scaleX, scaleY);
+        mPermutation[i] = static_cast<uint32_t>(i);
+    }
+
+    // LSD radix sort, one byte of the key per pass. Being stable, equal keys keep their order.
+    for(int shift = 0; shift < 32; shift += 8) {
+        std::array<uint32_t, 257> offsets{};
+        for(size_t i = 0; i < count; ++i) {
+            ++offsets[((mKeys[i] >> shift) & 0xff) + 1];
+        }
+        for(size_t b = 0; b < 256; ++b) {
+            offsets[b + 1] += offsets[b];
+        }
+        for(size_t i = 0; i < count; ++i) {
+            const uint32_t slot = offsets[(mKeys[i] >> shift) & 0xff]++;
+            mScratchKeys[slot] = mKeys[i];
+            mScratchPermutation[slot] = mPermutation[i];
+        }
+        mKeys.swap(mScratchKeys);
+        mPermutation.swap(mScratchPermutation);
+    }
+
+    Permute(state.colors, mPermutation, mScratchColors);
+    Permute(state.pos, mPermutation, mScratchPositions);
+    Permute(state.vel, mPermutation, mScratchVelocities);
+    // The engine steps states without ids, which have nothing to follow the particles.
+    if(state.ids.size() == count) {
+        Permute(state.ids, mPermutation, mScratchIds);
+    }
+
+    rebuildIndexOfId(state);
+}
+
+float SpatialSorter::disorder(const State &state, float width, float height) const {
+    constexpr size_t Samples = 4096;
+
+    const size_t count = state.pos.size();
+    if(count < 2) {
+        return 0;
+    }
+
+    const float scaleX = 65535.0f / width;
+    const float scaleY = 65535.0f / height;
+    const size_t stride = std::max<size_t>(1, (count - 1) / Samples);
+
+    size_t samples = 0;
+    size_t descents = 0;
+    for(size_t i = 0; i + 1 < count; i += stride) {
+        ++samples;
+        if(MortonKey(state.pos[i + 1], scaleX, scaleY) < MortonKey(state.pos[i], scaleX, scaleY)) {
+            ++descents;
+        }
+    }
+    return static_cast<float>(descents) / samples;
+}
+
+uint32_t SpatialSorter::indexOf(const State &state, uint32_t id) {
+    const auto lookup = [&]() -> uint32_t {
+        if(id < mIndexOfId.size()) {
+            const uint32_t index = mIndexOfId[id];
+            if(index < state.ids.size() && state.ids[index] == id) {
+                return index;
+            }
+        }
+        return UINT32_MAX;
+    };
+
+    uint32_t index = lookup();
+    if(index == UINT32_MAX && (mIndexedCount != state.ids.size() || mIndexedNextId != state.nextId)) {
+        // Particles were added or removed since the table was built.
+        rebuildIndexOfId(state);
+        index = lookup();
+    }
+    return index;
+}
+
+void SpatialSorter::rebuildIndexOfId(const State &state) {
+    mIndexedCount = state.ids.size();
+    mIndexedNextId = state.nextId;
+    mIndexOfId.assign(state.nextId, UINT32_MAX);
+    for(size_t i = 0; i < state.ids.size(); ++i) {
+        if(state.ids[i] < state.nextId) {
+            mIndexOfId[state.ids[i]] = static_cast<uint32_t>(i);
+        }
+    }
+}
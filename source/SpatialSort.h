@@ -0,0 +1,62 @@
+#pragma once
+
+#include "State.h"
+#include <cstdint>
+#include <vector>
+
+/// @brief Keeps particles that are close in space close in memory by reordering all State
+/// arrays along a Z-order (Morton) curve. Runs every `interval` steps, or earlier when the
+/// sampled disorder of the arrays crosses `disorderThreshold`.
+class SpatialSorter {
+public:
+    struct Settings {
+        /// Steps between two sorts, 0 disables the periodic sort
+        int interval = 120;
+        /// Steps between two disorder measurements
+        int checkInterval = 10;
+        /// Fraction of sampled neighbours in memory that are out of curve order, 0 when sorted
+        /// and about 0.5 for random order
+        float disorderThreshold = 0.2f;
+    };
+
+    SpatialSorter() = default;
+    explicit SpatialSorter(Settings settings) : mSettings(settings) {}
+
+    /// @brief Called once per step, sorts the state when it is due. Returns true if it sorted.
+    bool update(State &state, float width, float height);
+
+    /// @brief Reorders colors, pos, vel and ids of the state along the curve. The ids are left
+    /// alone when there are not as many as particles.
+    void sort(State &state, float width, float height);
+
+    /// @brief Estimates how far the arrays are from curve order from a sample of adjacent pairs.
+    float disorder(const State &state, float width, float height) const;
+
+    /// @brief Current index of the particle with the given stable id, or UINT32_MAX if it is gone.
+    uint32_t indexOf(const State &state, uint32_t id);
+
+    /// @brief For every index after the last sort, the index the particle had before it.
+    const std::vector<uint32_t> &permutation() const { return mPermutation; }
+
+    int sortsCount() const { return mSortsCount; }
+
+private:
+    void rebuildIndexOfId(const State &state);
+
+    Settings mSettings;
+    int mStepsSinceSort = 0;
+    int mSortsCount = 0;
+
+    std::vector<uint32_t> mKeys;
+    std::vector<uint32_t> mPermutation;
+    std::vector<uint32_t> mScratchKeys;
+    std::vector<uint32_t> mScratchPermutation;
+    /// Storage the state arrays are permuted into, swapped with them
+    std::vector<int> mScratchColors;
+    std::vector<Position> mScratchPositions;
+    std::vector<Velocity> mScratchVelocities;
+    std::vector<uint32_t> mScratchIds;
+    std::vector<uint32_t> mIndexOfId;
+    size_t mIndexedCount = 0;
+    uint32_t mIndexedNextId = 0;
+};
@@ -0,0 +1,171 @@
+#include "SplatRasterizer.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+constexpr uint8_t Black[4] = {0, 0, 0, 255};
+
+uint8_t ToByte(float channel) {
+    return static_cast<uint8_t>(std::clamp(channel, 0.0f, 1.0f) * 255);
+}
+
+/// Bands [first, last] a disc of the given radius centred at y touches
+void BandRange(float y, float radius, int bandsCount, int bandHeight, int &first, int &last) {
+    first = std::clamp(static_cast<int>(std::floor((y - radius) / bandHeight)), 0, bandsCount - 1);
+    last = std::clamp(static_cast<int>(std::floor((y + radius) / bandHeight)), 0, bandsCount - 1);
+}
+
+/// Blends color over pixel with coverage in [0, 256], two channels at a time. Both are RGBA
+/// words with an alpha of 255, which stays 255.
+uint32_t Blend(uint32_t pixel, uint32_t color, uint32_t coverage) {
+    const uint32_t rb = ((color & 0x00ff00ff) * coverage + (pixel & 0x00ff00ff) * (256 - coverage)) >> 8;
+    const uint32_t ga = (((color >> 8) & 0x00ff00ff) * coverage + ((pixel >> 8) & 0x00ff00ff) * (256 - coverage)) >> 8;
+    return (rb & 0x00ff00ff) | ((ga & 0x00ff00ff) << 8);
+}
+
+/// Draws the part of a stamp placed at (x0, y0) within rows [rowBegin, rowEnd), clipped to the target
+void DrawStamp(const PixelBuffer &target, int rowBegin, int rowEnd, int x0, int y0, const uint16_t *stamp, const uint8_t *spans,
+               int size, uint32_t color) {
+    const int j0 = std::max(0, rowBegin - y0);
+    const int j1 = std::min(size, rowEnd - y0);
+    for(int j = j0; j < j1; ++j) {
+        const int i0 = std::max<int>(spans[2 * j], -x0);
+        const int i1 = std::min<int>(spans[2 * j + 1], target.width - x0);
+        uint32_t *row = reinterpret_cast<uint32_t *>(target.pixels + static_cast<size_t>(y0 + j) * target.pitch) + x0;
+        const uint16_t *coverage = stamp + j * size;
+        for(int i = i0; i < i1; ++i) {
+            row[i] = coverage[i] == 256 ? color : Blend(row[i], color, coverage[i]);
+        }
+    }
+}
+} // namespace
+
+SplatRasterizer::SplatRasterizer(size_t threadsCount) : mThreadPool(threadsCount) {}
+
+void SplatRasterizer::render(const PixelBuffer &target, const Config &config, std::span<const int> colors, std::span<const Position> pos) {
+    if(target.width <= 0 || target.height <= 0) {
+        return;
+    }
+
+    mPalette.clear();
+    for(const Rgb &rgb : config.particleColors) {
+        const uint8_t color[4] = {ToByte(rgb.r), ToByte(rgb.g), ToByte(rgb.b), 255};
+        uint32_t word = 0;
+        std::memcpy(&word, color, 4);
+        mPalette.push_back(word);
+    }
+    uint32_t black = 0;
+    std::memcpy(&black, Black, 4);
+
+    const float radius = config.particleSize / 2.0f;
+    const float outer = radius + 0.5f;
+    if(radius != mStampRadius) {
+        buildStamps(radius);
+    }
+    const size_t count = pos.size();
+    const int bandsCount = (target.height + BandHeight - 1) / BandHeight;
+    const size_t bands = static_cast<size_t>(bandsCount);
+    const size_t chunks = (count + BinChunkSize - 1) / BinChunkSize;
+
+    // Count the particles of every band per chunk, then lay the bands out one after the other
+    // with the chunks of a band in order, so a band lists its particles in drawing order.
+    mCounts.assign(chunks * bands, 0);
+    mThreadPool.parallelFor(count, BinChunkSize, [&](size_t begin, size_t end) {
+        uint32_t *counts = mCounts.data() + begin / BinChunkSize * bands;
+        for(size_t i = begin; i < end; ++i) {
+            int first = 0;
+            int last = 0;
+            BandRange(pos[i].y, outer, bandsCount, BandHeight, first, last);
+            for(int band = first; band <= last; ++band) {
+                ++counts[band];
+            }
+        }
+    });
+
+    mBandStarts.resize(bands + 1);
+    uint32_t offset = 0;
+    for(size_t band = 0; band < bands; ++band) {
+        mBandStarts[band] = offset;
+        for(size_t chunk = 0; chunk < chunks; ++chunk) {
+            const uint32_t n = mCounts[chunk * bands + band];
+            mCounts[chunk * bands + band] = offset;
+            offset += n;
+        }
+    }
+    mBandStarts[bands] = offset;
+    mBinned.resize(offset);
+
+    mThreadPool.parallelFor(count, BinChunkSize, [&](size_t begin, size_t end) {
+        uint32_t *next = mCounts.data() + begin / BinChunkSize * bands;
+        for(size_t i = begin; i < end; ++i) {
+            int first = 0;
+            int last = 0;
+            BandRange(pos[i].y, outer, bandsCount, BandHeight, first, last);
+            const Splat splat{pos[i].x - outer, pos[i].y - outer, mPalette[colors[i]]};
+            for(int band = first; band <= last; ++band) {
+                mBinned[next[band]++] = splat;
+            }
+        }
+    });
+
+    mThreadPool.parallelFor(bands, 1, [&](size_t begin, size_t end) {
+        for(size_t band = begin; band < end; ++band) {
+            const int rowBegin = static_cast<int>(band) * BandHeight;
+            const int rowEnd = std::min(rowBegin + BandHeight, target.height);
+            for(int y = rowBegin; y < rowEnd; ++y) {
+                uint32_t *row = reinterpret_cast<uint32_t *>(target.pixels + static_cast<size_t>(y) * target.pitch);
+                std::fill_n(row, target.width, black);
+            }
+            for(uint32_t k = mBandStarts[band]; k < mBandStarts[band + 1]; ++k) {
+                const Splat &splat = mBinned[k];
+                const float left = splat.left;
+                const float top = splat.top;
+                const int x0 = static_cast<int>(std::floor(left));
+                const int y0 = static_cast<int>(std::floor(top));
+                const int sx = std::min(static_cast<int>((left - x0) * StampSteps), StampSteps - 1);
+                const int sy = std::min(static_cast<int>((top - y0) * StampSteps), StampSteps - 1);
+                const size_t index = static_cast<size_t>(sy * StampSteps + sx);
+                DrawStamp(target, rowBegin, rowEnd, x0, y0, mStamps.data() + index * mStampSize * mStampSize,
+                          mStampSpans.data() + index * 2 * mStampSize, mStampSize, splat.color);
+            }
+        }
+    });
+}
+
+void SplatRasterizer::buildStamps(float radius) {
+    // The coverage of a pixel is the part of a one pixel wide ramp across the edge its centre falls on.
+    const float outer = radius + 0.5f;
+    const float inner = std::max(radius - 0.5f, 0.0f);
+    mStampRadius = radius;
+    mStampSize = static_cast<int>(std::ceil(2 * outer)) + 1;
+    const size_t area = static_cast<size_t>(mStampSize) * mStampSize;
+    mStamps.resize(StampSteps * StampSteps * area);
+    mStampSpans.resize(StampSteps * StampSteps * 2 * mStampSize);
+    for(int sy = 0; sy < StampSteps; ++sy) {
+        for(int sx = 0; sx < StampSteps; ++sx) {
+            // Centre of the disc relative to the stamp's corner, in the middle of the sub-pixel step
+            const float cx = outer + (sx + 0.5f) / StampSteps;
+            const float cy = outer + (sy + 0.5f) / StampSteps;
+            const size_t index = static_cast<size_t>(sy * StampSteps + sx);
+            uint16_t *stamp = mStamps.data() + index * area;
+            uint8_t *spans = mStampSpans.data() + index * 2 * mStampSize;
+            for(int j = 0; j < mStampSize; ++j) {
+                int begin = mStampSize;
+                int end = 0;
+                for(int i = 0; i < mStampSize; ++i) {
+                    const float distance = std::hypot(i + 0.5f - cx, j + 0.5f - cy);
+                    const float coverage = distance <= inner ? 1 : std::clamp(outer - distance, 0.0f, 1.0f);
+                    stamp[j * mStampSize + i] = static_cast<uint16_t>(coverage * 256);
+                    if(stamp[j * mStampSize + i] != 0) {
+                        begin = std::min(begin, i);
+                        end = i + 1;
+                    }
+                }
+                spans[2 * j] = static_cast<uint8_t>(std::min(begin, end));
+                spans[2 * j + 1] = static_cast<uint8_t>(end);
+            }
+        }
+    }
+}
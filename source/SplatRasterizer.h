@@ -0,0 +1,62 @@
+#pragma once
+
+#include "Config.h"
+#include "PixelBuffer.h"
+#include "State.h"
+#include "ThreadPool.h"
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <thread>
+#include <vector>
+
+/// @brief Draws particles on the CPU straight into a pixel buffer, one pixel per world unit.
+/// The image is cut into horizontal bands and every particle is binned into the bands its disc
+/// touches, so each thread owns whole bands and no two threads write the same pixel. The cost
+/// is one pass over the particles plus the covered pixels, no sprite or GPU is involved.
+class SplatRasterizer {
+public:
+    explicit SplatRasterizer(size_t threadsCount = std::thread::hardware_concurrency());
+
+    /// @brief Clears target to black and draws every particle as an anti-aliased disc
+    /// `config.particleSize` pixels wide in its color. Later particles cover earlier ones, as
+    /// with the sprites.
+    void render(const PixelBuffer &target, const Config &config, std::span<const int> colors, std::span<const Position> pos);
+
+    size_t threadsCount() const { return mThreadPool.threadsCount(); }
+
+private:
+    /// Rows of a band, the unit of work of a thread
+    static constexpr int BandHeight = 16;
+    /// Particles binned by one task
+    static constexpr size_t BinChunkSize = 1 << 14;
+    /// Sub-pixel positions of the disc per axis that get their own stamp
+    static constexpr int StampSteps = 8;
+
+    /// What the bands need of a particle, copied so they read it in order
+    struct Splat {
+        /// Top left corner of the disc's bounding box
+        float left;
+        float top;
+        uint32_t color;
+    };
+
+    /// Precomputes the coverage of a disc of the given radius at every sub-pixel position
+    void buildStamps(float radius);
+
+    ThreadPool mThreadPool;
+    /// RGBA word of every color
+    std::vector<uint32_t> mPalette;
+    /// StampSteps x StampSteps stamps of mStampSize x mStampSize coverages in [0, 256]
+    std::vector<uint16_t> mStamps;
+    /// Columns [begin, end) of every stamp row with a coverage above 0
+    std::vector<uint8_t> mStampSpans;
+    int mStampSize = 0;
+    float mStampRadius = -1;
+    /// Particles of every (chunk, band), then where they go in mBinned
+    std::vector<uint32_t> mCounts;
+    /// First binned particle of every band, and the end of the last one
+    std::vector<uint32_t> mBandStarts;
+    /// Particles grouped by band, in drawing order within a band
+    std::vector<Splat> mBinned;
+};
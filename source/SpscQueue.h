@@ -0,0 +1,45 @@
+#pragma once
+
+#include "Aligned.h"
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+/// @brief Bounded lock-free queue between exactly one producer thread and one consumer thread.
+/// Capacity has to be a power of two; one slot is kept free to tell a full queue from an empty one.
+template <typename T, size_t Capacity>
+class SpscQueue {
+    static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    /// @brief Producer side. Returns false and leaves value untouched when the queue is full.
+    bool push(T &&value) {
+        const size_t tail = mTail.load(std::memory_order_relaxed);
+        const size_t next = (tail + 1) & Mask;
+        if(next == mHead.load(std::memory_order_acquire)) {
+            return false;
+        }
+        mSlots[tail] = std::move(value);
+        mTail.store(next, std::memory_order_release);
+        return true;
+    }
+
+    /// @brief Consumer side. Returns false when the queue is empty.
+    bool pop(T &value) {
+        const size_t head = mHead.load(std::memory_order_relaxed);
+        if(head == mTail.load(std::memory_order_acquire)) {
+            return false;
+        }
+        value = std::move(mSlots[head]);
+        mHead.store((head + 1) & Mask, std::memory_order_release);
+        return true;
+    }
+
+private:
+    static constexpr size_t Mask = Capacity - 1;
+
+    std::array<T, Capacity> mSlots{};
+    alignas(CacheLine) std::atomic<size_t> mHead = 0;
+    alignas(CacheLine) std::atomic<size_t> mTail = 0;
+};
@@ -1,5 +1,6 @@
 #pragma once
 #include "Vec.h"
+#include <cstdint>
 #include <vector>
 
 struct Position {
@@ -17,6 +18,9 @@ struct State
 	std::vector<int> colors;
 	std::vector<Position> pos;
 	std::vector<Velocity> vel;
+	/// Stable id of every particle, follows the particle when the arrays are reordered
+	std::vector<uint32_t> ids;
+	uint32_t nextId = 0;
 };
 
 
@@ -24,4 +28,26 @@ inline void AddParticle(State& state, const float x, const float y, const int c)
 	state.pos.push_back(Position{.x = x, .y = y});
 	state.vel.push_back(Velocity{});
 	state.colors.push_back(c);
-}
\ No newline at end of file
+	state.ids.push_back(state.nextId++);
+}
+
+/// @brief Removes all particles. Ids are not reused.
+inline void ClearParticles(State& state) {
+	state.colors.clear();
+	state.pos.clear();
+	state.vel.clear();
+	state.ids.clear();
+}
+
+/// @brief Sizes the back buffer so a step can write the new positions and velocities into it.
+/// Colors never change during a step, so only the front buffer holds them.
+inline void prepareBackBuffer(const State& front, State& back) {
+	back.pos.resize(front.pos.size());
+	back.vel.resize(front.vel.size());
+}
+
+/// @brief Makes the back buffer written by a step the new front buffer.
+inline void swapBuffers(State& front, State& back) {
+	front.pos.swap(back.pos);
+	front.vel.swap(back.vel);
+}
@@ -1,24 +1,70 @@
 #include "StateFunctions.h"
-#include "Math.h"
+#include "Hash.h"
+#include "Random.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <numeric>
+
+namespace {
+
+/// Particles drawn from one random stream by generateRandomState
+constexpr size_t SpawnChunkSize = 1 << 14;
+/// Below this many particles spawning a thread pool costs more than it saves
+constexpr int ParallelSpawnMin = 1 << 18;
+} // namespace
 
 State generateRandomState(int particlesCount, int colorsCount, int width, int height)
 {
     State state;
-    for (int i = 0; i < particlesCount; ++i)
-    {
-        state.colors.push_back(rand() % colorsCount);
-        state.pos.push_back(Position {.x = rand(0, width), .y = rand(0, height)} );
-        state.vel.push_back(Velocity {});
+    const size_t count = static_cast<size_t>(std::max(particlesCount, 0));
+    state.colors.resize(count);
+    state.pos.resize(count);
+    state.vel.resize(count);
+    state.ids.resize(count);
+    std::iota(state.ids.begin(), state.ids.end(), 0u);
+    state.nextId = static_cast<uint32_t>(count);
+
+    // Every chunk draws from its own stream so the state is the same for any number of threads.
+    const uint64_t seed = threadRandom().next64();
+    // The streams are keyed on SpawnChunkSize chunks whatever range fill is handed.
+    const auto fill = [&](size_t begin, size_t end) {
+        for (size_t chunk = begin / SpawnChunkSize * SpawnChunkSize; chunk < end; chunk += SpawnChunkSize) {
+            Random random(seed, chunk / SpawnChunkSize);
+            for (size_t i = chunk; i < std::min(chunk + SpawnChunkSize, end); ++i) {
+                state.colors[i] = static_cast<int>(random.below(static_cast<uint32_t>(colorsCount)));
+                state.pos[i] = Position{.x = random.uniform(0, static_cast<float>(width)), .y = random.uniform(0, static_cast<float>(height))};
+            }
+        }
+    };
+
+    if (particlesCount >= ParallelSpawnMin) {
+        ThreadPool pool;
+        pool.parallelFor(count, SpawnChunkSize, fill);
+    } else {
+        fill(0, count);
     }
     return state;
 }
 
 State generateAllInTheMiddleState(int particlesCount, int colorsCount, int width, int height) {
     State state;
+    Random &random = threadRandom();
     for (int i = 0; i < particlesCount; ++i) {
-        state.colors.push_back(rand() % colorsCount);
-        state.pos.push_back(Position {.x = static_cast<float>(width) / 2, .y = static_cast<float>(height) / 2});
-        state.vel.push_back(Velocity {});
+        AddParticle(state, static_cast<float>(width) / 2, static_cast<float>(height) / 2, static_cast<int>(random.below(static_cast<uint32_t>(colorsCount))));
     }
     return state;
-}
\ No newline at end of file
+}
+
+StateChecksum checksum(const State &state) {
+    std::vector<uint32_t> order(state.ids.size());
+    std::iota(order.begin(), order.end(), 0u);
+    std::sort(order.begin(), order.end(), [&](uint32_t lhs, uint32_t rhs) { return state.ids[lhs] < state.ids[rhs]; });
+
+    StateChecksum result{FnvOffset, FnvOffset, FnvOffset};
+    for (const uint32_t i : order) {
+        result.colors = fnv1a(result.colors, state.colors[i]);
+        result.pos = fnv1a(fnv1a(result.pos, state.pos[i].x), state.pos[i].y);
+        result.vel = fnv1a(fnv1a(result.vel, state.vel[i].x), state.vel[i].y);
+    }
+    return result;
+}
\ No newline at end of file
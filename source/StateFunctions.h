@@ -1,6 +1,17 @@
 #pragma once
 
 #include "State.h"
+#include <cstdint>
 
 State generateRandomState(int particlesCount, int colorsCount, int width, int height);
-State generateAllInTheMiddleState(int particlesCount, int colorsCount, int width, int height);
\ No newline at end of file
+State generateAllInTheMiddleState(int particlesCount, int colorsCount, int width, int height);
+
+/// @brief FNV-1a hashes of the particle arrays, visited in id order so they do not depend on how
+/// the arrays are currently ordered.
+struct StateChecksum {
+    uint64_t colors;
+    uint64_t pos;
+    uint64_t vel;
+};
+
+StateChecksum checksum(const State &state);
@@ -0,0 +1,135 @@
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cassert>
+
+namespace {
+
+uint64_t Pack(uint32_t begin, uint32_t end) {
+    return (static_cast<uint64_t>(begin) << 32) | end;
+}
+
+uint32_t Begin(uint64_t range) {
+    return static_cast<uint32_t>(range >> 32);
+}
+
+uint32_t End(uint64_t range) {
+    return static_cast<uint32_t>(range);
+}
+} // namespace
+
+ThreadPool::ThreadPool(size_t threadsCount) {
+    mThreadsCount = std::max<size_t>(1, threadsCount);
+    mQueues = std::make_unique<Queue[]>(mThreadsCount);
+    for(size_t worker = 1; worker < mThreadsCount; ++worker) {
+        mThreads.emplace_back([this, worker] { workerLoop(worker); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard lock(mMutex);
+        mStop = true;
+    }
+    mWake.notify_all();
+    for(std::thread &thread : mThreads) {
+        thread.join();
+    }
+}
+
+void ThreadPool::parallelFor(size_t count, size_t chunkSize, const std::function<void(size_t, size_t)> &f) {
+    if(count == 0) {
+        return;
+    }
+    chunkSize = std::max<size_t>(1, chunkSize);
+    const size_t chunksCount = (count + chunkSize - 1) / chunkSize;
+    if(mThreads.empty() || chunksCount == 1) {
+        // Same chunks as the workers would run, callers may key their work on the boundaries.
+        for(size_t begin = 0; begin < count; begin += chunkSize) {
+            f(begin, std::min(begin + chunkSize, count));
+        }
+        return;
+    }
+
+    {
+        std::lock_guard lock(mMutex);
+        assert(mJob == nullptr && "parallelFor cannot be nested");
+
+        mJob = &f;
+        mCount = count;
+        mChunkSize = chunkSize;
+
+        const size_t workers = mThreadsCount;
+        for(size_t worker = 0; worker < workers; ++worker) {
+            const uint32_t begin = static_cast<uint32_t>(chunksCount * worker / workers);
+            const uint32_t end = static_cast<uint32_t>(chunksCount * (worker + 1) / workers);
+            mQueues[worker].range.store(Pack(begin, end), std::memory_order_relaxed);
+        }
+
+        mBusyWorkers = mThreads.size();
+        ++mGeneration;
+    }
+    mWake.notify_all();
+
+    runChunks(0);
+
+    std::unique_lock lock(mMutex);
+    mDone.wait(lock, [this] { return mBusyWorkers == 0; });
+    mJob = nullptr;
+}
+
+void ThreadPool::workerLoop(size_t worker) {
+    uint64_t generation = 0;
+    while(true) {
+        {
+            std::unique_lock lock(mMutex);
+            mWake.wait(lock, [&] { return mStop || mGeneration != generation; });
+            if(mStop) {
+                return;
+            }
+            generation = mGeneration;
+        }
+
+        runChunks(worker);
+
+        std::lock_guard lock(mMutex);
+        if(--mBusyWorkers == 0) {
+            mDone.notify_one();
+        }
+    }
+}
+
+void ThreadPool::runChunks(size_t worker) {
+    const std::function<void(size_t, size_t)> &f = *mJob;
+    uint32_t chunk = 0;
+    while(popOwn(worker, chunk) || steal(worker, chunk)) {
+        const size_t begin = chunk * mChunkSize;
+        f(begin, std::min(begin + mChunkSize, mCount));
+    }
+}
+
+bool ThreadPool::popOwn(size_t worker, uint32_t &chunk) {
+    std::atomic<uint64_t> &range = mQueues[worker].range;
+    uint64_t current = range.load(std::memory_order_acquire);
+    while(Begin(current) < End(current)) {
+        if(range.compare_exchange_weak(current, Pack(Begin(current) + 1, End(current)), std::memory_order_acq_rel)) {
+            chunk = Begin(current);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ThreadPool::steal(size_t worker, uint32_t &chunk) {
+    const size_t workers = mThreadsCount;
+    for(size_t offset = 1; offset < workers; ++offset) {
+        std::atomic<uint64_t> &range = mQueues[(worker + offset) % workers].range;
+        uint64_t current = range.load(std::memory_order_acquire);
+        while(Begin(current) < End(current)) {
+            if(range.compare_exchange_weak(current, Pack(Begin(current), End(current) - 1), std::memory_order_acq_rel)) {
+                chunk = End(current) - 1;
+                return true;
+            }
+        }
+    }
+    return false;
+}
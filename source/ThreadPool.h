@@ -0,0 +1,58 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// @brief Persistent pool of worker threads running data parallel loops.
+/// A loop is cut into fixed size chunks which are dealt evenly to the workers; a worker that
+/// runs out of chunks steals from the back of the other workers' ranges. The calling thread
+/// takes part in the loop as well, so a pool of one thread runs everything inline.
+class ThreadPool {
+public:
+    /// @brief Creates a pool running loops on threadsCount threads, including the caller.
+    explicit ThreadPool(size_t threadsCount = std::thread::hardware_concurrency());
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    /// @brief Calls f(begin, end) for consecutive chunks covering [0, count) and blocks until
+    /// all of them finished. Chunk boundaries only depend on count and chunkSize, not on the
+    /// threads count: a pool of one thread calls f once per chunk too.
+    void parallelFor(size_t count, size_t chunkSize, const std::function<void(size_t begin, size_t end)> &f);
+
+    size_t threadsCount() const { return mThreadsCount; }
+
+private:
+    /// Range of chunks [begin, end) packed into one word so it can be shrunk from both sides
+    struct alignas(64) Queue {
+        std::atomic<uint64_t> range{0};
+    };
+
+    void workerLoop(size_t worker);
+    void runChunks(size_t worker);
+    bool popOwn(size_t worker, uint32_t &chunk);
+    bool steal(size_t worker, uint32_t &chunk);
+
+    size_t mThreadsCount = 1;
+    std::vector<std::thread> mThreads;
+    std::unique_ptr<Queue[]> mQueues;
+
+    std::mutex mMutex;
+    std::condition_variable mWake;
+    std::condition_variable mDone;
+    uint64_t mGeneration = 0;
+    size_t mBusyWorkers = 0;
+    bool mStop = false;
+
+    const std::function<void(size_t, size_t)> *mJob = nullptr;
+    size_t mCount = 0;
+    size_t mChunkSize = 0;
+};
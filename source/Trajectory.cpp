@@ -0,0 +1,419 @@
+#include "Trajectory.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <numeric>
+
+namespace {
+
+constexpr float QuantizationSteps = 65536.0f;
+
+/// scale is QuantizationSteps / world size. A coordinate equal to the size wraps to 0, the same
+/// point of the periodic world.
+uint16_t Quantize(float v, float scale) {
+    return static_cast<uint16_t>(static_cast<int32_t>(v * scale) & 0xffff);
+}
+
+float Dequantize(uint16_t q, float size) {
+    return (static_cast<float>(q) + 0.5f) / QuantizationSteps * size;
+}
+
+uint32_t ZigZag(int32_t v) {
+    return (static_cast<uint32_t>(v) << 1) ^ static_cast<uint32_t>(v >> 31);
+}
+
+int32_t UnZigZag(uint32_t v) {
+    return static_cast<int32_t>(v >> 1) ^ -static_cast<int32_t>(v & 1);
+}
+
+/// Longest varint of a 32 bit value
+constexpr size_t MaxVarintSize = 5;
+
+uint8_t *PutVarint(uint8_t *out, uint32_t v) {
+    while(v >= 0x80) {
+        *out++ = static_cast<uint8_t>(v | 0x80);
+        v >>= 7;
+    }
+    *out++ = static_cast<uint8_t>(v);
+    return out;
+}
+
+/// Reads LEB128 varints from an encoded frame, failing once the frame is exhausted
+class VarintReader {
+public:
+    VarintReader(const std::byte *data, size_t size) : mData(reinterpret_cast<const uint8_t *>(data)), mEnd(mData + size) {}
+
+    bool read(uint64_t &v) {
+        v = 0;
+        for(int shift = 0; shift < 64 && mData < mEnd; shift += 7) {
+            const uint8_t byte = *mData++;
+            v |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if((byte & 0x80) == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    const uint8_t *mData;
+    const uint8_t *mEnd;
+};
+
+template <typename T>
+T Read(const std::byte *data) {
+    T value;
+    std::memcpy(&value, data, sizeof(T));
+    return value;
+}
+
+/// Whether the frame record at offset lies within the records, which end at recordsEnd, and its
+/// particles fit in its size: every particle takes at least one byte per value
+bool RecordFits(const std::byte *data, uint64_t offset, uint64_t recordsEnd) {
+    if(offset < sizeof(TrajectoryFileHeader) || offset > recordsEnd || recordsEnd - offset < sizeof(TrajectoryFrameHeader)) {
+        return false;
+    }
+    const auto header = Read<TrajectoryFrameHeader>(data + offset);
+    const uint64_t bytesPerParticle = header.keyframe ? 4 : 2;
+    return header.size <= recordsEnd - offset - sizeof(header) && header.particlesCount <= header.size / bytesPerParticle;
+}
+} // namespace
+
+TrajectoryRecorder::~TrajectoryRecorder() {
+    close();
+}
+
+bool TrajectoryRecorder::open(const std::string &path, int width, int height, std::string &error, uint32_t keyframeInterval,
+                              size_t buffersCount) {
+    close();
+    mFile = std::fopen(path.c_str(), "wb");
+    if(mFile == nullptr) {
+        error = "cannot create " + path + ": " + std::strerror(errno);
+        return false;
+    }
+
+    TrajectoryFileHeader header{};
+    std::memcpy(header.magic, TrajectoryFileMagic, sizeof(header.magic));
+    header.version = TrajectoryFileVersion;
+    header.keyframeInterval = std::max<uint32_t>(1, keyframeInterval);
+    header.width = width;
+    header.height = height;
+    if(std::fwrite(&header, sizeof(header), 1, mFile) != 1) {
+        error = "cannot write " + path + ": " + std::strerror(errno);
+        std::fclose(mFile);
+        mFile = nullptr;
+        return false;
+    }
+
+    mWidth = static_cast<float>(width);
+    mHeight = static_cast<float>(height);
+    mKeyframeInterval = header.keyframeInterval;
+    mOffset = sizeof(header);
+    mIndex.clear();
+    mPreviousIds.clear();
+    mWriteFailed = false;
+
+    mFree.clear();
+    mPending.clear();
+    for(size_t i = 0; i < std::max<size_t>(1, buffersCount); ++i) {
+        mFree.push_back(std::make_unique<Frame>());
+    }
+    mClosing = false;
+    mFramesDropped = 0;
+    mFramesWritten = 0;
+    mBytesWritten = sizeof(header);
+    mWriter = std::thread([this] { writerLoop(); });
+    return true;
+}
+
+void TrajectoryRecorder::close() {
+    if(mFile == nullptr) {
+        return;
+    }
+    {
+        std::lock_guard lock(mMutex);
+        mClosing = true;
+    }
+    mQueued.notify_one();
+    mWriter.join();
+
+    TrajectoryFileTrailer trailer{};
+    trailer.indexOffset = mOffset;
+    trailer.framesCount = mIndex.size();
+    std::memcpy(trailer.magic, TrajectoryFileMagic, sizeof(trailer.magic));
+    if(!mWriteFailed) {
+        std::fwrite(mIndex.data(), sizeof(TrajectoryIndexEntry), mIndex.size(), mFile);
+        std::fwrite(&trailer, sizeof(trailer), 1, mFile);
+    }
+    std::fclose(mFile);
+    mFile = nullptr;
+}
+
+bool TrajectoryRecorder::record(const State &state, uint64_t step) {
+    std::unique_ptr<Frame> frame;
+    {
+        std::lock_guard lock(mMutex);
+        if(mFree.empty()) {
+            ++mFramesDropped;
+            return false;
+        }
+        frame = std::move(mFree.back());
+        mFree.pop_back();
+    }
+
+    frame->step = step;
+    frame->ids.assign(state.ids.begin(), state.ids.end());
+    frame->colors.assign(state.colors.begin(), state.colors.end());
+    frame->pos.assign(state.pos.begin(), state.pos.end());
+
+    {
+        std::lock_guard lock(mMutex);
+        mPending.push_back(std::move(frame));
+    }
+    mQueued.notify_one();
+    return true;
+}
+
+uint64_t TrajectoryRecorder::framesWritten() const {
+    std::lock_guard lock(mMutex);
+    return mFramesWritten;
+}
+
+uint64_t TrajectoryRecorder::framesDropped() const {
+    std::lock_guard lock(mMutex);
+    return mFramesDropped;
+}
+
+uint64_t TrajectoryRecorder::bytesWritten() const {
+    std::lock_guard lock(mMutex);
+    return mBytesWritten;
+}
+
+void TrajectoryRecorder::writerLoop() {
+    std::unique_lock lock(mMutex);
+    while(true) {
+        mQueued.wait(lock, [this] { return mClosing || !mPending.empty(); });
+        if(mPending.empty()) {
+            return;
+        }
+        std::unique_ptr<Frame> frame = std::move(mPending.front());
+        mPending.erase(mPending.begin());
+        lock.unlock();
+
+        write(*frame);
+
+        lock.lock();
+        mFree.push_back(std::move(frame));
+        ++mFramesWritten;
+        mBytesWritten = mOffset;
+    }
+}
+
+void TrajectoryRecorder::write(const Frame &frame) {
+    const size_t n = frame.ids.size();
+
+    // Id order. Ids are usually close to dense, then a scatter is cheaper than a sort.
+    mOrder.resize(n);
+    const uint32_t maxId = n > 0 ? *std::max_element(frame.ids.begin(), frame.ids.end()) : 0;
+    if(n > 0 && maxId < 4 * n) {
+        mById.assign(static_cast<size_t>(maxId) + 1, UINT32_MAX);
+        for(uint32_t i = 0; i < n; ++i) {
+            mById[frame.ids[i]] = i;
+        }
+        size_t k = 0;
+        for(const uint32_t i : mById) {
+            if(i != UINT32_MAX) {
+                mOrder[k++] = i;
+            }
+        }
+    } else {
+        std::iota(mOrder.begin(), mOrder.end(), 0u);
+        std::sort(mOrder.begin(), mOrder.end(), [&](uint32_t lhs, uint32_t rhs) { return frame.ids[lhs] < frame.ids[rhs]; });
+    }
+
+    mX.resize(n);
+    mY.resize(n);
+    const float scaleX = QuantizationSteps / mWidth;
+    const float scaleY = QuantizationSteps / mHeight;
+    for(size_t k = 0; k < n; ++k) {
+        const Position p = frame.pos[mOrder[k]];
+        mX[k] = Quantize(p.x, scaleX);
+        mY[k] = Quantize(p.y, scaleY);
+    }
+
+    bool keyframe = mIndex.size() % mKeyframeInterval == 0 || mPreviousIds.size() != n;
+    for(size_t k = 0; k < n && !keyframe; ++k) {
+        keyframe = mPreviousIds[k] != frame.ids[mOrder[k]];
+    }
+
+    // Sized for the longest encoding so the loops below write without bounds checks.
+    mEncoded.resize(n * 4 * MaxVarintSize);
+    uint8_t *out = mEncoded.data();
+    if(keyframe) {
+        mPreviousIds.resize(n);
+        uint32_t previousId = 0;
+        for(size_t k = 0; k < n; ++k) {
+            const uint32_t i = mOrder[k];
+            mPreviousIds[k] = frame.ids[i];
+            out = PutVarint(out, frame.ids[i] - previousId);
+            out = PutVarint(out, static_cast<uint32_t>(frame.colors[i]));
+            out = PutVarint(out, mX[k]);
+            out = PutVarint(out, mY[k]);
+            previousId = frame.ids[i];
+        }
+    } else {
+        for(size_t k = 0; k < n; ++k) {
+            out = PutVarint(out, ZigZag(static_cast<int16_t>(mX[k] - mPreviousX[k])));
+            out = PutVarint(out, ZigZag(static_cast<int16_t>(mY[k] - mPreviousY[k])));
+        }
+    }
+    mEncoded.resize(static_cast<size_t>(out - mEncoded.data()));
+    mPreviousX.swap(mX);
+    mPreviousY.swap(mY);
+
+    TrajectoryFrameHeader header{};
+    header.size = static_cast<uint32_t>(mEncoded.size());
+    header.keyframe = keyframe;
+    header.step = frame.step;
+    header.particlesCount = n;
+    if(mWriteFailed || std::fwrite(&header, sizeof(header), 1, mFile) != 1 ||
+       std::fwrite(mEncoded.data(), 1, mEncoded.size(), mFile) != mEncoded.size()) {
+        mWriteFailed = true;
+        return;
+    }
+    mIndex.push_back(TrajectoryIndexEntry{mOffset, frame.step});
+    mOffset += sizeof(header) + mEncoded.size();
+}
+
+bool TrajectoryReader::open(const std::string &path, std::string &error) {
+    mIndex.clear();
+    mDecoded = SIZE_MAX;
+    if(!mFile.open(path, error)) {
+        return false;
+    }
+    const std::byte *data = mFile.data();
+    const size_t size = mFile.size();
+    if(size < sizeof(TrajectoryFileHeader) || std::memcmp(data, TrajectoryFileMagic, sizeof(TrajectoryFileMagic)) != 0) {
+        error = path + ": not a trajectory file";
+        return false;
+    }
+    mHeader = Read<TrajectoryFileHeader>(data);
+    if(mHeader.version != TrajectoryFileVersion) {
+        error = path + ": unsupported trajectory file version";
+        return false;
+    }
+
+    if(size >= sizeof(TrajectoryFileHeader) + sizeof(TrajectoryFileTrailer)) {
+        const auto trailer = Read<TrajectoryFileTrailer>(data + size - sizeof(TrajectoryFileTrailer));
+        const uint64_t indexSpace = size - sizeof(TrajectoryFileTrailer);
+        if(std::memcmp(trailer.magic, TrajectoryFileMagic, sizeof(trailer.magic)) == 0) {
+            // The records lie between the header and the index, every frame the index points at too.
+            if(trailer.indexOffset < sizeof(TrajectoryFileHeader) || trailer.indexOffset > indexSpace ||
+               trailer.framesCount != (indexSpace - trailer.indexOffset) / sizeof(TrajectoryIndexEntry) ||
+               (indexSpace - trailer.indexOffset) % sizeof(TrajectoryIndexEntry) != 0) {
+                mIndex.clear();
+                error = path + ": corrupt trajectory index";
+                return false;
+            }
+            mIndex.resize(trailer.framesCount);
+            std::memcpy(mIndex.data(), data + trailer.indexOffset, trailer.framesCount * sizeof(TrajectoryIndexEntry));
+            for(const TrajectoryIndexEntry &entry : mIndex) {
+                if(!RecordFits(data, entry.offset, trailer.indexOffset)) {
+                    mIndex.clear();
+                    error = path + ": corrupt trajectory index";
+                    return false;
+                }
+            }
+            return true;
+        }
+    }
+
+    // No index: the recorder did not get to close the file. Complete records are still readable.
+    uint64_t offset = sizeof(TrajectoryFileHeader);
+    while(RecordFits(data, offset, size)) {
+        const auto header = Read<TrajectoryFrameHeader>(data + offset);
+        mIndex.push_back(TrajectoryIndexEntry{offset, header.step});
+        offset += sizeof(header) + header.size;
+    }
+    return true;
+}
+
+bool TrajectoryReader::readFrame(size_t frame, TrajectoryFrame &out, std::string &error) {
+    if(frame >= mIndex.size()) {
+        error = "frame out of range";
+        return false;
+    }
+    if(!decode(frame, error)) {
+        mDecoded = SIZE_MAX;
+        return false;
+    }
+
+    const float width = static_cast<float>(mHeader.width);
+    const float height = static_cast<float>(mHeader.height);
+    out.step = mStep;
+    out.ids = mIds;
+    out.colors = mColors;
+    out.pos.resize(mX.size());
+    for(size_t k = 0; k < mX.size(); ++k) {
+        out.pos[k] = Position{.x = Dequantize(mX[k], width), .y = Dequantize(mY[k], height)};
+    }
+    return true;
+}
+
+bool TrajectoryReader::decode(size_t frame, std::string &error) {
+    const auto header = [&](size_t f) { return Read<TrajectoryFrameHeader>(mFile.data() + mIndex[f].offset); };
+
+    if(frame == mDecoded) {
+        return true;
+    }
+    // Walk back to the closest keyframe, or to right after the last decoded frame when it is on the way.
+    size_t first = frame;
+    while(!(mDecoded != SIZE_MAX && first == mDecoded + 1) && !header(first).keyframe) {
+        if(first == 0) {
+            error = "trajectory starts without a keyframe";
+            return false;
+        }
+        --first;
+    }
+
+    for(size_t f = first; f <= frame; ++f) {
+        const TrajectoryFrameHeader h = header(f);
+        const size_t n = static_cast<size_t>(h.particlesCount);
+        VarintReader reader(mFile.data() + mIndex[f].offset + sizeof(h), h.size);
+        uint64_t a, b, c, d;
+        if(h.keyframe) {
+            mIds.resize(n);
+            mColors.resize(n);
+            mX.resize(n);
+            mY.resize(n);
+            uint32_t id = 0;
+            for(size_t k = 0; k < n; ++k) {
+                if(!reader.read(a) || !reader.read(b) || !reader.read(c) || !reader.read(d)) {
+                    error = "truncated keyframe";
+                    return false;
+                }
+                id += static_cast<uint32_t>(a);
+                mIds[k] = id;
+                mColors[k] = static_cast<int>(b);
+                mX[k] = static_cast<uint16_t>(c);
+                mY[k] = static_cast<uint16_t>(d);
+            }
+        } else {
+            if(n != mX.size()) {
+                error = "frame does not match the previous one";
+                return false;
+            }
+            for(size_t k = 0; k < n; ++k) {
+                if(!reader.read(a) || !reader.read(b)) {
+                    error = "truncated frame";
+                    return false;
+                }
+                mX[k] = static_cast<uint16_t>(mX[k] + UnZigZag(static_cast<uint32_t>(a)));
+                mY[k] = static_cast<uint16_t>(mY[k] + UnZigZag(static_cast<uint32_t>(b)));
+            }
+        }
+        mStep = h.step;
+        mDecoded = f;
+    }
+    return true;
+}
@@ -0,0 +1,160 @@
+#pragma once
+
+#include "State.h"
+#include "WorldFile.h"
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/// @brief Trajectory file layout.
+///
+/// A TrajectoryFileHeader, then one record per frame, then the frame index and a
+/// TrajectoryFileTrailer pointing at it. Particles of a frame are stored in id order, so frames stay
+/// comparable when the engine reorders its arrays. Positions are quantized to 16 bits of the world
+/// size. A keyframe stores the ids (delta coded), colors and quantized positions; the other frames
+/// only store the difference of every quantized coordinate to the previous frame, modulo 2^16 so a
+/// particle crossing the edge of the periodic world gives a small difference too. Every value is
+/// written as a zigzag LEB128 varint, most moves take one byte per coordinate. A keyframe is written
+/// every keyframeInterval frames and whenever the set of particles changed.
+constexpr char TrajectoryFileMagic[8] = {'P', 'A', 'R', 'T', 'T', 'R', 'A', 'J'};
+constexpr uint32_t TrajectoryFileVersion = 1;
+
+struct TrajectoryFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t keyframeInterval;
+    int32_t width;
+    int32_t height;
+};
+
+struct TrajectoryFrameHeader {
+    /// Size of the encoded particles following the header
+    uint32_t size;
+    uint32_t keyframe;
+    uint64_t step;
+    uint64_t particlesCount;
+};
+
+struct TrajectoryIndexEntry {
+    uint64_t offset;
+    uint64_t step;
+};
+
+struct TrajectoryFileTrailer {
+    uint64_t indexOffset;
+    uint64_t framesCount;
+    char magic[8];
+};
+
+/// @brief Streams the positions of every recorded step to a trajectory file.
+/// record() only copies the arrays into a buffer taken from a fixed pool; sorting, quantizing,
+/// encoding and writing run on a writer thread. When the writer falls behind and the pool is empty
+/// the frame is dropped rather than stalling the caller.
+class TrajectoryRecorder {
+public:
+    TrajectoryRecorder() = default;
+    ~TrajectoryRecorder();
+
+    TrajectoryRecorder(const TrajectoryRecorder &) = delete;
+    TrajectoryRecorder &operator=(const TrajectoryRecorder &) = delete;
+
+    /// @brief Creates path and starts the writer thread. Returns false and sets error on failure.
+    bool open(const std::string &path, int width, int height, std::string &error, uint32_t keyframeInterval = 60,
+              size_t buffersCount = 8);
+    /// @brief Writes the queued frames and the index, then closes the file.
+    void close();
+    bool isOpen() const { return mFile != nullptr; }
+
+    /// @brief Queues the particles of state as the frame of the given step. Returns false when
+    /// the frame was dropped because every buffer is waiting to be written.
+    bool record(const State &state, uint64_t step);
+
+    uint64_t framesWritten() const;
+    uint64_t framesDropped() const;
+    /// Bytes written to the file so far
+    uint64_t bytesWritten() const;
+
+private:
+    struct Frame {
+        uint64_t step = 0;
+        std::vector<uint32_t> ids;
+        std::vector<int> colors;
+        std::vector<Position> pos;
+    };
+
+    void writerLoop();
+    void write(const Frame &frame);
+
+    std::FILE *mFile = nullptr;
+    float mWidth = 0;
+    float mHeight = 0;
+    uint32_t mKeyframeInterval = 60;
+
+    mutable std::mutex mMutex;
+    std::condition_variable mQueued;
+    std::vector<std::unique_ptr<Frame>> mFree;
+    std::vector<std::unique_ptr<Frame>> mPending;
+    bool mClosing = false;
+    uint64_t mFramesDropped = 0;
+    uint64_t mFramesWritten = 0;
+    uint64_t mBytesWritten = 0;
+    std::thread mWriter;
+
+    // Writer thread only
+    std::vector<uint32_t> mOrder;
+    std::vector<uint32_t> mById;
+    std::vector<uint32_t> mPreviousIds;
+    std::vector<uint16_t> mPreviousX;
+    std::vector<uint16_t> mPreviousY;
+    std::vector<uint16_t> mX;
+    std::vector<uint16_t> mY;
+    std::vector<uint8_t> mEncoded;
+    std::vector<TrajectoryIndexEntry> mIndex;
+    uint64_t mOffset = 0;
+    bool mWriteFailed = false;
+};
+
+/// @brief Particles of one recorded frame, in id order.
+struct TrajectoryFrame {
+    uint64_t step = 0;
+    std::vector<uint32_t> ids;
+    std::vector<int> colors;
+    /// Dequantized positions, within half a quantization step of the recorded ones
+    std::vector<Position> pos;
+};
+
+/// @brief Random access to the frames of a trajectory file. Frame k is decoded from the keyframe
+/// at or before it; reading frames in order only decodes every frame once.
+class TrajectoryReader {
+public:
+    /// @brief Maps path and loads its frame index. A file whose recorder did not close it has no
+    /// index, its frames are found by walking the records instead. Returns false and sets error on failure.
+    bool open(const std::string &path, std::string &error);
+
+    int width() const { return mHeader.width; }
+    int height() const { return mHeader.height; }
+    size_t framesCount() const { return mIndex.size(); }
+    uint64_t frameStep(size_t frame) const { return mIndex[frame].step; }
+
+    /// @brief Decodes frame into out. Returns false and sets error when the file is corrupt.
+    bool readFrame(size_t frame, TrajectoryFrame &out, std::string &error);
+
+private:
+    bool decode(size_t frame, std::string &error);
+
+    MappedFile mFile;
+    TrajectoryFileHeader mHeader{};
+    std::vector<TrajectoryIndexEntry> mIndex;
+    /// Last decoded frame and its quantized coordinates
+    size_t mDecoded = SIZE_MAX;
+    uint64_t mStep = 0;
+    std::vector<uint32_t> mIds;
+    std::vector<int> mColors;
+    std::vector<uint16_t> mX;
+    std::vector<uint16_t> mY;
+};
@@ -0,0 +1,280 @@
+#include "Transport.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <new>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+namespace {
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "the shared rings need lock free 64 bit atomics");
+
+/// Indices of one direction of a shared memory channel. head and tail count every byte ever
+/// written and read, the ring position is the count modulo the capacity. Each index is written
+/// by one process only and sits on a cache line of its own.
+struct SharedRing {
+    alignas(64) std::atomic<uint64_t> head{0};
+    alignas(64) std::atomic<uint64_t> tail{0};
+    /// Set by the writer when it drops its end
+    alignas(64) std::atomic<uint32_t> closed{0};
+};
+
+/// Shared anonymous mapping holding two rings and their bytes. Both ends created in one process
+/// share it, it is unmapped with the last of them. A fork gives the child a mapping of its own
+/// onto the same memory.
+class SharedRegion {
+public:
+    SharedRegion(void *memory, size_t size, size_t capacity) : mMemory(memory), mSize(size), mCapacity(capacity) {
+        new(ring(0)) SharedRing();
+        new(ring(1)) SharedRing();
+    }
+    ~SharedRegion() { munmap(mMemory, mSize); }
+
+    SharedRing *ring(int direction) { return static_cast<SharedRing *>(mMemory) + direction; }
+    std::byte *bytes(int direction) { return static_cast<std::byte *>(mMemory) + 2 * sizeof(SharedRing) + direction * mCapacity; }
+    size_t capacity() const { return mCapacity; }
+
+private:
+    void *mMemory;
+    size_t mSize;
+    size_t mCapacity;
+};
+
+class SharedMemoryChannel : public Channel {
+public:
+    /// The end writing direction `out` and reading the other one
+    SharedMemoryChannel(std::shared_ptr<SharedRegion> region, int out) : mRegion(std::move(region)), mOut(out) {}
+
+    ~SharedMemoryChannel() override {
+        // Only the process talking through this end closes it, the copies other processes drop
+        // after the fork were never used.
+        if(mUsed) {
+            mRegion->ring(mOut)->closed.store(1, std::memory_order_release);
+        }
+    }
+
+    ptrdiff_t writeSome(std::span<const std::byte> data) override {
+        mUsed = true;
+        SharedRing &ring = *mRegion->ring(mOut);
+        const size_t capacity = mRegion->capacity();
+        const uint64_t head = ring.head.load(std::memory_order_relaxed);
+        const uint64_t tail = ring.tail.load(std::memory_order_acquire);
+        const size_t count = std::min(data.size(), static_cast<size_t>(capacity - (head - tail)));
+        if(count == 0) {
+            // The ring is full, the peer stopped reading if it dropped its end.
+            return mRegion->ring(1 - mOut)->closed.load(std::memory_order_acquire) != 0 ? -1 : 0;
+        }
+        const size_t offset = static_cast<size_t>(head % capacity);
+        const size_t first = std::min(count, capacity - offset);
+        std::memcpy(mRegion->bytes(mOut) + offset, data.data(), first);
+        std::memcpy(mRegion->bytes(mOut), data.data() + first, count - first);
+        ring.head.store(head + count, std::memory_order_release);
+        return static_cast<ptrdiff_t>(count);
+    }
+
+    ptrdiff_t readSome(std::span<std::byte> data) override {
+        mUsed = true;
+        const int in = 1 - mOut;
+        SharedRing &ring = *mRegion->ring(in);
+        const size_t capacity = mRegion->capacity();
+        // Read closed before head, a writer closing after its last write leaves nothing behind.
+        const bool closed = ring.closed.load(std::memory_order_acquire) != 0;
+        const uint64_t tail = ring.tail.load(std::memory_order_relaxed);
+        const uint64_t head = ring.head.load(std::memory_order_acquire);
+        const size_t count = std::min(data.size(), static_cast<size_t>(head - tail));
+        if(count == 0) {
+            return closed && head == tail ? -1 : 0;
+        }
+        const size_t offset = static_cast<size_t>(tail % capacity);
+        const size_t first = std::min(count, capacity - offset);
+        std::memcpy(data.data(), mRegion->bytes(in) + offset, first);
+        std::memcpy(data.data() + first, mRegion->bytes(in), count - first);
+        ring.tail.store(tail + count, std::memory_order_release);
+        return static_cast<ptrdiff_t>(count);
+    }
+
+private:
+    std::shared_ptr<SharedRegion> mRegion;
+    int mOut;
+    bool mUsed = false;
+};
+
+class SocketChannel : public Channel {
+public:
+    explicit SocketChannel(int fd) : mFd(fd) {}
+    ~SocketChannel() override { close(mFd); }
+
+    ptrdiff_t writeSome(std::span<const std::byte> data) override {
+        const ssize_t count = send(mFd, data.data(), data.size(), MSG_NOSIGNAL);
+        if(count < 0) {
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ? 0 : -1;
+        }
+        return count;
+    }
+
+    ptrdiff_t readSome(std::span<std::byte> data) override {
+        if(data.empty()) {
+            return 0;
+        }
+        const ssize_t count = recv(mFd, data.data(), data.size(), 0);
+        if(count < 0) {
+            return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ? 0 : -1;
+        }
+        // A stream socket reads 0 bytes only at the end of the stream.
+        return count == 0 ? -1 : count;
+    }
+
+private:
+    int mFd;
+};
+
+bool CreateSharedMemoryChannel(size_t capacity, ChannelPair &pair, std::string &error) {
+    if(capacity == 0) {
+        error = "shared memory channel capacity must be positive";
+        return false;
+    }
+    const size_t size = 2 * sizeof(SharedRing) + 2 * capacity;
+    void *memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if(memory == MAP_FAILED) {
+        error = std::string("cannot map shared memory: ") + std::strerror(errno);
+        return false;
+    }
+    auto region = std::make_shared<SharedRegion>(memory, size, capacity);
+    pair.first = std::make_unique<SharedMemoryChannel>(region, 0);
+    pair.second = std::make_unique<SharedMemoryChannel>(region, 1);
+    return true;
+}
+
+bool CreateSocketChannel(ChannelPair &pair, std::string &error) {
+    int fds[2];
+    if(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+        error = std::string("cannot create socket pair: ") + std::strerror(errno);
+        return false;
+    }
+    for(const int fd : fds) {
+        const int flags = fcntl(fd, F_GETFL);
+        if(flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) != 0) {
+            error = std::string("cannot make socket non blocking: ") + std::strerror(errno);
+            close(fds[0]);
+            close(fds[1]);
+            return false;
+        }
+    }
+    pair.first = std::make_unique<SocketChannel>(fds[0]);
+    pair.second = std::make_unique<SocketChannel>(fds[1]);
+    return true;
+}
+
+/// Transfer state of one channel in exchange()
+struct Transfer {
+    uint64_t outgoingSize = 0;
+    /// Bytes of the size prefix and the message sent and received so far
+    size_t sent = 0;
+    size_t received = 0;
+    uint64_t incomingSize = 0;
+};
+
+constexpr size_t PrefixSize = sizeof(uint64_t);
+} // namespace
+
+const char *toString(TransportKind kind) {
+    switch(kind) {
+    case TransportKind::SharedMemory:
+        return "shm";
+    case TransportKind::Socket:
+        return "socket";
+    }
+    return "unknown";
+}
+
+bool parseTransport(std::string_view name, TransportKind &kind) {
+    for(const TransportKind candidate : {TransportKind::SharedMemory, TransportKind::Socket}) {
+        if(name == toString(candidate)) {
+            kind = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool createChannel(TransportKind kind, size_t capacity, ChannelPair &pair, std::string &error) {
+    switch(kind) {
+    case TransportKind::SharedMemory:
+        return CreateSharedMemoryChannel(capacity, pair, error);
+    case TransportKind::Socket:
+        return CreateSocketChannel(pair, error);
+    }
+    error = "unknown transport";
+    return false;
+}
+
+bool exchange(std::span<Channel *const> channels, std::span<const std::vector<std::byte>> outgoing,
+              std::span<std::vector<std::byte>> incoming, std::string &error,
+              const std::function<bool(std::string &error)> &idle) {
+    const bool sending = !outgoing.empty();
+    const bool receiving = !incoming.empty();
+    std::vector<Transfer> transfers(channels.size());
+    for(size_t k = 0; sending && k < channels.size(); ++k) {
+        transfers[k].outgoingSize = outgoing[k].size();
+    }
+
+    size_t pending = (sending + receiving) * channels.size();
+    while(pending > 0) {
+        bool progress = false;
+        for(size_t k = 0; k < channels.size(); ++k) {
+            Transfer &transfer = transfers[k];
+            Channel &channel = *channels[k];
+
+            if(sending && transfer.sent < PrefixSize + transfer.outgoingSize) {
+                std::span<const std::byte> data;
+                if(transfer.sent < PrefixSize) {
+                    data = std::as_bytes(std::span(&transfer.outgoingSize, 1)).subspan(transfer.sent);
+                } else {
+                    data = std::span(outgoing[k]).subspan(transfer.sent - PrefixSize);
+                }
+                const ptrdiff_t count = channel.writeSome(data);
+                if(count < 0) {
+                    error = "peer closed the channel while sending";
+                    return false;
+                }
+                transfer.sent += static_cast<size_t>(count);
+                progress |= count > 0;
+                pending -= transfer.sent == PrefixSize + transfer.outgoingSize;
+            }
+
+            // The size prefix is read first, the message once it is known.
+            if(receiving && (transfer.received < PrefixSize || transfer.received < PrefixSize + transfer.incomingSize)) {
+                std::span<std::byte> data;
+                if(transfer.received < PrefixSize) {
+                    data = std::as_writable_bytes(std::span(&transfer.incomingSize, 1)).subspan(transfer.received);
+                } else {
+                    data = std::span(incoming[k]).subspan(transfer.received - PrefixSize);
+                }
+                const ptrdiff_t count = channel.readSome(data);
+                if(count < 0) {
+                    error = "peer closed the channel while receiving";
+                    return false;
+                }
+                const bool prefixRead = transfer.received < PrefixSize;
+                transfer.received += static_cast<size_t>(count);
+                progress |= count > 0;
+                if(prefixRead && transfer.received == PrefixSize) {
+                    incoming[k].resize(transfer.incomingSize);
+                }
+                pending -= transfer.received >= PrefixSize && transfer.received == PrefixSize + transfer.incomingSize;
+            }
+        }
+        if(!progress) {
+            if(idle && !idle(error)) {
+                return false;
+            }
+            std::this_thread::yield();
+        }
+    }
+    return true;
+}
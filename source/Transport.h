@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/// @brief How the worker processes of a distributed run talk to each other.
+enum class TransportKind {
+    /// Two single producer single consumer byte rings in a shared anonymous mapping
+    SharedMemory,
+    /// A Unix domain stream socket pair
+    Socket,
+};
+
+const char *toString(TransportKind kind);
+
+/// @brief Parses the name printed by toString (case sensitive). Returns false for unknown names.
+bool parseTransport(std::string_view name, TransportKind &kind);
+
+/// @brief One end of a two way byte stream between two processes. Neither call blocks, both move
+/// as many bytes as they can right now.
+class Channel {
+public:
+    virtual ~Channel() = default;
+
+    /// @brief Writes up to data.size() bytes. Returns how many were written, or -1 once the
+    /// other end is gone.
+    virtual ptrdiff_t writeSome(std::span<const std::byte> data) = 0;
+    /// @brief Reads up to data.size() bytes. Returns how many were read, or -1 once the other
+    /// end is gone and everything it wrote was read.
+    virtual ptrdiff_t readSome(std::span<std::byte> data) = 0;
+};
+
+/// @brief Both ends of a channel. Created before forking, each process then keeps the end it
+/// talks through and drops the other, so a process exiting is seen by its peer.
+struct ChannelPair {
+    std::unique_ptr<Channel> first;
+    std::unique_ptr<Channel> second;
+};
+
+/// @brief Creates a channel of the given kind. capacity is the size of each direction's ring in
+/// bytes, the socket transport leaves its buffers to the kernel.
+bool createChannel(TransportKind kind, size_t capacity, ChannelPair &pair, std::string &error);
+
+/// @brief Sends outgoing[k] as one message through channels[k] and receives one message from each
+/// channel into incoming[k]. An empty outgoing or incoming span only receives or only sends. All
+/// channels progress together, so processes exchanging with each other in a ring never wait for
+/// one another to drain a full buffer. Fails when a peer is gone. While nothing moves idle is
+/// called, if set, before yielding; it can end the wait by returning false with an error.
+bool exchange(std::span<Channel *const> channels, std::span<const std::vector<std::byte>> outgoing,
+              std::span<std::vector<std::byte>> incoming, std::string &error,
+              const std::function<bool(std::string &error)> &idle = {});
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "Aligned.h"
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+/// @brief Hands whole frames from one writer thread to one reader thread without blocking either.
+/// The writer fills back() and publishes it; the reader picks up the most recent published frame
+/// with update() and reads front() until its next update(). Frames the reader was too slow to see
+/// are dropped.
+template <typename T>
+class TripleBuffer {
+public:
+    /// @brief Writer side: the frame being filled, not visible to the reader.
+    T &back() { return mSlots[mBack]; }
+
+    /// @brief Writer side: makes back() the latest frame and hands the writer a free slot.
+    void publish() {
+        mBack = mMiddle.exchange(mBack | Fresh, std::memory_order_acq_rel) & IndexMask;
+    }
+
+    /// @brief Writer side: true while the last published frame was not picked up by the reader.
+    bool pending() const { return (mMiddle.load(std::memory_order_relaxed) & Fresh) != 0; }
+
+    /// @brief Reader side: switches front() to the latest published frame.
+    /// Returns false when nothing was published since the last call.
+    bool update() {
+        if((mMiddle.load(std::memory_order_relaxed) & Fresh) == 0) {
+            return false;
+        }
+        mFront = mMiddle.exchange(mFront, std::memory_order_acq_rel) & IndexMask;
+        return true;
+    }
+
+    /// @brief Reader side: the frame picked by the last update().
+    const T &front() const { return mSlots[mFront]; }
+
+private:
+    static constexpr uint8_t IndexMask = 0x3;
+    /// Set on the middle index while it holds a frame the reader has not picked up
+    static constexpr uint8_t Fresh = 0x4;
+
+    std::array<T, 3> mSlots{};
+    alignas(CacheLine) uint8_t mBack = 0;
+    alignas(CacheLine) std::atomic<uint8_t> mMiddle = 1;
+    alignas(CacheLine) uint8_t mFront = 2;
+};
@@ -0,0 +1,109 @@
+#include "ViewCuller.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+/// Cells [first, last] covering the world interval [begin, begin + length] of a periodic axis,
+/// each listed once
+void CellsOfInterval(float begin, float length, float period, int cellsCount, std::vector<int> &cells) {
+    cells.clear();
+    if(length + 2 * ViewCuller::CellSize >= period) {
+        for(int c = 0; c < cellsCount; ++c) {
+            cells.push_back(c);
+        }
+        return;
+    }
+    const auto cellOf = [&](float x) { return std::clamp(static_cast<int>(x / ViewCuller::CellSize), 0, cellsCount - 1); };
+    const float first = begin - std::floor(begin / period) * period;
+    const float last = first + length;
+    if(last < period) {
+        for(int c = cellOf(first); c <= cellOf(last); ++c) {
+            cells.push_back(c);
+        }
+        return;
+    }
+    // Straddles the seam: the end of the axis, then its start. The gap of at least two cells
+    // between them keeps the two runs apart.
+    for(int c = cellOf(first); c < cellsCount; ++c) {
+        cells.push_back(c);
+    }
+    for(int c = 0; c <= cellOf(last - period); ++c) {
+        cells.push_back(c);
+    }
+}
+} // namespace
+
+void ViewCuller::update(const Snapshot &snapshot, const Camera &camera, float width, float height, float margin,
+                        std::chrono::steady_clock::time_point now) {
+    PROFILE_SCOPE("Cull");
+    if(camera.identity()) {
+        // Everything is in view where it is, there is nothing to pick.
+        interpolatePositions(snapshot, width, height, now, mViewPositions);
+        mViewColors.assign(snapshot.colors.begin(), snapshot.colors.end());
+        mCandidates.clear();
+        return;
+    }
+
+    if(snapshot.time != mBuiltTime || snapshot.pos.size() != mBuiltCount || mColumns == 0) {
+        build(snapshot.pos, width, height);
+        mBuiltTime = snapshot.time;
+        mBuiltCount = snapshot.pos.size();
+    }
+
+    const Boundry rect = camera.visibleRect();
+    const float slack = margin + StepSlack;
+    CellsOfInterval(rect.x - slack, rect.width + 2 * slack, width, mColumns, mVisibleColumns);
+    CellsOfInterval(rect.y - slack, rect.height + 2 * slack, height, mRows, mVisibleRows);
+    mCandidates.clear();
+    for(const int row : mVisibleRows) {
+        for(const int column : mVisibleColumns) {
+            const size_t cell = static_cast<size_t>(row) * mColumns + column;
+            mCandidates.insert(mCandidates.end(), mIndices.begin() + mCellStart[cell], mIndices.begin() + mCellStart[cell + 1]);
+        }
+    }
+
+    interpolatePositions(snapshot, width, height, now, mCandidates, mInterpolated);
+    // The view is as large as the world, the margin grows with the zoom.
+    const float viewMargin = margin * camera.zoom();
+    mViewPositions.clear();
+    mViewColors.clear();
+    for(size_t k = 0; k < mCandidates.size(); ++k) {
+        const Position view = camera.toView(mInterpolated[k]);
+        if(view.x >= -viewMargin && view.x < width + viewMargin && view.y >= -viewMargin && view.y < height + viewMargin) {
+            mViewPositions.push_back(view);
+            mViewColors.push_back(snapshot.colors[mCandidates[k]]);
+        }
+    }
+}
+
+void ViewCuller::build(std::span<const Position> pos, float width, float height) {
+    PROFILE_SCOPE("Cull grid");
+    mColumns = std::max(1, static_cast<int>(std::ceil(width / CellSize)));
+    mRows = std::max(1, static_cast<int>(std::ceil(height / CellSize)));
+    const size_t cellsCount = static_cast<size_t>(mColumns) * mRows;
+    const float invCellSize = 1 / CellSize;
+
+    mCells.resize(pos.size());
+    mCellStart.assign(cellsCount + 1, 0);
+    for(size_t i = 0; i < pos.size(); ++i) {
+        const int column = std::clamp(static_cast<int>(pos[i].x * invCellSize), 0, mColumns - 1);
+        const int row = std::clamp(static_cast<int>(pos[i].y * invCellSize), 0, mRows - 1);
+        mCells[i] = static_cast<uint32_t>(row * mColumns + column);
+        ++mCellStart[mCells[i] + 1];
+    }
+    for(size_t cell = 0; cell < cellsCount; ++cell) {
+        mCellStart[cell + 1] += mCellStart[cell];
+    }
+
+    mIndices.resize(pos.size());
+    // Fill every cell from its start, mCellStart[cell] ends up at the start of the next cell.
+    for(size_t i = 0; i < pos.size(); ++i) {
+        mIndices[mCellStart[mCells[i]]++] = static_cast<uint32_t>(i);
+    }
+    for(size_t cell = cellsCount; cell > 0; --cell) {
+        mCellStart[cell] = mCellStart[cell - 1];
+    }
+    mCellStart[0] = 0;
+}
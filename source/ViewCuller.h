@@ -0,0 +1,54 @@
+#pragma once
+
+#include "Camera.h"
+#include "Simulation.h"
+#include "State.h"
+#include <chrono>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+/// @brief Picks the particles of a snapshot a Camera sees and moves them into view pixels, so the
+/// renderers only touch what is on screen. The snapshot's positions are binned into a coarse grid
+/// once per published snapshot; a frame then visits the cells overlapping the visible rectangle
+/// and interpolates only the particles in them.
+class ViewCuller {
+public:
+    /// Grid cell side in world units
+    static constexpr float CellSize = 32;
+    /// How far a particle may move in one step, the grid holds the positions at the end of the step
+    /// while the frame draws them somewhere between the last two steps
+    static constexpr float StepSlack = 8;
+
+    /// @brief Collects the particles whose centre is within margin world units of the camera's view
+    /// of a width x height world, interpolated at now.
+    void update(const Snapshot &snapshot, const Camera &camera, float width, float height, float margin,
+                std::chrono::steady_clock::time_point now);
+
+    /// @brief Visible particles in view pixels, and their colors.
+    std::span<const Position> positions() const { return mViewPositions; }
+    std::span<const int> colors() const { return mViewColors; }
+    /// @brief Particles in the cells visited by the last update, before the exact test.
+    size_t candidatesCount() const { return mCandidates.size(); }
+
+private:
+    void build(std::span<const Position> pos, float width, float height);
+
+    int mColumns = 0;
+    int mRows = 0;
+    /// Publication time of the snapshot binned into the grid
+    std::chrono::steady_clock::time_point mBuiltTime{};
+    size_t mBuiltCount = 0;
+    /// Counting sort of the particle indices by cell
+    std::vector<uint32_t> mCellStart;
+    std::vector<uint32_t> mIndices;
+    std::vector<uint32_t> mCells;
+
+    /// Columns and rows of the cells overlapping the view
+    std::vector<int> mVisibleColumns;
+    std::vector<int> mVisibleRows;
+    std::vector<uint32_t> mCandidates;
+    std::vector<Position> mInterpolated;
+    std::vector<Position> mViewPositions;
+    std::vector<int> mViewColors;
+};
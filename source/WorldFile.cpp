@@ -0,0 +1,369 @@
+#include "WorldFile.h"
+#include "ConfigFunctions.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static_assert(sizeof(int) == sizeof(int32_t), "State colors are stored as int32");
+static_assert(sizeof(Position) == 2 * sizeof(float) && sizeof(Velocity) == 2 * sizeof(float));
+static_assert(sizeof(Rgb) == 3 * sizeof(float));
+static_assert(sizeof(WorldFileHeader) % 8 == 0);
+
+namespace {
+
+uint64_t AlignUp(uint64_t offset) {
+    return (offset + WorldFileAlignment - 1) / WorldFileAlignment * WorldFileAlignment;
+}
+
+/// Size in bytes of every section of a world with the given counts
+void SectionSizes(uint64_t colorsCount, uint64_t particlesCount, uint64_t (&sizes)[static_cast<size_t>(WorldSection::Count)]) {
+    const uint64_t matrix = colorsCount * colorsCount * sizeof(float);
+    sizes[static_cast<size_t>(WorldSection::ConfigColors)] = colorsCount * sizeof(Rgb);
+    sizes[static_cast<size_t>(WorldSection::Matrix)] = matrix;
+    sizes[static_cast<size_t>(WorldSection::MinDistances)] = matrix;
+    sizes[static_cast<size_t>(WorldSection::Forces)] = matrix;
+    sizes[static_cast<size_t>(WorldSection::Radii)] = matrix;
+    sizes[static_cast<size_t>(WorldSection::Colors)] = particlesCount * sizeof(int32_t);
+    sizes[static_cast<size_t>(WorldSection::Positions)] = particlesCount * sizeof(Position);
+    sizes[static_cast<size_t>(WorldSection::Velocities)] = particlesCount * sizeof(Velocity);
+    sizes[static_cast<size_t>(WorldSection::Ids)] = particlesCount * sizeof(uint32_t);
+}
+
+bool MatrixMatches(const Matrix &matrix, int colorsCount) {
+    if(matrix.size() != static_cast<size_t>(colorsCount)) {
+        return false;
+    }
+    for(const std::vector<float> &row : matrix) {
+        if(row.size() != static_cast<size_t>(colorsCount)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+class Writer {
+public:
+    explicit Writer(std::FILE *file) : mFile(file) {}
+
+    bool write(const void *data, size_t size) {
+        mOffset += size;
+        return size == 0 || std::fwrite(data, 1, size, mFile) == size;
+    }
+
+    /// Pads with zeros up to offset
+    bool seek(uint64_t offset) {
+        static constexpr char Zeros[WorldFileAlignment] = {};
+        while(mOffset < offset) {
+            if(!write(Zeros, static_cast<size_t>(std::min<uint64_t>(offset - mOffset, sizeof(Zeros))))) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+private:
+    std::FILE *mFile;
+    uint64_t mOffset = 0;
+};
+
+bool WriteWorld(std::FILE *file, const WorldFileHeader &header, const Config &config, const State &state) {
+    Writer writer(file);
+    if(!writer.write(&header, sizeof(header))) {
+        return false;
+    }
+
+    const auto seek = [&](WorldSection section) { return writer.seek(header.sections[static_cast<size_t>(section)]); };
+    const auto writeMatrix = [&](WorldSection section, const Matrix &matrix) {
+        if(!seek(section)) {
+            return false;
+        }
+        for(const std::vector<float> &row : matrix) {
+            if(!writer.write(row.data(), row.size() * sizeof(float))) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    const size_t n = state.pos.size();
+    return seek(WorldSection::ConfigColors) && writer.write(config.particleColors.data(), config.colorsCount * sizeof(Rgb)) &&
+           writeMatrix(WorldSection::Matrix, config.matrix) && writeMatrix(WorldSection::MinDistances, config.minDistances) &&
+           writeMatrix(WorldSection::Forces, config.forces) && writeMatrix(WorldSection::Radii, config.radii) &&
+           seek(WorldSection::Colors) && writer.write(state.colors.data(), n * sizeof(int32_t)) &&
+           seek(WorldSection::Positions) && writer.write(state.pos.data(), n * sizeof(Position)) &&
+           seek(WorldSection::Velocities) && writer.write(state.vel.data(), n * sizeof(Velocity)) &&
+           seek(WorldSection::Ids) && writer.write(state.ids.data(), n * sizeof(uint32_t)) && writer.seek(header.fileSize);
+}
+
+std::string SystemError(const char *what, const std::string &path) {
+    return std::string(what) + " " + path + ": " + std::strerror(errno);
+}
+} // namespace
+
+bool saveWorld(const std::string &path, const Config &config, const State &state, int width, int height, std::string &error) {
+    const size_t n = state.pos.size();
+    if(state.colors.size() != n || state.vel.size() != n || state.ids.size() != n) {
+        error = "state arrays have different sizes";
+        return false;
+    }
+    if(config.particleColors.size() < static_cast<size_t>(config.colorsCount) || !MatrixMatches(config.matrix, config.colorsCount) ||
+       !MatrixMatches(config.minDistances, config.colorsCount) || !MatrixMatches(config.forces, config.colorsCount) ||
+       !MatrixMatches(config.radii, config.colorsCount)) {
+        error = "config matrices do not match its colors count";
+        return false;
+    }
+
+    WorldFileHeader header{};
+    std::memcpy(header.magic, WorldFileMagic, sizeof(header.magic));
+    header.version = WorldFileVersion;
+    header.byteOrder = WorldFileByteOrder;
+    header.width = width;
+    header.height = height;
+    header.colorsCount = config.colorsCount;
+    header.dt = config.dt;
+    header.frictionHalfLife = config.frictionHalfLife;
+    header.rMax = config.rMax;
+    header.forceFactor = config.forceFactor;
+    header.particleSize = config.particleSize;
+    header.k = config.k;
+    header.friction = config.friction;
+    header.particlesCount = n;
+    header.nextId = state.nextId;
+
+    uint64_t sizes[static_cast<size_t>(WorldSection::Count)];
+    SectionSizes(static_cast<uint64_t>(config.colorsCount), n, sizes);
+    uint64_t offset = sizeof(header);
+    for(size_t section = 0; section < static_cast<size_t>(WorldSection::Count); ++section) {
+        offset = AlignUp(offset);
+        header.sections[section] = offset;
+        offset += sizes[section];
+    }
+    header.fileSize = AlignUp(offset);
+
+    const std::string temporary = path + ".tmp";
+    std::FILE *file = std::fopen(temporary.c_str(), "wb");
+    if(file == nullptr) {
+        error = SystemError("cannot create", temporary);
+        return false;
+    }
+    const bool written = WriteWorld(file, header, config, state);
+    if(std::fclose(file) != 0 || !written) {
+        error = SystemError("cannot write", temporary);
+        std::remove(temporary.c_str());
+        return false;
+    }
+
+    std::error_code code;
+    std::filesystem::rename(temporary, path, code);
+    if(code) {
+        error = "cannot rename " + temporary + " to " + path + ": " + code.message();
+        std::remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+MappedFile::MappedFile(MappedFile &&other) noexcept {
+    *this = std::move(other);
+}
+
+MappedFile &MappedFile::operator=(MappedFile &&other) noexcept {
+    if(this != &other) {
+        close();
+        mData = std::exchange(other.mData, nullptr);
+        mSize = std::exchange(other.mSize, 0);
+#ifdef _WIN32
+        mFile = std::exchange(other.mFile, nullptr);
+        mMapping = std::exchange(other.mMapping, nullptr);
+#endif
+    }
+    return *this;
+}
+
+#ifdef _WIN32
+
+bool MappedFile::open(const std::string &path, std::string &error) {
+    close();
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if(file == INVALID_HANDLE_VALUE) {
+        error = "cannot open " + path + ": error " + std::to_string(GetLastError());
+        return false;
+    }
+    LARGE_INTEGER size;
+    if(!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+        error = "cannot map empty file " + path;
+        CloseHandle(file);
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    const void *data = mapping != nullptr ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if(data == nullptr) {
+        error = "cannot map " + path + ": error " + std::to_string(GetLastError());
+        if(mapping != nullptr) {
+            CloseHandle(mapping);
+        }
+        CloseHandle(file);
+        return false;
+    }
+    mFile = file;
+    mMapping = mapping;
+    mData = static_cast<const std::byte *>(data);
+    mSize = static_cast<size_t>(size.QuadPart);
+    return true;
+}
+
+void MappedFile::close() {
+    if(mData != nullptr) {
+        UnmapViewOfFile(mData);
+        CloseHandle(mMapping);
+        CloseHandle(mFile);
+    }
+    mData = nullptr;
+    mSize = 0;
+    mFile = nullptr;
+    mMapping = nullptr;
+}
+
+#else
+
+bool MappedFile::open(const std::string &path, std::string &error) {
+    close();
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0) {
+        error = SystemError("cannot open", path);
+        return false;
+    }
+    struct stat info;
+    if(fstat(fd, &info) != 0 || info.st_size == 0) {
+        error = "cannot map empty file " + path;
+        ::close(fd);
+        return false;
+    }
+    void *data = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping keeps the file alive.
+    ::close(fd);
+    if(data == MAP_FAILED) {
+        error = SystemError("cannot map", path);
+        return false;
+    }
+    mData = static_cast<const std::byte *>(data);
+    mSize = static_cast<size_t>(info.st_size);
+    return true;
+}
+
+void MappedFile::close() {
+    if(mData != nullptr) {
+        munmap(const_cast<std::byte *>(mData), mSize);
+    }
+    mData = nullptr;
+    mSize = 0;
+}
+
+#endif
+
+bool WorldFile::open(const std::string &path, std::string &error) {
+    if(!mFile.open(path, error)) {
+        return false;
+    }
+
+    const auto fail = [&](const char *reason) {
+        error = path + ": " + reason;
+        mFile.close();
+        return false;
+    };
+    if(mFile.size() < sizeof(WorldFileHeader) || std::memcmp(header().magic, WorldFileMagic, sizeof(WorldFileMagic)) != 0) {
+        return fail("not a world file");
+    }
+    const WorldFileHeader &h = header();
+    if(h.version != WorldFileVersion) {
+        return fail("unsupported world file version");
+    }
+    if(h.byteOrder != WorldFileByteOrder) {
+        return fail("world file written with another byte order");
+    }
+    if(h.fileSize > mFile.size() || h.colorsCount < 0 || h.particlesCount > UINT32_MAX) {
+        return fail("truncated or corrupt world file");
+    }
+
+    uint64_t sizes[static_cast<size_t>(WorldSection::Count)];
+    SectionSizes(static_cast<uint64_t>(h.colorsCount), h.particlesCount, sizes);
+    for(size_t section = 0; section < static_cast<size_t>(WorldSection::Count); ++section) {
+        const uint64_t offset = h.sections[section];
+        if(offset % WorldFileAlignment != 0 || offset > h.fileSize || sizes[section] > h.fileSize - offset) {
+            return fail("truncated or corrupt world file");
+        }
+    }
+    // A color the config has no row for would index past the interactions.
+    for(const int32_t color : colors()) {
+        if(color < 0 || color >= h.colorsCount) {
+            return fail("particle color out of range of the config colors");
+        }
+    }
+    return true;
+}
+
+std::span<const float> WorldFile::matrixRow(WorldSection matrix, int r) const {
+    const int colorsCount = header().colorsCount;
+    return section<float>(matrix, static_cast<uint64_t>(colorsCount) * colorsCount).subspan(static_cast<size_t>(r) * colorsCount, colorsCount);
+}
+
+void WorldFile::copyTo(Config &config, State &state) const {
+    const WorldFileHeader &h = header();
+    config.colorsCount = h.colorsCount;
+    config.dt = h.dt;
+    config.frictionHalfLife = h.frictionHalfLife;
+    config.rMax = h.rMax;
+    config.forceFactor = h.forceFactor;
+    config.particleSize = h.particleSize;
+    config.k = h.k;
+    config.friction = h.friction;
+
+    const std::span<const Rgb> colors = configColors();
+    config.particleColors.assign(colors.begin(), colors.end());
+    const auto copyMatrix = [&](WorldSection section, Matrix &matrix) {
+        matrix.resize(static_cast<size_t>(h.colorsCount));
+        for(int r = 0; r < h.colorsCount; ++r) {
+            const std::span<const float> row = matrixRow(section, r);
+            matrix[r].assign(row.begin(), row.end());
+        }
+    };
+    copyMatrix(WorldSection::Matrix, config.matrix);
+    copyMatrix(WorldSection::MinDistances, config.minDistances);
+    copyMatrix(WorldSection::Forces, config.forces);
+    copyMatrix(WorldSection::Radii, config.radii);
+    invalidateInteractions(config);
+
+    state.colors.assign(this->colors().begin(), this->colors().end());
+    state.pos.assign(positions().begin(), positions().end());
+    state.vel.assign(velocities().begin(), velocities().end());
+    state.ids.assign(ids().begin(), ids().end());
+    state.nextId = h.nextId;
+}
+
+bool loadWorld(const std::string &path, Config &config, State &state, int &width, int &height, std::string &error) {
+    WorldFile file;
+    if(!file.open(path, error)) {
+        return false;
+    }
+    file.copyTo(config, state);
+    width = file.header().width;
+    height = file.header().height;
+    return true;
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include "Config.h"
+#include "State.h"
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+
+/// @brief Binary snapshot of a Config and a State, laid out so a mapped file can be read in place.
+///
+/// The file starts with a WorldFileHeader followed by sections, each starting at a multiple of
+/// WorldFileAlignment bytes: the colors of the config (Rgb), its matrix, minDistances, forces and
+/// radii (colorsCount x colorsCount floats, row by row), then the particle colors (int32), positions,
+/// velocities and ids. Numbers are stored in the byte order of the machine that wrote the file, a
+/// file written on a machine of the other byte order is refused.
+constexpr char WorldFileMagic[8] = {'P', 'A', 'R', 'T', 'W', 'R', 'L', 'D'};
+constexpr uint32_t WorldFileVersion = 1;
+constexpr size_t WorldFileAlignment = 64;
+/// Tells the byte order of the writer apart, reads 0x04030201 when the reader's order matches
+constexpr uint32_t WorldFileByteOrder = 0x04030201;
+
+enum class WorldSection : uint32_t {
+    ConfigColors,
+    Matrix,
+    MinDistances,
+    Forces,
+    Radii,
+    Colors,
+    Positions,
+    Velocities,
+    Ids,
+    Count,
+};
+
+struct WorldFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint64_t fileSize;
+    /// Size of the world the state was simulated in
+    int32_t width;
+    int32_t height;
+
+    int32_t colorsCount;
+    float dt;
+    float frictionHalfLife;
+    float rMax;
+    float forceFactor;
+    int32_t particleSize;
+    float k;
+    float friction;
+
+    uint64_t particlesCount;
+    uint32_t nextId;
+    uint32_t padding;
+    /// Byte offset of every section from the start of the file
+    uint64_t sections[static_cast<size_t>(WorldSection::Count)];
+};
+
+/// @brief Writes config and state to path. The file is written next to it and renamed over it once
+/// complete, so a failed save leaves the previous file intact. Returns false and sets error on failure.
+bool saveWorld(const std::string &path, const Config &config, const State &state, int width, int height, std::string &error);
+
+/// @brief Read only memory mapping of a whole file.
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(MappedFile &&other) noexcept;
+    MappedFile &operator=(MappedFile &&other) noexcept;
+
+    /// @brief Maps path, unmapping the previous file. Returns false and sets error on failure.
+    bool open(const std::string &path, std::string &error);
+    void close();
+
+    const std::byte *data() const { return mData; }
+    size_t size() const { return mSize; }
+
+private:
+    const std::byte *mData = nullptr;
+    size_t mSize = 0;
+#ifdef _WIN32
+    void *mFile = nullptr;
+    void *mMapping = nullptr;
+#endif
+};
+
+/// @brief A world file mapped into memory. The arrays point into the mapping: nothing is parsed or
+/// copied until copyTo, and pages are only read from disk when touched.
+class WorldFile {
+public:
+    /// @brief Maps path and checks its header, section bounds and particle colors. Returns false and
+    /// sets error when the file is not a world file of this version.
+    bool open(const std::string &path, std::string &error);
+
+    const WorldFileHeader &header() const { return *reinterpret_cast<const WorldFileHeader *>(mFile.data()); }
+
+    std::span<const Rgb> configColors() const { return section<Rgb>(WorldSection::ConfigColors, header().colorsCount); }
+    /// @brief Row r of matrix, minDistances, forces or radii.
+    std::span<const float> matrixRow(WorldSection matrix, int r) const;
+
+    std::span<const int32_t> colors() const { return section<int32_t>(WorldSection::Colors, header().particlesCount); }
+    std::span<const Position> positions() const { return section<Position>(WorldSection::Positions, header().particlesCount); }
+    std::span<const Velocity> velocities() const { return section<Velocity>(WorldSection::Velocities, header().particlesCount); }
+    std::span<const uint32_t> ids() const { return section<uint32_t>(WorldSection::Ids, header().particlesCount); }
+
+    /// @brief Replaces config and state with the contents of the file. The config's interactions are
+    /// invalidated.
+    void copyTo(Config &config, State &state) const;
+
+private:
+    template <typename T>
+    std::span<const T> section(WorldSection section, uint64_t count) const {
+        const uint64_t offset = header().sections[static_cast<size_t>(section)];
+        return {reinterpret_cast<const T *>(mFile.data() + offset), static_cast<size_t>(count)};
+    }
+
+    MappedFile mFile;
+};
+
+/// @brief Maps path and copies it into config and state. width and height are set to the size of
+/// the world it was saved from. Returns false and sets error on failure, leaving the outputs as is.
+bool loadWorld(const std::string &path, Config &config, State &state, int &width, int &height, std::string &error);
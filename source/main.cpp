@@ -1,29 +1,41 @@
 #include "IApp.h"
 #include "ConfigFunctions.h"
 #include "StateFunctions.h"
+#include "WorldFile.h"
 
 #include "LayoutTestApp.h"
+#include <cstdint>
+#include <cstdio>
 #include <memory>
+#include <string>
+#include <string_view>
 
 int main(int argc, char **argv) {
 
-	constexpr int width = 1280;
-	constexpr int height = 960;
+	int width = 1280;
+	int height = 960;
 
 	constexpr int colorsCount = 6;
-	Config config;
-	config.colorsCount = colorsCount;
-	config.particleColors = generateRandomColors(config.colorsCount);
-	config.matrix = generateRandomMatrix(config.colorsCount);
-	config.minDistances = generateDistances(config.colorsCount);
-	config.forces = generateForces(config.colorsCount);
-	config.radii = generateRadii(config.colorsCount);
+	Config config = generateRandomConfig(colorsCount);
 
 	constexpr int particlesCount = 1;
 	State state = generateRandomState(particlesCount, config.colorsCount, width, height);
 
-	const std::unique_ptr<IApp> app = CreateLayoutTestApp(config, state, width, height);
+	// particles --load FILE starts from a world saved with F5 instead of a random one
+	if (argc == 3 && std::string_view(argv[1]) == "--load") {
+		std::string error;
+		if (!loadWorld(argv[2], config, state, width, height, error)) {
+			printf("%s\n", error.c_str());
+			return 1;
+		}
+		if (width < 1 || width > INT16_MAX || height < 1 || height > INT16_MAX) {
+			printf("%s: the world size %dx%d does not fit the engine\n", argv[2], width, height);
+			return 1;
+		}
+	}
+
+	const std::unique_ptr<IApp> app = CreateLayoutTestApp(config, state, static_cast<int16_t>(width), static_cast<int16_t>(height));
 
 	app->Run();
 	return 0;
-}
\ No newline at end of file
+}
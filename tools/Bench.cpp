@@ -0,0 +1,289 @@
+// Sweeps particle counts, color counts, initial layouts and update paths and prints one JSON
+// document with the cost of a step for every case.
+//
+//   particles_bench > bench.json
+//   particles_bench --particles 1000,10000 --colors 6 --layouts random --paths cells/AVX2
+
+#include "ConfigFunctions.h"
+#include "Engine.h"
+#include "Random.h"
+#include "StateFunctions.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+std::atomic<uint64_t> gAllocations = 0;
+
+struct Path {
+    Backend backend;
+    ForceKernel kernel;
+    bool halfPairs = false;
+};
+
+std::string ToString(const Path &path) {
+    std::string name = toString(path.backend);
+    if(path.backend == Backend::CellList || path.backend == Backend::Verlet || path.halfPairs) {
+        name += "/";
+        name += toString(path.kernel);
+    }
+    if(path.halfPairs) {
+        name += "/half";
+    }
+    return name;
+}
+
+/// @brief Every update path this CPU can run: each backend, the cell list once per kernel, the
+/// Verlet lists and the half pair brute force and cell list with the widest one.
+std::vector<Path> AvailablePaths() {
+    std::vector<Path> paths{Path{Backend::BruteForce, ForceKernel::Scalar}};
+    const ForceKernel widest = detectForceKernel();
+    for(const ForceKernel kernel : {ForceKernel::Scalar, ForceKernel::SSE, ForceKernel::AVX2}) {
+        paths.push_back(Path{Backend::CellList, kernel});
+        if(kernel == widest) {
+            break;
+        }
+    }
+    paths.push_back(Path{Backend::QuadTree, ForceKernel::Scalar});
+    paths.push_back(Path{Backend::Verlet, widest});
+    paths.push_back(Path{Backend::BruteForce, widest, true});
+    paths.push_back(Path{Backend::CellList, widest, true});
+    return paths;
+}
+
+struct Options {
+    std::vector<int> particles{1000, 10000, 100000, 1000000};
+    std::vector<int> colors{2, 6, 12};
+    std::vector<std::string> layouts{"random", "middle"};
+    std::vector<Path> paths = AvailablePaths();
+    int steps = 10;
+    int warmup = 2;
+    /// Cases that cost O(N^2) per step (brute force, everything starting in the middle) are skipped above this count
+    int maxQuadratic = 20000;
+    size_t threads = std::thread::hardware_concurrency();
+    unsigned seed = 1;
+};
+
+std::vector<std::string> Split(std::string_view list) {
+    std::vector<std::string> items;
+    while(!list.empty()) {
+        const size_t comma = list.find(',');
+        items.emplace_back(list.substr(0, comma));
+        list = comma == std::string_view::npos ? std::string_view{} : list.substr(comma + 1);
+    }
+    return items;
+}
+
+std::vector<int> SplitInts(std::string_view list) {
+    std::vector<int> values;
+    for(const std::string &item : Split(list)) {
+        values.push_back(std::atoi(item.c_str()));
+    }
+    return values;
+}
+
+void PrintUsage(const char *program) {
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  --particles LIST     particle counts (default 1000,10000,100000,1000000)\n"
+            "  --colors LIST        color counts (default 2,6,12)\n"
+            "  --layouts LIST       random and/or middle (default both)\n"
+            "  --paths LIST         update paths, e.g. brute,cells/AVX2,cells/AVX2/half (default: all available)\n"
+            "  --steps N            measured steps per case (default 10)\n"
+            "  --warmup N           unmeasured steps before measuring (default 2)\n"
+            "  --max-quadratic N    skip O(N^2) cases above N particles (default 20000)\n"
+            "  --threads N          worker threads including the main one (default: all cores)\n"
+            "  --seed N             random seed (default 1)\n",
+            program);
+}
+
+bool ParseOptions(int argc, char **argv, Options &options) {
+    for(int i = 1; i < argc; ++i) {
+        const std::string_view arg = argv[i];
+        if(arg == "--help" || arg == "-h" || i + 1 >= argc) {
+            return false;
+        }
+
+        const char *value = argv[++i];
+        if(arg == "--particles") {
+            options.particles = SplitInts(value);
+        } else if(arg == "--colors") {
+            options.colors = SplitInts(value);
+        } else if(arg == "--layouts") {
+            options.layouts = Split(value);
+        } else if(arg == "--paths") {
+            const std::vector<Path> available = AvailablePaths();
+            options.paths.clear();
+            for(const std::string &name : Split(value)) {
+                bool found = false;
+                for(const Path &path : available) {
+                    if(ToString(path) == name) {
+                        options.paths.push_back(path);
+                        found = true;
+                    }
+                }
+                if(!found) {
+                    fprintf(stderr, "unknown or unsupported path %s\n", name.c_str());
+                    return false;
+                }
+            }
+        } else if(arg == "--steps") {
+            options.steps = std::atoi(value);
+        } else if(arg == "--warmup") {
+            options.warmup = std::atoi(value);
+        } else if(arg == "--max-quadratic") {
+            options.maxQuadratic = std::atoi(value);
+        } else if(arg == "--threads") {
+            options.threads = static_cast<size_t>(std::atoi(value));
+        } else if(arg == "--seed") {
+            options.seed = static_cast<unsigned>(std::strtoul(value, nullptr, 10));
+        } else {
+            fprintf(stderr, "unknown option %s\n", argv[i - 1]);
+            return false;
+        }
+    }
+
+    for(const std::string &layout : options.layouts) {
+        if(layout != "random" && layout != "middle") {
+            fprintf(stderr, "unknown layout %s\n", layout.c_str());
+            return false;
+        }
+    }
+    for(const int colors : options.colors) {
+        if(colors < 1 || colors > 12) {
+            fprintf(stderr, "colors must be between 1 and 12\n");
+            return false;
+        }
+    }
+    return options.steps > 0;
+}
+
+struct Result {
+    double nsPerStep = 0;
+    double pairsPerSecond = 0;
+    double allocationsPerStep = 0;
+    /// Fraction of steps that rebuilt the Verlet lists
+    double rebuildsPerStep = 0;
+};
+
+Result RunCase(const Options &options, const Path &path, int particles, int colors, const std::string &layout) {
+    constexpr int16_t Width = 1280;
+    constexpr int16_t Height = 960;
+
+    setRandomSeed(options.seed);
+    Config config = generateRandomConfig(colors);
+    State state = layout == "middle" ? generateAllInTheMiddleState(particles, colors, Width, Height)
+                                     : generateRandomState(particles, colors, Width, Height);
+
+    Engine engine(config, state, Width, Height, options.threads);
+    engine.setBackend(path.backend);
+    engine.setForceKernel(path.kernel);
+    engine.setHalfPairs(path.halfPairs);
+    for(int step = 0; step < options.warmup; ++step) {
+        engine.step();
+    }
+
+    uint64_t pairs = 0;
+    int rebuilds = 0;
+    const uint64_t allocations = gAllocations.load();
+    const auto start = std::chrono::steady_clock::now();
+    for(int step = 0; step < options.steps; ++step) {
+        engine.step();
+        pairs += engine.lastStepStats().pairs;
+        rebuilds += engine.lastStepStats().neighbourListRebuilt;
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    Result result;
+    result.nsPerStep = seconds * 1e9 / options.steps;
+    result.pairsPerSecond = seconds > 0 ? pairs / seconds : 0;
+    result.allocationsPerStep = static_cast<double>(gAllocations.load() - allocations) / options.steps;
+    result.rebuildsPerStep = static_cast<double>(rebuilds) / options.steps;
+    return result;
+}
+} // namespace
+
+void *operator new(size_t size) {
+    gAllocations.fetch_add(1, std::memory_order_relaxed);
+    if(void *p = std::malloc(size == 0 ? 1 : size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void *operator new(size_t size, std::align_val_t alignment) {
+    gAllocations.fetch_add(1, std::memory_order_relaxed);
+    const size_t align = static_cast<size_t>(alignment);
+    if(void *p = std::aligned_alloc(align, (size + align - 1) / align * align)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+    std::free(p);
+}
+
+void operator delete(void *p, std::align_val_t) noexcept {
+    std::free(p);
+}
+
+void operator delete(void *p, size_t, std::align_val_t) noexcept {
+    std::free(p);
+}
+
+int main(int argc, char **argv) {
+    Options options;
+    if(!ParseOptions(argc, argv, options)) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+
+    printf("{\n  \"threads\": %zu,\n  \"steps\": %d,\n  \"warmup\": %d,\n  \"cases\": [", options.threads, options.steps, options.warmup);
+
+    bool first = true;
+    for(const Path &path : options.paths) {
+        for(const std::string &layout : options.layouts) {
+            for(const int colors : options.colors) {
+                for(const int particles : options.particles) {
+                    const std::string name = ToString(path);
+                    const bool quadratic = path.backend == Backend::BruteForce || layout == "middle";
+                    const bool skipped = quadratic && particles > options.maxQuadratic;
+
+                    printf("%s\n    {\"path\": \"%s\", \"particles\": %d, \"colors\": %d, \"layout\": \"%s\"",
+                           first ? "" : ",", name.c_str(), particles, colors, layout.c_str());
+                    first = false;
+
+                    if(skipped) {
+                        printf(", \"skipped\": true}");
+                        continue;
+                    }
+
+                    fprintf(stderr, "%s %s colors=%d particles=%d\n", name.c_str(), layout.c_str(), colors, particles);
+                    const Result result = RunCase(options, path, particles, colors, layout);
+                    printf(", \"ns_per_step\": %.0f, \"pairs_per_second\": %.0f, \"allocations_per_step\": %.2f",
+                           result.nsPerStep, result.pairsPerSecond, result.allocationsPerStep);
+                    if(path.backend == Backend::Verlet) {
+                        printf(", \"rebuilds_per_step\": %.3f", result.rebuildsPerStep);
+                    }
+                    printf("}");
+                    fflush(stdout);
+                }
+            }
+        }
+    }
+
+    printf("\n  ]\n}\n");
+    return 0;
+}
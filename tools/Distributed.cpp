@@ -0,0 +1,186 @@
+// Runs the simulation split over several worker processes and compares it with a single engine.
+//
+//   particles_distributed --particles 20000 --workers 4 --transport shm --steps 100 --check 1
+//   particles_distributed --particles 20000 --workers 4 --transport socket --steps 100
+
+#include "ConfigFunctions.h"
+#include "Distributed.h"
+#include "Engine.h"
+#include "Random.h"
+#include "StateFunctions.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+struct Options {
+    int particles = 10000;
+    int colors = 6;
+    int steps = 100;
+    unsigned seed = 1;
+    int width = 1280;
+    int height = 960;
+    DistributedSettings settings;
+    /// Also runs a single engine from the same seed and compares the positions
+    bool check = false;
+    /// Largest position difference to a single engine the check accepts, in pixels
+    float tolerance = 0.01f;
+};
+
+void PrintUsage(const char *program) {
+    printf("usage: %s [options]\n"
+           "  --particles N    number of particles (default 10000)\n"
+           "  --colors N       number of colors, 1 to 12 (default 6)\n"
+           "  --steps N        number of steps to run (default 100)\n"
+           "  --seed N         random seed (default 1)\n"
+           "  --workers N      worker processes, one vertical strip each (default 2)\n"
+           "  --transport NAME shm or socket (default shm)\n"
+           "  --backend NAME   brute, cells or quadtree (default cells)\n"
+           "  --threads N      threads of every worker (default 1)\n"
+           "  --width N        world width (default 1280)\n"
+           "  --height N       world height (default 960)\n"
+           "  --check 0|1      compare with a single engine run from the same seed (default 0)\n"
+           "  --tolerance F    largest position difference the check accepts, in pixels (default 0.01)\n"
+           "The forces are summed in another order than in a single engine, the rounding differences\n"
+           "grow with every step, so check short runs: a missing halo shows within a few steps.\n",
+           program);
+}
+
+bool ParseOptions(int argc, char **argv, Options &options) {
+    for(int i = 1; i < argc; ++i) {
+        const std::string_view arg = argv[i];
+        if(arg == "--help" || arg == "-h") {
+            return false;
+        }
+        if(i + 1 >= argc) {
+            fprintf(stderr, "missing value for %s\n", argv[i]);
+            return false;
+        }
+
+        const char *value = argv[++i];
+        if(arg == "--particles") {
+            options.particles = std::atoi(value);
+        } else if(arg == "--colors") {
+            options.colors = std::atoi(value);
+        } else if(arg == "--steps") {
+            options.steps = std::atoi(value);
+        } else if(arg == "--seed") {
+            options.seed = static_cast<unsigned>(std::strtoul(value, nullptr, 10));
+        } else if(arg == "--workers") {
+            options.settings.workers = std::atoi(value);
+        } else if(arg == "--transport") {
+            if(!parseTransport(value, options.settings.transport)) {
+                fprintf(stderr, "unknown transport %s\n", value);
+                return false;
+            }
+        } else if(arg == "--backend") {
+            if(!parseBackend(value, options.settings.backend)) {
+                fprintf(stderr, "unknown backend %s\n", value);
+                return false;
+            }
+        } else if(arg == "--threads") {
+            options.settings.threadsPerWorker = static_cast<size_t>(std::atoi(value));
+        } else if(arg == "--width") {
+            options.width = std::atoi(value);
+        } else if(arg == "--height") {
+            options.height = std::atoi(value);
+        } else if(arg == "--check") {
+            options.check = std::atoi(value) != 0;
+        } else if(arg == "--tolerance") {
+            options.tolerance = static_cast<float>(std::atof(value));
+        } else {
+            fprintf(stderr, "unknown option %s\n", argv[i - 1]);
+            return false;
+        }
+    }
+
+    if(options.colors < 1 || options.colors > 12 || options.particles < 0 || options.steps < 0 || options.settings.workers < 1) {
+        fprintf(stderr, "invalid particles, colors, steps or workers\n");
+        return false;
+    }
+    // The engine keeps the world size in 16 bits.
+    if(options.width < 1 || options.width > INT16_MAX || options.height < 1 || options.height > INT16_MAX) {
+        fprintf(stderr, "the world size %dx%d is not within 1x1 and %dx%d\n", options.width, options.height, INT16_MAX, INT16_MAX);
+        return false;
+    }
+    return true;
+}
+} // namespace
+
+int main(int argc, char **argv) {
+    Options options;
+    if(!ParseOptions(argc, argv, options)) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+
+    setRandomSeed(options.seed);
+    Config config = generateRandomConfig(options.colors);
+    const State initial = generateRandomState(options.particles, options.colors, options.width, options.height);
+
+    printf("particles=%d colors=%d steps=%d seed=%u workers=%d transport=%s backend=%s threads=%zu\n", options.particles,
+           options.colors, options.steps, options.seed, options.settings.workers, toString(options.settings.transport),
+           toString(options.settings.backend), options.settings.threadsPerWorker);
+
+    // The workers are forked before this process starts any thread of its own.
+    State distributed = initial;
+    DistributedStats stats;
+    std::string error;
+    if(!runDistributed(config, distributed, static_cast<int16_t>(options.width), static_cast<int16_t>(options.height), options.steps,
+                       options.settings, stats, error)) {
+        fprintf(stderr, "%s\n", error.c_str());
+        return 1;
+    }
+    printf("steps/sec: %.2f (%.3f s total)\n", stats.seconds > 0 ? options.steps / stats.seconds : 0.0, stats.seconds);
+    printf("halo particles: %.1f per step, migrations: %.1f per step\n",
+           options.steps > 0 ? static_cast<double>(stats.haloParticles) / options.steps : 0.0,
+           options.steps > 0 ? static_cast<double>(stats.migrations) / options.steps : 0.0);
+    const StateChecksum sum = checksum(distributed);
+    printf("checksum colors=%016" PRIx64 " pos=%016" PRIx64 " vel=%016" PRIx64 "\n", sum.colors, sum.pos, sum.vel);
+
+    if(!options.check) {
+        return 0;
+    }
+
+    State single = initial;
+    Engine engine(config, single, static_cast<int16_t>(options.width), static_cast<int16_t>(options.height),
+                  options.settings.threadsPerWorker * options.settings.workers);
+    engine.setBackend(options.settings.backend);
+    const auto start = std::chrono::steady_clock::now();
+    for(int step = 0; step < options.steps; ++step) {
+        engine.step();
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // Both are compared by id, the engine reorders its particles.
+    std::vector<Position> byId(single.nextId);
+    for(size_t i = 0; i < single.pos.size(); ++i) {
+        byId[single.ids[i]] = single.pos[i];
+    }
+    float maxDifference = 0;
+    for(size_t i = 0; i < distributed.pos.size(); ++i) {
+        const Position expected = byId[distributed.ids[i]];
+        // Across the periodic edges a small move shows up as almost the world size.
+        float dx = std::abs(distributed.pos[i].x - expected.x);
+        float dy = std::abs(distributed.pos[i].y - expected.y);
+        dx = std::min(dx, options.width - dx);
+        dy = std::min(dy, options.height - dy);
+        maxDifference = std::max(maxDifference, std::max(dx, dy));
+    }
+    printf("single engine: %.2f steps/sec, largest position difference %.6f pixels\n", seconds > 0 ? options.steps / seconds : 0.0,
+           maxDifference);
+    if(maxDifference > options.tolerance) {
+        fprintf(stderr, "the distributed run differs from the single engine by more than %g pixels\n", options.tolerance);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,301 @@
+// Runs the simulation without a window and reports its throughput and final state.
+//
+//   particles_headless --particles 100000 --colors 6 --steps 200 --seed 1 --layout random --backend cells
+//   particles_headless --particles 1000000 --steps 500 --save warm.world && particles_headless --load warm.world
+//   particles_headless --particles 100000 --steps 100000 --publish /particles & particles_state_stats --name /particles
+
+#include "ConfigFunctions.h"
+#include "Engine.h"
+#include "Profiler.h"
+#include "Random.h"
+#include "StateFunctions.h"
+#include "Trajectory.h"
+#include "WorldFile.h"
+#if PARTICLES_SHARED_STATE
+#include "SharedState.h"
+#endif
+
+#include <chrono>
+#include <cstdint>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+namespace {
+
+struct Options {
+    int particles = 10000;
+    int colors = 6;
+    int steps = 100;
+    unsigned seed = 1;
+    std::string layout = "random";
+    Backend backend = Backend::CellList;
+    bool halfPairs = false;
+    /// Still steps after which a particle falls asleep, 0 keeps every particle awake
+    int sleep = 0;
+    size_t threads = std::thread::hardware_concurrency();
+    int width = 1280;
+    int height = 960;
+    /// World file to start from instead of a generated world, and to write the final world to
+    std::string load;
+    std::string save;
+    /// Trajectory file every step is recorded to
+    std::string record;
+    /// Chrome trace of the profiled phases of the run
+    std::string trace;
+    /// Shared memory name every step is published to, and the slots of its ring
+    std::string publish;
+    int publishSlots = 4;
+};
+
+void PrintUsage(const char *program) {
+    printf("usage: %s [options]\n"
+           "  --particles N    number of particles (default 10000)\n"
+           "  --colors N       number of colors, 1 to 12 (default 6)\n"
+           "  --steps N        number of steps to run (default 100)\n"
+           "  --seed N         random seed (default 1)\n"
+           "  --layout NAME    initial layout: random or middle (default random)\n"
+           "  --backend NAME   brute, cells, quadtree or verlet (default cells)\n"
+           "  --pairs MODE     full or half, half evaluates every pair once (brute and cells, default full)\n"
+           "  --sleep N        particles still for N steps fall asleep (cells, default 0: never)\n"
+           "  --threads N      worker threads including the main one (default: all cores)\n"
+           "  --width N        world width (default 1280)\n"
+           "  --height N       world height (default 960)\n"
+           "  --load FILE      start from a saved world, ignores particles, colors, layout, width and height\n"
+           "  --save FILE      save the world after the last step\n"
+           "  --record FILE    record the trajectory of every step\n"
+           "  --trace FILE     write the profiled phases of the run as a Chrome trace\n"
+           "  --publish NAME   publish every step to the shared memory NAME, e.g. /particles\n"
+           "  --publish-slots N  frames the shared memory ring holds (default 4)\n",
+           program);
+}
+
+/// The engine keeps the world size in 16 bits
+bool ValidWorldSize(int width, int height) {
+    if(width < 1 || width > INT16_MAX || height < 1 || height > INT16_MAX) {
+        fprintf(stderr, "the world size %dx%d is not within 1x1 and %dx%d\n", width, height, INT16_MAX, INT16_MAX);
+        return false;
+    }
+    return true;
+}
+
+bool ParseOptions(int argc, char **argv, Options &options) {
+    for(int i = 1; i < argc; ++i) {
+        const std::string_view arg = argv[i];
+        if(arg == "--help" || arg == "-h") {
+            return false;
+        }
+        if(i + 1 >= argc) {
+            fprintf(stderr, "missing value for %s\n", argv[i]);
+            return false;
+        }
+
+        const char *value = argv[++i];
+        if(arg == "--particles") {
+            options.particles = std::atoi(value);
+        } else if(arg == "--colors") {
+            options.colors = std::atoi(value);
+        } else if(arg == "--steps") {
+            options.steps = std::atoi(value);
+        } else if(arg == "--seed") {
+            options.seed = static_cast<unsigned>(std::strtoul(value, nullptr, 10));
+        } else if(arg == "--layout") {
+            options.layout = value;
+        } else if(arg == "--backend") {
+            if(!parseBackend(value, options.backend)) {
+                fprintf(stderr, "unknown backend %s\n", value);
+                return false;
+            }
+        } else if(arg == "--pairs") {
+            if(std::string_view(value) != "full" && std::string_view(value) != "half") {
+                fprintf(stderr, "unknown pairs mode %s\n", value);
+                return false;
+            }
+            options.halfPairs = std::string_view(value) == "half";
+        } else if(arg == "--sleep") {
+            options.sleep = std::atoi(value);
+        } else if(arg == "--threads") {
+            options.threads = static_cast<size_t>(std::atoi(value));
+        } else if(arg == "--width") {
+            options.width = std::atoi(value);
+        } else if(arg == "--height") {
+            options.height = std::atoi(value);
+        } else if(arg == "--load") {
+            options.load = value;
+        } else if(arg == "--save") {
+            options.save = value;
+        } else if(arg == "--record") {
+            options.record = value;
+        } else if(arg == "--trace") {
+            options.trace = value;
+        } else if(arg == "--publish") {
+            options.publish = value;
+        } else if(arg == "--publish-slots") {
+            options.publishSlots = std::atoi(value);
+        } else {
+            fprintf(stderr, "unknown option %s\n", argv[i - 1]);
+            return false;
+        }
+    }
+
+    if(options.layout != "random" && options.layout != "middle") {
+        fprintf(stderr, "unknown layout %s\n", options.layout.c_str());
+        return false;
+    }
+    if(options.colors < 1 || options.colors > 12 || options.particles < 0 || options.steps < 0 || options.sleep < 0) {
+        fprintf(stderr, "invalid particles, colors or steps\n");
+        return false;
+    }
+    if(options.publishSlots < 2) {
+        fprintf(stderr, "the shared memory ring needs at least 2 slots\n");
+        return false;
+    }
+    return ValidWorldSize(options.width, options.height);
+}
+} // namespace
+
+int main(int argc, char **argv) {
+    Options options;
+    if(!ParseOptions(argc, argv, options)) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+
+    setRandomSeed(options.seed);
+
+    Config config;
+    State state;
+    if(options.load.empty()) {
+        config = generateRandomConfig(options.colors);
+        state = options.layout == "middle" ? generateAllInTheMiddleState(options.particles, options.colors, options.width, options.height)
+                                           : generateRandomState(options.particles, options.colors, options.width, options.height);
+    } else {
+        std::string error;
+        const auto loadStart = std::chrono::steady_clock::now();
+        if(!loadWorld(options.load, config, state, options.width, options.height, error)) {
+            fprintf(stderr, "%s\n", error.c_str());
+            return 1;
+        }
+        if(!ValidWorldSize(options.width, options.height)) {
+            return 1;
+        }
+        const double loadSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - loadStart).count();
+        printf("loaded %s in %.3f s\n", options.load.c_str(), loadSeconds);
+        options.particles = static_cast<int>(state.pos.size());
+        options.colors = config.colorsCount;
+        options.layout = "file";
+    }
+
+    Engine engine(config, state, static_cast<int16_t>(options.width), static_cast<int16_t>(options.height), options.threads);
+    engine.setBackend(options.backend);
+    engine.setHalfPairs(options.halfPairs);
+    if(options.sleep > 0) {
+        engine.setSleepSettings(SleepSettings{.enabled = true, .steps = options.sleep});
+    }
+
+    printf("particles=%d colors=%d steps=%d seed=%u layout=%s backend=%s threads=%zu kernel=%s\n",
+           options.particles, options.colors, options.steps, options.seed, options.layout.c_str(),
+           toString(engine.backend()), engine.threadsCount(), toString(engine.forceKernel()));
+
+    TrajectoryRecorder recorder;
+    if(!options.record.empty()) {
+        std::string error;
+        if(!recorder.open(options.record, options.width, options.height, error)) {
+            fprintf(stderr, "%s\n", error.c_str());
+            return 1;
+        }
+    }
+
+#if PARTICLES_SHARED_STATE
+    StatePublisher publisher;
+    const uint64_t publishedConfig = configHash(config);
+    if(!options.publish.empty()) {
+        std::string error;
+        if(!publisher.open(options.publish, state.pos.size(), options.width, options.height, error, static_cast<uint32_t>(options.publishSlots))) {
+            fprintf(stderr, "%s\n", error.c_str());
+            return 1;
+        }
+    }
+#else
+    if(!options.publish.empty()) {
+        fprintf(stderr, "this build cannot publish to shared memory\n");
+        return 1;
+    }
+#endif
+
+    int rebuilds = 0;
+    double awake = 0;
+    std::chrono::steady_clock::duration recording{};
+    std::chrono::steady_clock::duration publishing{};
+    const auto start = std::chrono::steady_clock::now();
+    for(int step = 0; step < options.steps; ++step) {
+        engine.step();
+        rebuilds += engine.lastStepStats().neighbourListRebuilt;
+        awake += engine.lastStepStats().awakeFraction();
+        if(recorder.isOpen()) {
+            const auto recordStart = std::chrono::steady_clock::now();
+            recorder.record(state, static_cast<uint64_t>(step) + 1);
+            recording += std::chrono::steady_clock::now() - recordStart;
+        }
+#if PARTICLES_SHARED_STATE
+        if(publisher.isOpen()) {
+            const auto publishStart = std::chrono::steady_clock::now();
+            publisher.publish(state, static_cast<uint64_t>(step) + 1, publishedConfig);
+            publishing += std::chrono::steady_clock::now() - publishStart;
+        }
+#endif
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("steps/sec: %.2f (%.3f s total)\n", seconds > 0 ? options.steps / seconds : 0.0, seconds);
+    if(engine.backend() == Backend::Verlet) {
+        printf("neighbour list rebuilds: %d of %d steps (%.1f%%)\n", rebuilds, options.steps, 100.0 * rebuilds / options.steps);
+    }
+    if(engine.sleepSettings().enabled && options.steps > 0) {
+        printf("awake: %.1f%% of the particles on average, %.1f%% in the last step\n", 100 * awake / options.steps,
+               100.0 * engine.lastStepStats().awakeFraction());
+    }
+    if(recorder.isOpen()) {
+        recorder.close();
+        const double recordSeconds = std::chrono::duration<double>(recording).count();
+        const double rawBytes = static_cast<double>(recorder.framesWritten()) * state.pos.size() * sizeof(Position);
+        printf("recorded %" PRIu64 " frames (%" PRIu64 " dropped), %.1f MB, %.1fx smaller than raw positions, %.2f%% of the run spent recording\n",
+               recorder.framesWritten(), recorder.framesDropped(), recorder.bytesWritten() / 1e6,
+               recorder.bytesWritten() > 0 ? rawBytes / recorder.bytesWritten() : 0.0, seconds > 0 ? 100 * recordSeconds / seconds : 0.0);
+    }
+#if PARTICLES_SHARED_STATE
+    if(publisher.isOpen()) {
+        publisher.close();
+        const double publishSeconds = std::chrono::duration<double>(publishing).count();
+        printf("published %" PRIu64 " frames (%" PRIu64 " dropped), %.2f%% of the run spent publishing\n", publisher.framesPublished(),
+               publisher.framesDropped(), seconds > 0 ? 100 * publishSeconds / seconds : 0.0);
+    }
+#endif
+
+    if(!options.trace.empty()) {
+        const std::vector<ProfileEvent> events = collectProfileEvents(0);
+        std::string error;
+        if(!writeChromeTrace(options.trace, events, error)) {
+            fprintf(stderr, "%s\n", error.c_str());
+            return 1;
+        }
+        for(const ProfilePhaseStats &phase : profilePhaseStats(events)) {
+            printf("%-32s n=%-6zu p50=%.3f ms p95=%.3f ms p99=%.3f ms\n", phase.name, phase.count, phase.p50, phase.p95, phase.p99);
+        }
+    }
+
+    const StateChecksum sum = checksum(state);
+    printf("checksum colors=%016" PRIx64 " pos=%016" PRIx64 " vel=%016" PRIx64 "\n", sum.colors, sum.pos, sum.vel);
+
+    if(!options.save.empty()) {
+        std::string error;
+        if(!saveWorld(options.save, config, state, options.width, options.height, error)) {
+            fprintf(stderr, "%s\n", error.c_str());
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,161 @@
+// Renders the same state with one SDL_RenderTexture per particle, with the batched
+// ParticleRenderer, with the SplatRasterizer writing into a streaming texture and as the
+// DensityRenderer's density map, all into an offscreen software renderer, and prints the cost
+// of a frame for each.
+//
+//   particles_render_bench [--particles 1000,10000,100000] [--frames 20]
+
+#include "ConfigFunctions.h"
+#include "DensityRenderer.h"
+#include "ParticleRenderer.h"
+#include "SplatRasterizer.h"
+#include "StateFunctions.h"
+
+#include <chrono>
+#include <cstdio>
+#include <algorithm>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <SDL3/SDL.h>
+
+namespace {
+
+constexpr int Width = 1024;
+constexpr int Height = 1024;
+constexpr int SpriteSize = 16;
+
+/// @brief White disc with a soft edge, stands in for res/circle.png so no image loader is needed.
+SDL_Texture *CreateSprite(SDL_Renderer *renderer) {
+    SDL_Surface *surface = SDL_CreateSurface(SpriteSize, SpriteSize, SDL_PIXELFORMAT_RGBA32);
+    for(int y = 0; y < SpriteSize; ++y) {
+        Uint32 *row = reinterpret_cast<Uint32 *>(static_cast<Uint8 *>(surface->pixels) + y * surface->pitch);
+        for(int x = 0; x < SpriteSize; ++x) {
+            const float dx = x + 0.5f - SpriteSize / 2.0f;
+            const float dy = y + 0.5f - SpriteSize / 2.0f;
+            const float alpha = SDL_clamp(SpriteSize / 2.0f - SDL_sqrtf(dx * dx + dy * dy), 0.0f, 1.0f);
+            row[x] = SDL_MapSurfaceRGBA(surface, 255, 255, 255, static_cast<Uint8>(255 * alpha));
+        }
+    }
+    SDL_Texture *texture = SDL_CreateTextureFromSurface(renderer, surface);
+    SDL_DestroySurface(surface);
+    return texture;
+}
+
+/// @brief Rasterizes the particles into a streaming texture and draws it over the whole target.
+void RenderSplats(SDL_Renderer *renderer, SDL_Texture *texture, SplatRasterizer &rasterizer, const Config &config, const State &state) {
+    void *pixels = nullptr;
+    int pitch = 0;
+    if(!SDL_LockTexture(texture, nullptr, &pixels, &pitch)) {
+        return;
+    }
+    rasterizer.render(PixelBuffer{static_cast<Uint8 *>(pixels), pitch, Width, Height}, config, state.colors, state.pos);
+    SDL_UnlockTexture(texture);
+    SDL_RenderTexture(renderer, texture, nullptr, nullptr);
+}
+
+/// @brief Draws the density of the particles into a streaming texture of one texel per tile and
+/// stretches it over the whole target.
+void RenderDensity(SDL_Renderer *renderer, SDL_Texture *texture, DensityRenderer &density, const Config &config, const State &state) {
+    void *pixels = nullptr;
+    int pitch = 0;
+    if(!SDL_LockTexture(texture, nullptr, &pixels, &pitch)) {
+        return;
+    }
+    density.render(PixelBuffer{static_cast<Uint8 *>(pixels), pitch, texture->w, texture->h}, Width, Height, config, state.colors,
+                   state.pos);
+    SDL_UnlockTexture(texture);
+    SDL_RenderTexture(renderer, texture, nullptr, nullptr);
+}
+
+/// @brief The drawing loop the app used before batching: a color mod and a copy per particle.
+void RenderPerSprite(SDL_Renderer *renderer, SDL_Texture *sprite, const Config &config, const State &state) {
+    const float size = static_cast<float>(config.particleSize);
+    for(size_t i = 0; i < state.pos.size(); ++i) {
+        const Rgb rgb = config.particleColors[state.colors[i]];
+        const SDL_FRect dst{state.pos[i].x - size / 2, state.pos[i].y - size / 2, size, size};
+        SDL_SetTextureColorModFloat(sprite, rgb.r, rgb.g, rgb.b);
+        SDL_RenderTexture(renderer, sprite, nullptr, &dst);
+    }
+}
+
+template<typename F>
+double MillisecondsPerFrame(SDL_Renderer *renderer, int frames, F &&render) {
+    const auto start = std::chrono::steady_clock::now();
+    for(int frame = 0; frame < frames; ++frame) {
+        SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+        SDL_RenderClear(renderer);
+        render();
+        SDL_RenderPresent(renderer);
+    }
+    const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / frames;
+}
+
+std::vector<int> SplitInts(std::string_view list) {
+    std::vector<int> values;
+    while(!list.empty()) {
+        const size_t comma = list.find(',');
+        values.push_back(std::atoi(std::string(list.substr(0, comma)).c_str()));
+        list = comma == std::string_view::npos ? std::string_view{} : list.substr(comma + 1);
+    }
+    return values;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    std::vector<int> particles{1000, 10000, 100000};
+    int frames = 20;
+
+    for(int i = 1; i + 1 < argc; i += 2) {
+        const std::string_view name = argv[i];
+        if(name == "--particles") {
+            particles = SplitInts(argv[i + 1]);
+        } else if(name == "--frames") {
+            frames = std::max(1, std::atoi(argv[i + 1]));
+        } else {
+            std::fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    SDL_Surface *target = SDL_CreateSurface(Width, Height, SDL_PIXELFORMAT_RGBA32);
+    SDL_Renderer *renderer = target ? SDL_CreateSoftwareRenderer(target) : nullptr;
+    if(!renderer) {
+        std::fprintf(stderr, "cannot create the software renderer: %s\n", SDL_GetError());
+        return 1;
+    }
+    SDL_Texture *sprite = CreateSprite(renderer);
+
+    Config config = generateRandomConfig(6);
+    ParticleRenderer batched;
+    SplatRasterizer rasterizer;
+    SDL_Texture *splatTexture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STREAMING, Width, Height);
+    DensityRenderer density;
+    SDL_Texture *densityTexture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STREAMING,
+                                                    Width / DensityRenderer::TileSize, Height / DensityRenderer::TileSize);
+
+    std::printf("%10s %16s %16s %16s %16s\n", "particles", "per sprite ms", "batched ms", "splats ms", "density ms");
+    for(const int count : particles) {
+        State state = generateRandomState(count, config.colorsCount, Width, Height);
+        const double perSprite =
+            MillisecondsPerFrame(renderer, frames, [&] { RenderPerSprite(renderer, sprite, config, state); });
+        const double geometry =
+            MillisecondsPerFrame(renderer, frames, [&] { batched.render(renderer, sprite, config, state); });
+        const double splats =
+            MillisecondsPerFrame(renderer, frames, [&] { RenderSplats(renderer, splatTexture, rasterizer, config, state); });
+        const double densityMap =
+            MillisecondsPerFrame(renderer, frames, [&] { RenderDensity(renderer, densityTexture, density, config, state); });
+        std::printf("%10d %16.3f %16.3f %16.3f %16.3f\n", count, perSprite, geometry, splats, densityMap);
+    }
+
+    SDL_DestroyTexture(densityTexture);
+    SDL_DestroyTexture(splatTexture);
+    SDL_DestroyTexture(sprite);
+    SDL_DestroyRenderer(renderer);
+    SDL_DestroySurface(target);
+    return 0;
+}
@@ -0,0 +1,163 @@
+// Attaches to the live state a simulation publishes to shared memory and prints statistics of
+// every frame it gets to, without slowing the simulation down.
+//
+//   particles_headless --particles 100000 --steps 100000 --publish /particles &
+//   particles_state_stats --name /particles --frames 100
+
+#include "SharedState.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct Options {
+    std::string name = "/particles";
+    /// Frames to read before exiting, 0 reads until the publisher closes the stream
+    uint64_t frames = 0;
+    /// Seconds to wait for the stream to appear
+    double wait = 10;
+};
+
+/// Largest color index counted separately, higher ones are counted as the last
+constexpr int MaxColors = 64;
+
+void PrintUsage(const char *program) {
+    printf("usage: %s [options]\n"
+           "  --name NAME      shared memory the simulation publishes to (default /particles)\n"
+           "  --frames N       frames to read, 0 until the simulation stops (default 0)\n"
+           "  --wait S         seconds to wait for the simulation to start publishing (default 10)\n",
+           program);
+}
+
+bool ParseOptions(int argc, char **argv, Options &options) {
+    for(int i = 1; i < argc; ++i) {
+        const std::string_view arg = argv[i];
+        if(arg == "--help" || arg == "-h") {
+            return false;
+        }
+        if(i + 1 >= argc) {
+            fprintf(stderr, "missing value for %s\n", argv[i]);
+            return false;
+        }
+
+        const char *value = argv[++i];
+        if(arg == "--name") {
+            options.name = value;
+        } else if(arg == "--frames") {
+            options.frames = std::strtoull(value, nullptr, 10);
+        } else if(arg == "--wait") {
+            options.wait = std::atof(value);
+        } else {
+            fprintf(stderr, "unknown option %s\n", argv[i - 1]);
+            return false;
+        }
+    }
+    return true;
+}
+
+struct FrameStats {
+    double meanSpeed = 0;
+    double maxSpeed = 0;
+    double kineticEnergy = 0;
+    std::vector<size_t> colors;
+};
+
+/// Reads the frame in place, the result only holds if the frame is still valid afterwards
+void Measure(const SharedStateReader::Frame &frame, FrameStats &stats) {
+    stats = FrameStats{};
+    stats.colors.assign(MaxColors, 0);
+    double speeds = 0;
+    for(const Velocity &vel : frame.vel) {
+        const double speedSq = static_cast<double>(vel.x) * vel.x + static_cast<double>(vel.y) * vel.y;
+        speeds += std::sqrt(speedSq);
+        stats.maxSpeed = std::max(stats.maxSpeed, speedSq);
+        stats.kineticEnergy += speedSq / 2;
+    }
+    stats.maxSpeed = std::sqrt(stats.maxSpeed);
+    stats.meanSpeed = frame.vel.empty() ? 0.0 : speeds / frame.vel.size();
+    for(const int32_t color : frame.colors) {
+        ++stats.colors[std::clamp(color, 0, MaxColors - 1)];
+    }
+    while(!stats.colors.empty() && stats.colors.back() == 0) {
+        stats.colors.pop_back();
+    }
+}
+} // namespace
+
+int main(int argc, char **argv) {
+    Options options;
+    if(!ParseOptions(argc, argv, options)) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+
+    SharedStateReader reader;
+    std::string error;
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<double>(options.wait);
+    while(!reader.open(options.name, error)) {
+        if(std::chrono::steady_clock::now() >= deadline) {
+            fprintf(stderr, "%s\n", error.c_str());
+            return 1;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    printf("attached to %s: %dx%d world, %u slots\n", options.name.c_str(), reader.width(), reader.height(), reader.slotsCount());
+
+    // Start from the newest frame, the older ones are history.
+    uint64_t next = std::max<uint64_t>(reader.published(), 1) - 1;
+    uint64_t read = 0;
+    uint64_t skipped = 0;
+    uint64_t torn = 0;
+    uint64_t lastConfig = 0;
+    FrameStats stats;
+    while(options.frames == 0 || read < options.frames) {
+        const uint64_t published = reader.published();
+        if(published <= next) {
+            if(reader.closed()) {
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+
+        // Always take the newest frame, a slow reader skips rather than falls behind.
+        const uint64_t frame = published - 1;
+        skipped += frame - next;
+        next = published;
+        SharedStateReader::Frame view;
+        if(!reader.read(frame, view)) {
+            ++torn;
+            continue;
+        }
+        Measure(view, stats);
+        if(!reader.valid(view)) {
+            ++torn;
+            continue;
+        }
+
+        ++read;
+        if(view.configHash != lastConfig) {
+            printf("config %016" PRIx64 "\n", view.configHash);
+            lastConfig = view.configHash;
+        }
+        printf("step %-8" PRIu64 " particles=%zu mean speed=%.4f max speed=%.4f kinetic energy=%.2f colors=", view.step, view.pos.size(),
+               stats.meanSpeed, stats.maxSpeed, stats.kineticEnergy);
+        for(size_t c = 0; c < stats.colors.size(); ++c) {
+            printf("%s%zu", c > 0 ? "/" : "", stats.colors[c]);
+        }
+        printf("\n");
+    }
+
+    printf("read %" PRIu64 " frames, skipped %" PRIu64 " the simulation published meanwhile, %" PRIu64 " overwritten while read\n", read,
+           skipped, torn);
+    return 0;
+}
@@ -0,0 +1,322 @@
+// Compares keeping the particles in the plain State vectors with keeping them as components of an
+// entt::registry (EnttParticles) and prints one JSON document with, for every particle count:
+//   iterate  ns per particle of a move loop over positions and velocities, plain and with 10% of
+//            the particles tagged as pinned and skipped
+//   churn    ns per round of a brush spawning particles in a disc and erasing the previous disc
+//   step     ns of an engine step on the State, and on a State gathered from the registry and
+//            scattered back
+//   memory   bytes per particle
+// The world grows with the particle count so the density, and the cost of a step per particle,
+// stays the same.
+//
+//   particles_storage_bench > storage.json
+//   particles_storage_bench --particles 10000,100000 --steps 20
+
+#include "ConfigFunctions.h"
+#include "Engine.h"
+#include "EnttParticles.h"
+#include "ParticlePool.h"
+#include "Physics.h"
+#include "Random.h"
+#include "StateFunctions.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+constexpr int Colors = 6;
+/// Particles in a 1280x960 world, the world grows with the particle count from there
+constexpr double Density = 1000;
+
+using Clock = std::chrono::steady_clock;
+
+/// Tag of the particles skipped by the move loop
+struct Pinned {};
+
+struct Options {
+    std::vector<int> particles{1000, 10000, 100000};
+    /// Passes of the move loop per case
+    int passes = 50;
+    /// Spawn and erase rounds of the churn case
+    int rounds = 200;
+    /// Particles spawned per round
+    int brush = 1000;
+    int steps = 10;
+    size_t threads = std::thread::hardware_concurrency();
+    unsigned seed = 1;
+};
+
+std::vector<int> SplitInts(std::string_view list) {
+    std::vector<int> values;
+    while(!list.empty()) {
+        const size_t comma = list.find(',');
+        values.push_back(std::atoi(std::string(list.substr(0, comma)).c_str()));
+        list = comma == std::string_view::npos ? std::string_view{} : list.substr(comma + 1);
+    }
+    return values;
+}
+
+void PrintUsage(const char *program) {
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  --particles LIST     particle counts (default 1000,10000,100000)\n"
+            "  --passes N           passes of the move loop (default 50)\n"
+            "  --rounds N           spawn and erase rounds (default 200)\n"
+            "  --brush N            particles spawned per round (default 1000)\n"
+            "  --steps N            measured engine steps (default 10)\n"
+            "  --threads N          worker threads including the main one (default: all cores)\n"
+            "  --seed N             random seed (default 1)\n",
+            program);
+}
+
+bool ParseOptions(int argc, char **argv, Options &options) {
+    for(int i = 1; i < argc; ++i) {
+        const std::string_view arg = argv[i];
+        if(arg == "--help" || arg == "-h" || i + 1 >= argc) {
+            return false;
+        }
+
+        const char *value = argv[++i];
+        if(arg == "--particles") {
+            options.particles = SplitInts(value);
+        } else if(arg == "--passes") {
+            options.passes = std::atoi(value);
+        } else if(arg == "--rounds") {
+            options.rounds = std::atoi(value);
+        } else if(arg == "--brush") {
+            options.brush = std::atoi(value);
+        } else if(arg == "--steps") {
+            options.steps = std::atoi(value);
+        } else if(arg == "--threads") {
+            options.threads = static_cast<size_t>(std::atoi(value));
+        } else if(arg == "--seed") {
+            options.seed = static_cast<unsigned>(std::strtoul(value, nullptr, 10));
+        } else {
+            fprintf(stderr, "unknown option %s\n", argv[i - 1]);
+            return false;
+        }
+    }
+    for(const int particles : options.particles) {
+        if(particles < 1) {
+            fprintf(stderr, "particle counts must be positive\n");
+            return false;
+        }
+    }
+    return options.passes > 0 && options.rounds > 0 && options.brush > 0 && options.steps > 0;
+}
+
+struct World {
+    int16_t width;
+    int16_t height;
+};
+
+World WorldFor(int particles) {
+    const double scale = std::clamp(std::sqrt(particles / Density), 1.0, 25.0);
+    return World{static_cast<int16_t>(1280 * scale), static_cast<int16_t>(960 * scale)};
+}
+
+double Seconds(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+void Move(Position &pos, Velocity &vel, World world) {
+    vel.x *= 0.99f;
+    vel.y *= 0.99f;
+    pos.x = wrapFloat(pos.x + vel.x, world.width);
+    pos.y = wrapFloat(pos.y + vel.y, world.height);
+}
+
+State RandomState(const Options &options, int particles, World world) {
+    setRandomSeed(options.seed);
+    State state = generateRandomState(particles, Colors, world.width, world.height);
+    Random random(options.seed);
+    for(Velocity &vel : state.vel) {
+        vel = Velocity{random.uniform(-1, 1), random.uniform(-1, 1)};
+    }
+    return state;
+}
+
+size_t StateBytes(const State &state) {
+    return state.colors.capacity() * sizeof(int) + state.pos.capacity() * sizeof(Position) + state.vel.capacity() * sizeof(Velocity) +
+           state.ids.capacity() * sizeof(uint32_t);
+}
+
+void RunIterate(const Options &options, int particles) {
+    const World world = WorldFor(particles);
+    State state = RandomState(options, particles, world);
+    EnttParticles entt(world.width, world.height);
+    entt.load(state);
+
+    // Every tenth particle is pinned, the same ones in both storages.
+    std::vector<uint8_t> pinned(state.pos.size());
+    for(size_t i = 0; i < pinned.size(); i += 10) {
+        pinned[i] = 1;
+    }
+    entt::registry &registry = entt.registry();
+    // load() keeps the order of the state, packed index i is particle i.
+    const auto &entities = registry.storage<Position>();
+    for(size_t i = 0; i < pinned.size(); i += 10) {
+        registry.emplace<Pinned>(entities.data()[i]);
+    }
+    const double perPass = static_cast<double>(options.passes) * particles;
+
+    Clock::time_point start = Clock::now();
+    for(int pass = 0; pass < options.passes; ++pass) {
+        for(size_t i = 0; i < state.pos.size(); ++i) {
+            Move(state.pos[i], state.vel[i], world);
+        }
+    }
+    const double vectors = Seconds(start) * 1e9 / perPass;
+
+    start = Clock::now();
+    for(int pass = 0; pass < options.passes; ++pass) {
+        entt.each([world](entt::entity, Position &pos, Velocity &vel, ParticleColor &) { Move(pos, vel, world); });
+    }
+    const double group = Seconds(start) * 1e9 / perPass;
+
+    start = Clock::now();
+    for(int pass = 0; pass < options.passes; ++pass) {
+        for(size_t i = 0; i < state.pos.size(); ++i) {
+            if(!pinned[i]) {
+                Move(state.pos[i], state.vel[i], world);
+            }
+        }
+    }
+    const double vectorsPinned = Seconds(start) * 1e9 / perPass;
+
+    const auto view = registry.view<Position, Velocity>(entt::exclude<Pinned>);
+    start = Clock::now();
+    for(int pass = 0; pass < options.passes; ++pass) {
+        view.each([world](Position &pos, Velocity &vel) { Move(pos, vel, world); });
+    }
+    const double viewPinned = Seconds(start) * 1e9 / perPass;
+
+    printf(", \"iterate\": {\"vectors_ns\": %.3f, \"group_ns\": %.3f, \"vectors_pinned_ns\": %.3f, \"view_pinned_ns\": %.3f}", vectors,
+           group, vectorsPinned, viewPinned);
+}
+
+void RunChurn(const Options &options, int particles) {
+    // The default brush of the app
+    constexpr float Radius = 24;
+    const World world = WorldFor(particles);
+
+    State state = RandomState(options, particles, world);
+    ParticlePool pool(state, world.width, world.height);
+    EnttParticles entt(world.width, world.height);
+    entt.load(state);
+
+    size_t erased = 0;
+    const auto run = [&](auto &storage) {
+        Random random(options.seed);
+        Random brushes(options.seed + 1);
+        Disc previous{brushes.uniform(0, world.width), brushes.uniform(0, world.height), Radius};
+        erased = 0;
+        const Clock::time_point start = Clock::now();
+        for(int round = 0; round < options.rounds; ++round) {
+            const Disc next{brushes.uniform(0, world.width), brushes.uniform(0, world.height), Radius};
+            storage.spawn(static_cast<size_t>(options.brush), next, static_cast<int>(random.below(Colors)), random);
+            erased += storage.erase(previous);
+            previous = next;
+        }
+        return Seconds(start) * 1e9 / options.rounds;
+    };
+    const double vectors = run(pool);
+    const double registry = run(entt);
+
+    printf(", \"churn\": {\"spawned_per_round\": %d, \"erased_per_round\": %.0f, \"vectors_ns\": %.0f, \"registry_ns\": %.0f}",
+           options.brush, static_cast<double>(erased) / options.rounds, vectors, registry);
+}
+
+void RunStep(const Options &options, int particles) {
+    const World world = WorldFor(particles);
+    setRandomSeed(options.seed);
+    Config config = generateRandomConfig(Colors);
+    State state = generateRandomState(particles, Colors, world.width, world.height);
+
+    double vectors = 0;
+    {
+        Engine engine(config, state, world.width, world.height, options.threads);
+        engine.step();
+        const Clock::time_point start = Clock::now();
+        for(int step = 0; step < options.steps; ++step) {
+            engine.step();
+        }
+        vectors = Seconds(start) * 1e9 / options.steps;
+    }
+
+    setRandomSeed(options.seed);
+    state = generateRandomState(particles, Colors, world.width, world.height);
+    EnttParticles entt(world.width, world.height);
+    entt.load(state);
+    State gathered;
+    Engine engine(config, gathered, world.width, world.height, options.threads);
+    entt.gather(gathered);
+    engine.step();
+    entt.scatter(gathered);
+
+    double copies = 0;
+    const Clock::time_point start = Clock::now();
+    for(int step = 0; step < options.steps; ++step) {
+        const Clock::time_point gatherStart = Clock::now();
+        entt.gather(gathered);
+        copies += Seconds(gatherStart);
+        engine.step();
+        const Clock::time_point scatterStart = Clock::now();
+        entt.scatter(gathered);
+        copies += Seconds(scatterStart);
+    }
+    const double registry = Seconds(start) * 1e9 / options.steps;
+
+    printf(", \"step\": {\"vectors_ns\": %.0f, \"registry_ns\": %.0f, \"gather_scatter_ns\": %.0f}", vectors, registry,
+           copies * 1e9 / options.steps);
+}
+
+void RunMemory(const Options &options, int particles) {
+    const World world = WorldFor(particles);
+    const State state = RandomState(options, particles, world);
+    // Copies sized exactly, the generated vectors may hold spare capacity
+    State exact;
+    exact.colors.assign(state.colors.begin(), state.colors.end());
+    exact.pos.assign(state.pos.begin(), state.pos.end());
+    exact.vel.assign(state.vel.begin(), state.vel.end());
+    exact.ids.assign(state.ids.begin(), state.ids.end());
+
+    EnttParticles entt(world.width, world.height);
+    entt.load(state);
+
+    printf(", \"memory\": {\"vectors_bytes_per_particle\": %.1f, \"registry_bytes_per_particle\": %.1f}",
+           static_cast<double>(StateBytes(exact)) / particles, static_cast<double>(entt.memoryBytes()) / particles);
+}
+} // namespace
+
+int main(int argc, char **argv) {
+    Options options;
+    if(!ParseOptions(argc, argv, options)) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+
+    printf("{\n  \"threads\": %zu,\n  \"cases\": [", options.threads);
+    bool first = true;
+    for(const int particles : options.particles) {
+        const World world = WorldFor(particles);
+        fprintf(stderr, "particles=%d\n", particles);
+        printf("%s\n    {\"particles\": %d, \"world\": [%d, %d]", first ? "" : ",", particles, world.width, world.height);
+        first = false;
+        RunIterate(options, particles);
+        RunChurn(options, particles);
+        RunStep(options, particles);
+        RunMemory(options, particles);
+        printf("}");
+        fflush(stdout);
+    }
+    printf("\n  ]\n}\n");
+    return 0;
+}